@@ -102,7 +102,8 @@ bool vm_load_file(VM* vm, const char* path) {
     }
 
     // init registers
-    vm->regs = (Registers*)calloc(1, sizeof(Registers));
+    // reserved, not committed (see regfile.h), vm_run commits what the entry frame needs
+    vm->regs = regs_new();
     if (!vm->regs) {
         vm->panic_code = PANIC_OOM;
         goto fail_code;
@@ -126,6 +127,7 @@ bool vm_load_file(VM* vm, const char* path) {
         
         // turn packed callables into function pointers at load time (avoids runtime bs for a little startup delay whateverrrrr)
         for (u32 i = 0; i < constcount; i++) {
+            // OBJ constants are strings, described by their bytes (see str.h). vm_load builds them
             if (consts[i].type != CALLABLE) continue;
 
             // copy vals out
@@ -135,8 +137,8 @@ bool vm_load_file(VM* vm, const char* path) {
             memcpy(&argc, &consts[i].val[4], sizeof(u16));
             memcpy(&regc, &consts[i].val[6], sizeof(u16));
             
-            // malloc and poll
-            Func* fn = (Func*)malloc(sizeof(Func));
+            // slab and poll
+            Func* fn = (Func*)slab_alloc(&vm->funcslab, sizeof(Func));
             if (!fn) {
                 err = PANIC_OOM;
                 goto fail_code;
@@ -148,6 +150,10 @@ bool vm_load_file(VM* vm, const char* path) {
             fn->as.bc.entry_ip = entry_ip;
             fn->as.bc.argc = argc;
             fn->as.bc.regc = regc;
+            fn->as.bc.id = i;
+            fn->as.bc.calls = 0;
+            fn->as.bc.jit = NULL;
+            fn->as.bc.aot = NULL;
             
             funcs[i] = fn;
             memcpy(consts[i].val, &fn, sizeof(Func*));
@@ -163,6 +169,11 @@ bool vm_load_file(VM* vm, const char* path) {
             err = PANIC_GLOBAL_READ;
             goto fail_code;
         }
+        for (u32 i = 0; i < globalcount; i++) {
+            if (globals[i].type != OBJ) continue;
+            err = PANIC_GLOBAL_READ;
+            goto fail_code;
+        }
     }
     // END POTENTIAL EDIT
 
@@ -177,11 +188,11 @@ bool vm_load_file(VM* vm, const char* path) {
         goto fail_code;
     }
 
-    // free moved globals
-    if (globals) {
-        free(globals);
-        globals = NULL;
-    }
+    // past this point the vm owns code (and its own split copy of both pools), so a failure (decoding, pools)
+    // is cleaned up by vm_free. the Values read here are done with either way
+    free(consts);
+    free(globals);
+    if (vm->panic_code != NO_ERROR) return false;
 
     // TODO: load constant and global pools next
     // vm->file_flags = flags; will deal with storing flags later
@@ -203,17 +214,16 @@ fail_code:
         globals = NULL;
     }
 
+    // the Funcs themselves go with the slab
     if (funcs) {
-        for (u32 i = 0; i < constcount; i++) {
-            free(funcs[i]);
-        }
+        slab_release(&vm->funcslab);
         free(funcs);
         vm->funcs = NULL;
         vm->funccount = 0;
     }
     
     if (vm->regs) {
-        free(vm->regs);
+        regs_free(vm->regs);
         vm->regs = NULL;
     }
 
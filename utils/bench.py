@@ -0,0 +1,137 @@
+"""
+microbenchmark for the dispatch loop. writes a counted loop to a .stk file,
+runs it through each VM binary given and reports ns per executed instruction. then times the same loop with its
+step written three ways (a hoisted register, a LOADI every iteration, ADDI) and as a FORPREP/FORLOOP pair, to
+show what the immediate and for loop ops save. last, a loop whose body touches registers spread over a wider and
+wider window, to show what the register layout costs in cache once a frame stops fitting (split vs NaN-boxed).
+usage: python bench.py ./bench_switch.out ./bench_threaded.out
+"""
+from sys import argv
+from time import perf_counter
+from subprocess import run, DEVNULL
+from pathlib import Path
+
+from test import Opcode, ins, write_stk, LOADC, LOADI, HALT, WIDE, i64, func
+
+# two loop sizes, timing the difference cancels out process startup and file loading
+SMALL: int = 1_000_000
+LARGE: int = 11_000_000
+REPEATS: int = 5
+
+# the ways the loop's += 1 can be written, and how many instructions that is per iteration
+STEPS: dict[str, int] = { "register": 3, "load": 4, "immediate": 3, "forloop": 1 }
+
+# footprint loop: registers touched per iteration, the windows they're spread over, and its own loop sizes
+TOUCHED: int = 512
+WINDOWS: tuple[int, ...] = (1024, 8192, 65535)
+SPREAD_SMALL: int = 1_000
+SPREAD_LARGE: int = 11_000
+
+# bytes a register takes in each layout (NaN-boxed wide values also use a side slot, the loop has none)
+LAYOUTS: dict[str, str] = { "split": "8 B payload + 1 B tag, two arrays", "nanbox": "8 B, one word" }
+
+def counted_loop(n: int, step: str = "register") -> tuple[list[int], int]:
+    """
+    i = 0; while (i < n) i += 1
+    returns the words and how many instructions the vm will actually execute
+    """
+    # index, limit, step in r1..r3, FORLOOP jumps back to itself
+    if step == "forloop":
+        words = [LOADC(2, 0), LOADI(1, 0), LOADI(3, 1), ins(Opcode.FORPREP, 1, 0, 1), ins(Opcode.FORLOOP, 1, 0xFF, 0xFF), HALT()]
+        return words, 4 + n + 1
+
+    body = {
+        "register":  [ins(Opcode.ADD, 1, 1, 2)],
+        "load":      [LOADI(2, 1), ins(Opcode.ADD, 1, 1, 2)],
+        "immediate": [ins(Opcode.ADDI, 1, 1, 1)],
+    }[step]
+    setup = [LOADC(0, 0), LOADI(1, 0)] + ([LOADI(2, 1)] if step == "register" else [])
+    back = -(len(body) + 2)
+    words = [
+        *setup, *body,
+        ins(Opcode.LT, 3, 1, 0),
+        ins(Opcode.JMPIF, 3, (back >> 8) & 0xFF, back & 0xFF),   # back to the top of the body
+        HALT(),
+    ]
+    return words, len(setup) + STEPS[step] * n + 1
+
+def spread_loop(n: int, window: int) -> list[int]:
+    """
+    a function with a window sized frame, each iteration adds 1 to TOUCHED registers evenly spread across it.
+    r0 = index, r1 = 1, r2 = n, r3 = loop condition, the spread ones start at r4
+    """
+    stride = (window - 4) // TOUCHED
+    spread = [4 + k * stride for k in range(TOUCHED)]
+
+    def wide(op, a, b, c) -> list[int]:
+        return [WIDE(a >> 8, b >> 8, c >> 8), ins(op, a & 0xFF, b & 0xFF, c & 0xFF)]
+
+    setup = [LOADI(0, 0), LOADI(1, 1), LOADC(2, 1)]
+    for r in spread: setup += [WIDE(r >> 8), LOADI(r & 0xFF, 0)]
+    body = [word for r in spread for word in wide(Opcode.ADD, r, r, 1)]
+    body += [ins(Opcode.ADD, 0, 0, 1), ins(Opcode.LT, 3, 0, 2)]
+    back = -(len(body) + 1)
+    return [
+        LOADC(0, 0), ins(Opcode.CALL, 0, 0, 1), HALT(),
+        *setup, *body,
+        ins(Opcode.JMPIF, 3, (back >> 8) & 0xFF, back & 0xFF),
+        ins(Opcode.RET, 0),
+    ]
+
+def best_time(vm: str, path: Path) -> float:
+    """best wall time out of REPEATS runs (fails loudly if the vm does)"""
+    best = float("inf")
+    for _ in range(REPEATS):
+        start = perf_counter()
+        result = run([vm, str(path)], stdout=DEVNULL)
+        elapsed = perf_counter() - start
+
+        if result.returncode != 0: raise SystemExit(f"{vm} exited with {result.returncode}")
+        best = min(best, elapsed)
+    return best
+
+def main() -> None:
+    if len(argv) < 2:
+        return print("usage: bench.py vm_binary [vm_binary ...]")
+
+    Path("tests").mkdir(exist_ok=True)
+    small, large = Path("tests/bench_small.stk"), Path("tests/bench_large.stk")
+
+    def measure(step: str) -> int:
+        words, small_count = counted_loop(SMALL, step)
+        write_stk(small, words, (i64(SMALL),))
+        words, large_count = counted_loop(LARGE, step)
+        write_stk(large, words, (i64(LARGE),))
+        return large_count - small_count
+
+    count = measure("register")
+    print(f"counted loop, {count} instructions measured, best of {REPEATS}")
+    for vm in argv[1:]:
+        elapsed = best_time(vm, large) - best_time(vm, small)
+        ns = elapsed * 1e9 / count
+        print(f"  {Path(vm).name:<24} {ns:6.3f} ns/instruction")
+
+    # same loop, per iteration instead of per instruction since the instruction counts differ
+    iterations = LARGE - SMALL
+    print(f"\nloop step, {iterations} iterations measured")
+    for step, per in STEPS.items():
+        measure(step)
+        print(f"  {step:<10} {per} instructions/iteration")
+        for vm in argv[1:]:
+            elapsed = best_time(vm, large) - best_time(vm, small)
+            print(f"    {Path(vm).name:<22} {elapsed * 1e9 / iterations:6.3f} ns/iteration")
+
+    # per register touched, so windows compare directly. the split layout's tags stop sharing lines first
+    iterations = SPREAD_LARGE - SPREAD_SMALL
+    print(f"\nregister footprint, {TOUCHED} registers touched per iteration, {iterations} iterations measured")
+    for layout, size in LAYOUTS.items(): print(f"  {layout:<10} {size}")
+    for window in WINDOWS:
+        for path, n in ((small, SPREAD_SMALL), (large, SPREAD_LARGE)):
+            write_stk(path, spread_loop(n, window), (func(3, 0, window), i64(n)))
+        print(f"  {window} register window")
+        for vm in argv[1:]:
+            elapsed = best_time(vm, large) - best_time(vm, small)
+            print(f"    {Path(vm).name:<22} {elapsed * 1e9 / (iterations * TOUCHED):6.3f} ns/register")
+
+if __name__ == "__main__":
+    main()
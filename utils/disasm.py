@@ -51,9 +51,46 @@ def format_instr(idx: int, word: int) -> str:
     if name in ("LOADC", "LOADG", "STOREG"):
         return f"{idx:04d}: {raw}  {name} r{a}, idx={b}"
     
+    if name == "JMPTABLE":
+        return f"{idx:04d}: {raw}  JMPTABLE r{a}, table={b}"
+
     if name in ("COPY", "MOVE"):
         return f"{idx:04d}: {raw}  {name} r{a}, r{b}"
     
+    # arrays
+    if name == "NEWARR":
+        elem = Type(c).name if c in Type._value2member_map_ else c
+        return f"{idx:04d}: {raw}  NEWARR r{a}, len=r{b}, elem={elem}"
+
+    if name in ("ARRLEN", "ARRSUM", "ARRFILL", "ARRADD"):
+        return f"{idx:04d}: {raw}  {name} r{a}, r{b}"
+
+    if name == "ARRCOPY":
+        return f"{idx:04d}: {raw}  ARRCOPY r{a}, r{b}, n=r{c}"
+
+    if name == "ARRGET":
+        return f"{idx:04d}: {raw}  ARRGET r{a}, r{b}[r{c}]"
+
+    if name == "ARRSET":
+        return f"{idx:04d}: {raw}  ARRSET r{a}[r{b}], r{c}"
+
+    # tables
+    if name == "NEWTABLE":
+        return f"{idx:04d}: {raw}  NEWTABLE r{a}"
+
+    if name == "GETELEM":
+        return f"{idx:04d}: {raw}  GETELEM r{a}, r{b}[r{c}]"
+
+    if name == "SETELEM":
+        return f"{idx:04d}: {raw}  SETELEM r{a}[r{b}], r{c}"
+
+    # strings
+    if name == "CONCAT":
+        return f"{idx:04d}: {raw}  CONCAT r{a}, r{b}, r{c}"
+
+    if name == "STRLEN":
+        return f"{idx:04d}: {raw}  STRLEN r{a}, r{b}"
+
     # jumps
     if name == "JMP":
         off = (a << 16) | (b << 8) | c
@@ -62,7 +99,25 @@ def format_instr(idx: int, word: int) -> str:
     
     if name in ("JMPIF", "JMPIFZ"):
         return f"{idx:04d}: {raw}  {name} r{a}, off={c}"
+
+    # for loops, b/c are one signed 16 bit offset
+    if name in ("FORPREP", "FORLOOP", "FORPREP_D", "FORLOOP_D"):
+        return f"{idx:04d}: {raw}  {name} r{a}, off={signed((b << 8) | c, 16)}"
+
+    # prefix, the high bytes of the next op's operands
+    if name == "WIDE":
+        return f"{idx:04d}: {raw}  WIDE hi a={a}, b={b}, c={c}"
     
+    # calls
+    if name == "CALL":
+        return f"{idx:04d}: {raw}  CALL r{a}, argc={b}, dest=r{c}"
+
+    if name == "TAILCALL":
+        return f"{idx:04d}: {raw}  TAILCALL r{a}, argc={b}"
+
+    if name == "RET":
+        return f"{idx:04d}: {raw}  RET r{a}"
+
     # all binary ops
     if name in (
         "AND","OR","XOR","SHL","SHR","SAR",
@@ -72,9 +127,14 @@ def format_instr(idx: int, word: int) -> str:
         "ADD_F","SUB_F","MUL_F","DIV_F","EQ_F","NEQ_F","GT_F","GE_F","LT_F","LE_F",
         "ADD_D","SUB_D","MUL_D","DIV_D","EQ_D","NEQ_D","GT_D","GE_D","LT_D","LE_D",
         "AND_U","OR_U","XOR_U","SHL_U","SHR_U",
+        "ADD_N","SUB_N","MUL_N","DIV_N","MOD_N","EQ_N","NEQ_N","GT_N","GE_N","LT_N","LE_N",
     ):
         return f"{idx:04d}: {raw}  {name} r{a}, r{b}, r{c}"
     
+    # dest, src, signed 8 bit immediate
+    if name in ("ADDI","SUBI","MULI","SHLI","SHRI","EQI","NEQI","GTI","GEI","LTI","LEI"):
+        return f"{idx:04d}: {raw}  {name} r{a}, r{b}, {signed(c, 8)}"
+
     # unary ops
     if name.startswith("NEG") or name in ("LNOT","BNOT","BNOT_U","NEG_U"):
         return f"{idx:04d}: {raw}  {name} r{a}"
@@ -0,0 +1,493 @@
+/**
+ * @file stk2c.c
+ * @author Noah Mingolelli
+ * @brief ahead of time transpiler: .stk programs -> one C file of native functions for the vm to link in
+ * License: GPLv3
+ *
+ * usage: stk2c out.c prog.stk [more.stk ...]   (or just make aot PROG="...")
+ *
+ * every program is loaded exactly like the vm loads it (reader, decode, verify, fuse), so what gets transpiled is
+ * the decoded stream: absolute jump targets, resolved pools, fused pairs, and generic ops the verifier already
+ * proved. each bytecode function (one per distinct CALLABLE entry) becomes
+ *     static u32 pP_fE(VM* vm, TypedValue* R, u8* T, u32 ip)
+ * with a label per instruction and the same C the handlers in interp.h run, straight on the register window.
+ * anything that needs the interpreter (calls, returns, halts, type mismatches) returns its ip. see aot.h
+ */
+#include "vm.h"
+#include "decode.h"
+#include "aot.h"
+#include "io/reader.h"
+
+// how an op gets written out
+enum {
+    K_EXIT,    // hand back to the interpreter
+    K_BIN,     // typed binary op
+    K_CMP,     // typed compare
+    K_UN,      // typed unary op (in place)
+    K_CAST,    // conversion
+    K_CMPJMP,  // fused compare + branch
+    K_BINK,    // fused load + add/sub
+    K_BINI,    // i64 op against an immediate
+    K_CMPI,    // i64 compare against an immediate
+    K_GBIN,    // generic binary op, switches on the type at runtime
+    K_GCMP,    // generic compare
+    K_GUN,     // generic unary op
+};
+
+typedef struct {
+    u8          kind;
+    u8          tag;  // operand type (source type for casts)
+    u8          to;   // result type for casts, 1 on generic ops that only take integers
+    const char* op;   // the C operator
+} OpInfo;
+
+#define BIN(TAG, OP)      { K_BIN, (TAG), 0, (OP) }
+#define CMP(TAG, OP)      { K_CMP, (TAG), 0, (OP) }
+#define UN(TAG, OP)       { K_UN, (TAG), 0, (OP) }
+#define CAST(FROM, TO)    { K_CAST, (FROM), (TO), "" }
+#define CMPJMP(TAG, OP)   { K_CMPJMP, (TAG), 0, (OP) }
+#define BINK(TAG, OP)     { K_BINK, (TAG), 0, (OP) }
+#define BINI(OP)          { K_BINI, I64, 0, (OP) }
+#define CMPI(OP)          { K_CMPI, I64, 0, (OP) }
+#define GBIN(OP, INTS)    { K_GBIN, 0, (INTS), (OP) }
+#define GCMP(OP)          { K_GCMP, 0, 0, (OP) }
+
+static const OpInfo OPS[256] = {
+    [ADD] = BIN(I64, "+"), [SUB] = BIN(I64, "-"), [MUL] = BIN(I64, "*"), [DIV] = BIN(I64, "/"), [MOD] = BIN(I64, "%"),
+    [AND] = BIN(I64, "&"), [OR] = BIN(I64, "|"), [XOR] = BIN(I64, "^"), [SHL] = BIN(I64, "<<"), [SHR] = BIN(I64, ">>"),
+    [NEG] = UN(I64, "-"), [BNOT] = UN(I64, "~"),
+    [EQ] = CMP(I64, "=="), [NEQ] = CMP(I64, "!="), [GT] = CMP(I64, ">"), [GE] = CMP(I64, ">="), [LT] = CMP(I64, "<"), [LE] = CMP(I64, "<="),
+
+    [ADD_U] = BIN(U64, "+"), [SUB_U] = BIN(U64, "-"), [MUL_U] = BIN(U64, "*"), [DIV_U] = BIN(U64, "/"), [MOD_U] = BIN(U64, "%"),
+    [AND_U] = BIN(U64, "&"), [OR_U] = BIN(U64, "|"), [XOR_U] = BIN(U64, "^"), [SHL_U] = BIN(U64, "<<"), [SHR_U] = BIN(U64, ">>"),
+    [NEG_U] = UN(U64, "-"), [BNOT_U] = UN(U64, "~"),
+    [EQ_U] = CMP(U64, "=="), [NEQ_U] = CMP(U64, "!="), [GT_U] = CMP(U64, ">"), [GE_U] = CMP(U64, ">="), [LT_U] = CMP(U64, "<"), [LE_U] = CMP(U64, "<="),
+
+    [ADD_F] = BIN(FLOAT, "+"), [SUB_F] = BIN(FLOAT, "-"), [MUL_F] = BIN(FLOAT, "*"), [DIV_F] = BIN(FLOAT, "/"),
+    [NEG_F] = UN(FLOAT, "-"),
+    [EQ_F] = CMP(FLOAT, "=="), [NEQ_F] = CMP(FLOAT, "!="), [GT_F] = CMP(FLOAT, ">"), [GE_F] = CMP(FLOAT, ">="), [LT_F] = CMP(FLOAT, "<"), [LE_F] = CMP(FLOAT, "<="),
+
+    [ADD_D] = BIN(DOUBLE, "+"), [SUB_D] = BIN(DOUBLE, "-"), [MUL_D] = BIN(DOUBLE, "*"), [DIV_D] = BIN(DOUBLE, "/"),
+    [NEG_D] = UN(DOUBLE, "-"),
+    [EQ_D] = CMP(DOUBLE, "=="), [NEQ_D] = CMP(DOUBLE, "!="), [GT_D] = CMP(DOUBLE, ">"), [GE_D] = CMP(DOUBLE, ">="), [LT_D] = CMP(DOUBLE, "<"), [LE_D] = CMP(DOUBLE, "<="),
+
+    [I2D] = CAST(I64, DOUBLE), [I2F] = CAST(I64, FLOAT), [D2I] = CAST(DOUBLE, I64), [F2I] = CAST(FLOAT, I64),
+    [I2U] = CAST(I64, U64), [U2I] = CAST(U64, I64), [U2D] = CAST(U64, DOUBLE), [U2F] = CAST(U64, FLOAT),
+    [D2U] = CAST(DOUBLE, U64), [F2U] = CAST(FLOAT, U64),
+
+    [JEQ] = CMPJMP(I64, "=="), [JNEQ] = CMPJMP(I64, "!="), [JGT] = CMPJMP(I64, ">"),
+    [JGE] = CMPJMP(I64, ">="), [JLT] = CMPJMP(I64, "<"), [JLE] = CMPJMP(I64, "<="),
+    [JEQ_U] = CMPJMP(U64, "=="), [JNEQ_U] = CMPJMP(U64, "!="), [JGT_U] = CMPJMP(U64, ">"),
+    [JGE_U] = CMPJMP(U64, ">="), [JLT_U] = CMPJMP(U64, "<"), [JLE_U] = CMPJMP(U64, "<="),
+    [JEQ_D] = CMPJMP(DOUBLE, "=="), [JNEQ_D] = CMPJMP(DOUBLE, "!="), [JGT_D] = CMPJMP(DOUBLE, ">"),
+    [JGE_D] = CMPJMP(DOUBLE, ">="), [JLT_D] = CMPJMP(DOUBLE, "<"), [JLE_D] = CMPJMP(DOUBLE, "<="),
+    [ADD_KI] = BINK(I64, "+"), [SUB_KI] = BINK(I64, "-"), [ADD_KD] = BINK(DOUBLE, "+"), [SUB_KD] = BINK(DOUBLE, "-"),
+
+    [ADDI] = BINI("+"), [SUBI] = BINI("-"), [MULI] = BINI("*"), [SHLI] = BINI("<<"), [SHRI] = BINI(">>"),
+    [EQI] = CMPI("=="), [NEQI] = CMPI("!="), [GTI] = CMPI(">"), [GEI] = CMPI(">="), [LTI] = CMPI("<"), [LEI] = CMPI("<="),
+
+    [ADD_N] = GBIN("+", 0), [SUB_N] = GBIN("-", 0), [MUL_N] = GBIN("*", 0), [DIV_N] = GBIN("/", 0), [MOD_N] = GBIN("%", 1),
+    [NEG_N] = { K_GUN, 0, 0, "-" },
+    [EQ_N] = GCMP("=="), [NEQ_N] = GCMP("!="), [GT_N] = GCMP(">"), [GE_N] = GCMP(">="), [LT_N] = GCMP("<"), [LE_N] = GCMP("<="),
+};
+
+// type tag -> its name, its TypedValue field, its C type
+static const char* const TAG_NAME[CALLABLE + 1] = {
+    [NUL] = "NUL", [BOOL] = "BOOL", [U64] = "U64", [I64] = "I64",
+    [FLOAT] = "FLOAT", [DOUBLE] = "DOUBLE", [OBJ] = "OBJ", [CALLABLE] = "CALLABLE",
+};
+static const char FIELD[CALLABLE + 1] = { [BOOL] = 'u', [U64] = 'u', [I64] = 'i', [FLOAT] = 'f', [DOUBLE] = 'd' };
+static const char* const CTYPE[CALLABLE + 1] = { [U64] = "u64", [I64] = "i64", [FLOAT] = "float", [DOUBLE] = "double" };
+
+// the numeric types a generic op can run on
+static const u8 NUMERIC[4] = { I64, U64, FLOAT, DOUBLE };
+
+// what's being written, and whether type checks go in
+typedef struct {
+    FILE*     out;
+    const VM* vm;
+    bool      checked;
+} Gen;
+
+// leave at ip unless register r holds tag (only when the program didn't verify, same as the unchecked loop)
+static void check(const Gen* g, u16 r, u8 tag, u32 ip) {
+    if (g->checked) fprintf(g->out, "    if (T[%u] != %s) return %uu;\n", r, TAG_NAME[tag], ip);
+}
+
+// the switch over the numeric types a generic op takes, one case per type
+static void generic_cases(const Gen* g, const Inst* in, const OpInfo* info, u32 ip) {
+    for (u32 i = 0; i < 4; i++) {
+        u8 t = NUMERIC[i];
+        if (info->to && (t == FLOAT || t == DOUBLE)) continue;
+        char f = FIELD[t];
+        fprintf(g->out, "        case %s: ", TAG_NAME[t]);
+        switch (info->kind) {
+            case K_GBIN: fprintf(g->out, "R[%u].%c = R[%u].%c %s R[%u].%c; break;\n", in->a, f, in->b, f, info->op, in->c, f); break;
+            case K_GCMP: fprintf(g->out, "R[%u].u = (R[%u].%c %s R[%u].%c) ? 1u : 0u; break;\n", in->a, in->b, f, info->op, in->c, f); break;
+            default:     fprintf(g->out, "R[%u].%c = %sR[%u].%c; break;\n", in->a, f, info->op, in->a, f); break;
+        }
+    }
+    fprintf(g->out, "        default: return %uu;\n    }\n", ip);
+}
+
+/**
+ * write the C for one instruction (jumps only, the caller adds the fallthrough goto)
+ * @param g output and settings
+ * @param ip the instruction
+ */
+static void emit(const Gen* g, u32 ip) {
+    FILE* out = g->out;
+    const Inst* in = &g->vm->code[ip];
+    const OpInfo* info = &OPS[in->op];
+    u8 tag = info->tag;
+    char f = FIELD[tag];
+
+    switch (info->kind) {
+        case K_BIN:
+            check(g, in->b, tag, ip);
+            check(g, in->c, tag, ip);
+            fprintf(out, "    T[%u] = %s;\n", in->a, TAG_NAME[tag]);
+            fprintf(out, "    R[%u].%c = R[%u].%c %s R[%u].%c;\n", in->a, f, in->b, f, info->op, in->c, f);
+            return;
+
+        case K_CMP:
+            check(g, in->b, tag, ip);
+            check(g, in->c, tag, ip);
+            fprintf(out, "    T[%u] = BOOL;\n", in->a);
+            fprintf(out, "    R[%u].u = (R[%u].%c %s R[%u].%c) ? 1u : 0u;\n", in->a, in->b, f, info->op, in->c, f);
+            return;
+
+        case K_UN:
+            check(g, in->a, tag, ip);
+            fprintf(out, "    R[%u].%c = %sR[%u].%c;\n", in->a, f, info->op, in->a, f);
+            return;
+
+        case K_CAST:
+            check(g, in->b, tag, ip);
+            fprintf(out, "    T[%u] = %s;\n", in->a, TAG_NAME[info->to]);
+            fprintf(out, "    R[%u].%c = (%s)R[%u].%c;\n", in->a, FIELD[info->to], CTYPE[info->to], in->b, f);
+            return;
+
+        case K_CMPJMP:
+            check(g, in->b, tag, ip);
+            check(g, in->c, tag, ip);
+            fprintf(out, "    {\n        bool c_ = R[%u].%c %s R[%u].%c;\n", in->b, f, info->op, in->c, f);
+            if (in->aux & FUSE_KEEP) {
+                fprintf(out, "        T[%u] = BOOL;\n        R[%u].u = c_ ? 1u : 0u;\n", in->a, in->a);
+            }
+            fprintf(out, "        if (%sc_) goto L%u;\n    }\n", (in->aux & FUSE_SENSE) ? "" : "!", in->x.target);
+            return;
+
+        // the kept load goes first, same as the handler
+        case K_BINK: {
+            u64 k;
+            memcpy(&k, &in->x, sizeof(u64));
+            char kexpr[48];
+            if (tag == DOUBLE) snprintf(kexpr, sizeof kexpr, "aot_f64(UINT64_C(0x%016" PRIX64 "))", k);
+            else               snprintf(kexpr, sizeof kexpr, "(i64)UINT64_C(0x%016" PRIX64 ")", k);
+            if (in->aux & FUSE_KEEP) fprintf(out, "    T[%u] = %s;\n    R[%u].%c = %s;\n", in->c, TAG_NAME[tag], in->c, f, kexpr);
+            check(g, in->b, tag, ip);
+            fprintf(out, "    T[%u] = %s;\n", in->a, TAG_NAME[tag]);
+            fprintf(out, "    R[%u].%c = R[%u].%c %s %s;\n", in->a, f, in->b, f, info->op, kexpr);
+            return;
+        }
+
+        case K_BINI:
+            check(g, in->b, tag, ip);
+            fprintf(out, "    T[%u] = I64;\n", in->a);
+            fprintf(out, "    R[%u].i = R[%u].i %s (i64)%" PRId64 ";\n", in->a, in->b, info->op, in->x.imm);
+            return;
+
+        case K_CMPI:
+            check(g, in->b, tag, ip);
+            fprintf(out, "    T[%u] = BOOL;\n", in->a);
+            fprintf(out, "    R[%u].u = (R[%u].i %s (i64)%" PRId64 ") ? 1u : 0u;\n", in->a, in->b, info->op, in->x.imm);
+            return;
+
+        // generic ops always check, a type they don't take (or mismatched sources) goes back to the interpreter
+        case K_GBIN: case K_GCMP:
+            if (in->b != in->c) fprintf(out, "    if (T[%u] != T[%u]) return %uu;\n", in->b, in->c, ip);
+            fprintf(out, "    switch (T[%u]) {\n", in->b);
+            generic_cases(g, in, info, ip);
+            if (info->kind == K_GCMP) fprintf(out, "    T[%u] = BOOL;\n", in->a);
+            else if (in->a != in->b)  fprintf(out, "    T[%u] = T[%u];\n", in->a, in->b);
+            return;
+
+        case K_GUN:
+            fprintf(out, "    switch (T[%u]) {\n", in->a);
+            generic_cases(g, in, info, ip);
+            return;
+
+        default:
+            break;
+    }
+
+    switch (in->op) {
+        case JMP:
+            fprintf(out, "    goto L%u;\n", in->x.target);
+            return;
+
+        case JMPIF:
+            fprintf(out, "    if (!value_falsy(T[%u], R[%u])) goto L%u;\n", in->a, in->a, in->x.target);
+            return;
+
+        case JMPIFZ:
+            fprintf(out, "    if (value_falsy(T[%u], R[%u])) goto L%u;\n", in->a, in->a, in->x.target);
+            return;
+
+        case COPY: case MOVE:
+            fprintf(out, "    T[%u] = T[%u];\n    R[%u] = R[%u];\n", in->a, in->b, in->a, in->b);
+            if (in->op == MOVE) fprintf(out, "    T[%u] = NUL;\n    R[%u].u = 0;\n", in->b, in->b);
+            return;
+
+        case WIDE:
+            return;
+
+        // a plain switch, the C compiler turns it back into a table. anything else falls through
+        case JMPTABLE: {
+            u32 ncases;
+            const u32* cases = decoded_cases(in, &ncases);
+            check(g, in->a, I64, ip);
+            fprintf(out, "    switch (R[%u].u) {\n", in->a);
+            for (u32 c = 0; c < ncases; c++) fprintf(out, "        case %uu: goto L%u;\n", c, cases[c]);
+            fprintf(out, "        default: break;\n    }\n");
+            return;
+        }
+
+        // same as the handlers, a zero step goes back to the interpreter to panic
+        case FORPREP: case FORPREP_D: case FORLOOP: case FORLOOP_D: {
+            bool dbl = in->op == FORPREP_D || in->op == FORLOOP_D;
+            char ff = dbl ? 'd' : 'i';
+            for (u32 r = 0; r < 3; r++) check(g, (u16)(in->a + r), dbl ? DOUBLE : I64, ip);
+            if (in->op == FORLOOP) {
+                fprintf(out, "    {\n        bool near_ = R[%u].i < 0 ? R[%u].i > R[%u].i : R[%u].i < R[%u].i;\n",
+                        in->a + 2, in->a, in->a + 1, in->a, in->a + 1);
+                fprintf(out, "        u64 s_ = R[%u].i < 0 ? ~(u64)0 : 0;\n", in->a + 2);
+                fprintf(out, "        u64 left_ = ((R[%u].u - R[%u].u) ^ s_) - s_;\n", in->a + 1, in->a);
+                fprintf(out, "        u64 stride_ = (R[%u].u ^ s_) - s_;\n", in->a + 2);
+                fprintf(out, "        R[%u].u += R[%u].u;\n", in->a, in->a + 2);
+                fprintf(out, "        if (near_ && left_ > stride_) goto L%u;\n    }\n", in->x.target);
+                return;
+            }
+            if (in->op == FORLOOP_D) fprintf(out, "    R[%u].d += R[%u].d;\n", in->a, in->a + 2);
+            else                     fprintf(out, "    if (R[%u].%c == 0) return %uu;\n", in->a + 2, ff, ip);
+            fprintf(out, "    if (%s(R[%u].i < 0 ? R[%u].%c > R[%u].%c : R[%u].%c < R[%u].%c)) goto L%u;\n",
+                    in->op == FORLOOP_D ? "" : "!", in->a + 2, in->a, ff, in->a + 1, ff, in->a, ff, in->a + 1, ff, in->x.target);
+            return;
+        }
+
+        case LOADI:
+            fprintf(out, "    T[%u] = I64;\n    R[%u].i = %" PRId64 ";\n", in->a, in->a, in->x.imm);
+            return;
+
+        // plain constants get baked in, callables/objects are pointers that only exist at runtime
+        case LOADC: {
+            u32 idx = (u32)(in->x.k - g->vm->consts);
+            u8 type = in->aux;
+            if (type == CALLABLE || type == OBJ || type > CALLABLE) {
+                fprintf(out, "    T[%u] = vm->consttypes[%u];\n    R[%u] = vm->consts[%u];\n", in->a, idx, in->a, idx);
+            } else {
+                fprintf(out, "    T[%u] = %s;\n    R[%u].u = UINT64_C(0x%016" PRIX64 ");\n", in->a, TAG_NAME[type], in->a, in->x.k->u);
+            }
+            return;
+        }
+
+        case LOADG: {
+            fprintf(out, "    T[%u] = vm->globaltypes[%u];\n    R[%u] = vm->globals[%u];\n", in->a, in->x.slot, in->a, in->x.slot);
+            return;
+        }
+
+        // objects need the gc's barrier, the interpreter does that one
+        case STOREG: {
+            fprintf(out, "    if (T[%u] == OBJ) return %uu;\n", in->a, ip);
+            fprintf(out, "    vm->globaltypes[%u] = T[%u];\n    vm->globals[%u] = R[%u];\n", in->x.slot, in->a, in->x.slot, in->a);
+            return;
+        }
+
+        case LNOT:
+            check(g, in->a, BOOL, ip);
+            fprintf(out, "    R[%u].u = R[%u].u ? 0u : 1u;\n", in->a, in->a);
+            return;
+
+        // calls, returns, halts, traps, and anything without a translation
+        default:
+            fprintf(out, "    return %uu;\n", ip);
+            return;
+    }
+}
+
+/**
+ * write one function: everything reachable from entry without going through a call
+ * @return false if it ran out of memory
+ */
+static bool emit_function(const Gen* g, u32 prog, u32 entry) {
+    const VM* vm = g->vm;
+    u32 total = vm->icount + DECODE_PAD;
+    bool* seen = (bool*)calloc(total, sizeof(bool));
+    bool* label = (bool*)calloc(total, sizeof(bool));
+    bool* resume = (bool*)calloc(total, sizeof(bool));
+    u32* work = (u32*)malloc(total * sizeof(u32));
+    if (!seen || !label || !resume || !work) {
+        free(seen); free(label); free(resume); free(work);
+        return false;
+    }
+
+    u32 n = 0;
+    seen[entry] = true;
+    work[n++] = entry;
+    while (n) {
+        u32 ip = work[--n];
+        u32 next[2] = { decoded_next(&vm->code[ip], ip), decoded_target(&vm->code[ip]) };
+        u32 ncases;
+        const u32* cases = decoded_cases(&vm->code[ip], &ncases);
+        for (u32 i = 0; i < 2 + ncases; i++) {
+            u32 s = i < 2 ? next[i] : cases[i - 2];
+            if (s >= total || seen[s]) continue;
+            seen[s] = true;
+            work[n++] = s;
+        }
+    }
+
+    // where the interpreter can hand back in: the entry, and right after every call
+    resume[entry] = label[entry] = true;
+    for (u32 ip = 0; ip < total; ip++) {
+        if (!seen[ip]) continue;
+        const Inst* in = &vm->code[ip];
+        if (in->op == CALL && ip + 1 < total) resume[ip + 1] = label[ip + 1] = true;
+
+        u32 t = decoded_target(in);
+        if (t < total) label[t] = true;
+
+        u32 ncases;
+        const u32* cases = decoded_cases(in, &ncases);
+        for (u32 c = 0; c < ncases; c++) {
+            if (cases[c] < total) label[cases[c]] = true;
+        }
+
+        u32 ft = decoded_next(in, ip), after = ip + 1;
+        while (after < total && !seen[after]) after++;
+        if (ft < total && ft != after) label[ft] = true;
+    }
+
+    fprintf(g->out, "static u32 p%u_f%u(VM* vm, TypedValue* R, u8* T, u32 ip) {\n", prog, entry);
+    fprintf(g->out, "    (void)vm; (void)R; (void)T;\n    switch (ip) {\n");
+    for (u32 ip = 0; ip < total; ip++) {
+        if (resume[ip]) fprintf(g->out, "        case %uu: goto L%u;\n", ip, ip);
+    }
+    fprintf(g->out, "        default: return ip;\n    }\n\n");
+
+    for (u32 ip = 0; ip < total; ip++) {
+        if (!seen[ip]) continue;
+        if (label[ip]) fprintf(g->out, "L%u:\n", ip);
+        emit(g, ip);
+
+        u32 ft = decoded_next(&vm->code[ip], ip), after = ip + 1;
+        while (after < total && !seen[after]) after++;
+        if (ft < total && ft != after) fprintf(g->out, "    goto L%u;\n", ft);
+    }
+    fprintf(g->out, "}\n\n");
+
+    free(seen); free(label); free(resume); free(work);
+    return true;
+}
+
+/**
+ * transpile every bytecode function in a loaded program, then its function table
+ * @return how many functions were written, or -1 on failure
+ */
+static i64 emit_program(FILE* out, const VM* vm, u32 prog) {
+    Gen g = { out, vm, !vm->verified };
+    u32* entries = (u32*)malloc((vm->constcount + 1) * sizeof(u32));
+    if (!entries) return -1;
+
+    // one function per distinct entry (two constants can point at the same code)
+    u32 count = 0;
+    for (u32 i = 0; i < vm->constcount; i++) {
+        Func* fn = vm->funcs ? vm->funcs[i] : NULL;
+        if (!fn || fn->kind != BYTECODE) continue;
+        u32 entry = fn->as.bc.entry_ip;
+        bool dup = false;
+        for (u32 j = 0; j < count && !dup; j++) dup = entries[j] == entry;
+        if (dup) continue;
+        entries[count++] = entry;
+        if (!emit_function(&g, prog, entry)) {
+            free(entries);
+            return -1;
+        }
+    }
+
+    if (count) {
+        fprintf(out, "static const AotFunc p%u_funcs[] = {\n", prog);
+        for (u32 i = 0; i < count; i++) fprintf(out, "    { %uu, p%u_f%u },\n", entries[i], prog, entries[i]);
+        fprintf(out, "};\n\n");
+    }
+    free(entries);
+    return count;
+}
+
+int main(int argc, char const *argv[]) {
+    if (argc < 3) {
+        printf("usage: stk2c out.c prog.stk [more.stk ...]\n");
+        return 1;
+    }
+
+    FILE* out = fopen(argv[1], "w");
+    if (!out) {
+        printf("can't write %s\n", argv[1]);
+        return 1;
+    }
+
+    u32 progs = (u32)(argc - 2);
+    u64* sums = (u64*)malloc(progs * sizeof(u64));
+    bool* checked = (bool*)malloc(progs * sizeof(bool));
+    u32* counts = (u32*)malloc(progs * sizeof(u32));
+    if (!sums || !checked || !counts) {
+        printf("out of memory\n");
+        fclose(out);
+        return 1;
+    }
+
+    fprintf(out, "// generated by utils/stk2c.c, don't edit. build with -DVM_AOT=1 (make aot)\n");
+    fprintf(out, "#include \"vm.h\"\n#include \"aot.h\"\n\n");
+
+    int status = 0;
+    for (u32 p = 0; p < progs; p++) {
+        const char* path = argv[p + 2];
+        fprintf(out, "// %s\n", path);
+
+        VM vm;
+        vm_init(&vm);
+        if (!vm_load_file(&vm, path)) {
+            printf("error loading %s, code: %u\n", path, vm.panic_code);
+            vm_free(&vm);
+            status = 1;
+            break;
+        }
+
+        i64 n = emit_program(out, &vm, p);
+        sums[p] = aot_checksum(&vm);
+        checked[p] = !vm.verified;
+        counts[p] = n > 0 ? (u32)n : 0;
+        vm_free(&vm);
+        if (n < 0) {
+            printf("out of memory transpiling %s\n", path);
+            status = 1;
+            break;
+        }
+    }
+
+    if (status == 0) {
+        fprintf(out, "const AotProgram aot_programs[] = {\n");
+        for (u32 p = 0; p < progs; p++) {
+            if (counts[p]) fprintf(out, "    { UINT64_C(0x%016" PRIX64 "), %s, p%u_funcs, %uu },\n", sums[p], checked[p] ? "true" : "false", p, counts[p]);
+            else           fprintf(out, "    { UINT64_C(0x%016" PRIX64 "), %s, NULL, 0u },\n", sums[p], checked[p] ? "true" : "false");
+        }
+        fprintf(out, "};\nconst u32 aot_programcount = %uu;\n", progs);
+    }
+
+    free(sums);
+    free(checked);
+    free(counts);
+    fclose(out);
+    return status;
+}
@@ -66,6 +66,26 @@ class Opcode(IntEnum):
     # typed bitwise (unsigned)
     AND_U = auto(); OR_U = auto(); XOR_U = auto(); SHL_U = auto(); SHR_U = auto(); BNOT_U = auto()
 
+    # generic numeric (any type both sources share, quickened at runtime)
+    ADD_N = auto(); SUB_N = auto(); MUL_N = auto(); DIV_N = auto(); MOD_N = auto(); NEG_N = auto()
+    EQ_N = auto(); NEQ_N = auto(); GT_N = auto(); GE_N = auto(); LT_N = auto(); LE_N = auto()
+
+    # int64 against a signed 8 bit immediate (in c)
+    ADDI = auto(); SUBI = auto(); MULI = auto(); SHLI = auto(); SHRI = auto()
+    EQI = auto(); NEQI = auto(); GTI = auto(); GEI = auto(); LTI = auto(); LEI = auto()
+
+    # operand prefix (high bytes for the next instruction)
+    WIDE = auto()
+
+    # numeric for loops (index, limit, step in r..r+2)
+    FORPREP = auto(); FORLOOP = auto(); FORPREP_D = auto(); FORLOOP_D = auto()
+
+    # multi way branch through a table in the const pool
+    JMPTABLE = auto()
+
+    # bulk array ops
+    ARRFILL = auto(); ARRCOPY = auto(); ARRSUM = auto(); ARRADD = auto()
+
 # type tags (typing.h)
 class Type(IntEnum):
     NUL = 0
@@ -85,6 +105,10 @@ def f64(v: float) -> bytes:    return pack("<Bd", Type.DOUBLE, v)
 def func(entry: int, argc: int, regc: int) -> bytes:
     """4 byte function entry, 2 byte argc, 2 byte regc"""
     return pack("<BIHH", Type.CALLABLE, entry, argc, regc)
+def string(s: str) -> tuple:
+    """byte length << 1, then the bytes 8 to a U64 (see vm/str.h). takes (len + 7) // 8 + 1 slots, spread it in"""
+    b = s.encode()
+    return (pack("<BQ", Type.OBJ, len(b) << 1), *(u64(int.from_bytes(b[i:i + 8], "little")) for i in range(0, len(b), 8)))
 
 # ported directly from c lmao
 def ins(op, a = 0, b = 0, c = 0) -> int:
@@ -100,10 +124,13 @@ def STOREG(r, idx):     return ins(Opcode.STOREG, r, idx)
 def COPY(dst, src):     return ins(Opcode.COPY, dst, src)
 def MOVE(dst, src):     return ins(Opcode.MOVE, dst, src)
 def JMP(off):           return ins(Opcode.JMP, (off >> 16) & 0xFF, (off >> 8) & 0xFF, off & 0xFF)
-def JMPIF(r, off):      return ins(Opcode.JMPIF, r, 0, off)
-def JMPIFZ(r, off):     return ins(Opcode.JMPIFZ, r, 0, off)
+def JMPIF(r, off):      return ins(Opcode.JMPIF, r, (off >> 8) & 0xFF, off & 0xFF)
+def JMPIFZ(r, off):     return ins(Opcode.JMPIFZ, r, (off >> 8) & 0xFF, off & 0xFF)
 def BIN(op, dst, a, b): return ins(op, dst, a, b)
 def UN(op, r):          return ins(op, r)
+def IMM(op, dst, a, n): return ins(op, dst, a, n & 0xFF)
+def WIDE(a=0, b=0, c=0):  return ins(Opcode.WIDE, a, b, c)
+def FOR(op, r, off):    return ins(op, r, (off >> 8) & 0xFF, off & 0xFF)
 
 # test model
 @dataclass(frozen=True)
@@ -146,6 +173,12 @@ TESTS += [
         LOADC(0, 0), MOVE(1, 0),
         JMPIF(0, 2), JMPIFZ(1, 1), HALT(), PANIC()
     ], consts=(i64(7),)),
+
+    # values too wide to box (NaN-boxed builds spill them to the side array) survive math, moves and the global pool
+    pass_if_truthy(Opcode.MOVE, "move_full_width", [
+        LOADC(0, 0), BIN(Opcode.ADD, 1, 0, 0), MOVE(2, 1), STOREG(2, 0), LOADG(3, 0),
+        LOADC(4, 1), BIN(Opcode.EQ, 5, 3, 4)
+    ], 5, consts=(i64((1 << 60) + 5), i64((1 << 61) + 10)), globs=(i64(0),)),
 ]
 
 # load/store (imms, consts, globals)
@@ -373,6 +406,34 @@ TESTS += [
     ], 2, consts=(f64(7.75), f64(-7.75))),
 ]
 
+# generic numeric ops. proven types get rewritten at load, unknown ones quicken when they run
+TESTS += [
+    pass_if_truthy(Opcode.ADD_N, "add_n_u64", [
+        LOADC(0, 0), LOADC(1, 1), BIN(Opcode.ADD_N, 2, 0, 1), LOADC(3, 2), BIN(Opcode.EQ_N, 4, 2, 3)
+    ], 4, consts=(u64(7), u64(5), u64(12))),
+
+    # globals are never proven so these quicken at runtime
+    pass_if_truthy(Opcode.SUB_N, "sub_n_f32_globals", [
+        LOADG(0, 0), LOADG(1, 1), BIN(Opcode.SUB_N, 2, 0, 1), LOADG(3, 2), BIN(Opcode.EQ_N, 4, 2, 3)
+    ], 4, globs=(f32(5.5), f32(2.0), f32(3.5))),
+
+    pass_if_truthy(Opcode.MOD_N, "mod_n_i64", [
+        LOADI(0, 17), LOADI(1, 5), BIN(Opcode.MOD_N, 2, 0, 1), LOADI(3, 2), BIN(Opcode.EQ_N, 4, 2, 3)
+    ], 4),
+
+    pass_if_truthy(Opcode.NEG_N, "neg_n_f64", [
+        LOADG(0, 0), UN(Opcode.NEG_N, 0), LOADC(1, 0), BIN(Opcode.LT_N, 2, 0, 1)
+    ], 2, consts=(f64(0.0),), globs=(f64(2.5),)),
+
+    # same ADD_N sees i64s then f64s, so it quickens, misses its guard, and quickens again
+    TestCase(Opcode.ADD_N, "add_n_despecialize", [
+        LOADC(0, 0), LOADC(1, 0), LOADI(5, 0),
+        BIN(Opcode.ADD_N, 2, 0, 1), JMPIF(5, 4),
+        LOADC(0, 1), LOADC(1, 1), LOADI(5, 1), JMP(-6),
+        LOADC(3, 2), BIN(Opcode.EQ_N, 4, 2, 3), JMPIF(4, 1), PANIC(), HALT()
+    ], consts=(i64(2), f64(1.5), f64(3.0))),
+]
+
 # test globals with more than one slot
 TESTS.append(pass_if_truthy(Opcode.STOREG, "bonus_globals_multi", [
     LOADC(0, 0), LOADC(1, 1),
@@ -388,11 +449,390 @@ TESTS.append(pass_if_truthy(Opcode.ADD, "bonus_chained_arith", [
     LOADI(5, 1), BIN(Opcode.SUB, 6, 4, 5)
 ], 6))
 
+# counted loop, both the loop head and the exit are merge points for the verifier's type tracking
+TESTS.append(TestCase(Opcode.LT, "bonus_loop_merge", [
+    LOADI(0, 10), LOADI(1, 0), LOADI(2, 1),
+    BIN(Opcode.ADD, 1, 1, 2), BIN(Opcode.LT, 3, 1, 0), JMPIF(3, -3),
+    BIN(Opcode.EQ, 4, 1, 0), JMPIFZ(4, 1), HALT(), PANIC()
+]))
+
+# LT+JMPIF gets fused, then ip 6 jumps straight into the JMPIF half. it has to run on its own with the EQ's result
+TESTS.append(TestCase(Opcode.JMPIF, "bonus_jump_into_pair", [
+    LOADI(0, 5), LOADI(1, 5), BIN(Opcode.EQ, 2, 0, 1), JMP(2),
+    BIN(Opcode.LT, 2, 0, 1), JMPIF(2, 2), JMPIF(2, -2), PANIC(), HALT()
+]))
+
+# LOADI+ADD gets fused, r2 is read again after so the load still has to land
+TESTS.append(pass_if_truthy(Opcode.ADD, "bonus_fused_load_kept", [
+    LOADI(0, 4), LOADI(2, 3), BIN(Opcode.ADD, 1, 0, 2), BIN(Opcode.ADD, 3, 1, 2),
+    LOADI(4, 10), BIN(Opcode.EQ, 5, 3, 4)
+], 5))
+
 # edge test for double negation
 TESTS.append(pass_if_truthy(Opcode.NEG, "bonus_neg_double",
     [LOADI(0, 42), UN(Opcode.NEG, 0), UN(Opcode.NEG, 0)], 0))
 
 
+# immediate operand ops
+TESTS += [
+    # negative immediates have to sign extend
+    pass_if_truthy(Opcode.ADDI, "addi_subi_muli_negative", [
+        LOADI(0, 10), IMM(Opcode.ADDI, 1, 0, -3), IMM(Opcode.SUBI, 2, 1, -5), IMM(Opcode.MULI, 3, 2, -2),
+        LOADI(4, -24), BIN(Opcode.EQ, 5, 3, 4)
+    ], 5),
+
+    # SHRI is arithmetic like SHR, and the shift amount only keeps its low 6 bits (65 -> 1)
+    TestCase(Opcode.SHLI, "shift_immediate", [
+        LOADI(0, -64), IMM(Opcode.SHRI, 1, 0, 3), IMM(Opcode.SHLI, 2, 1, 4), IMM(Opcode.SHLI, 3, 0, 65),
+        LOADI(4, -128), BIN(Opcode.EQ, 5, 2, 4), JMPIFZ(5, 3), BIN(Opcode.EQ, 5, 3, 4), JMPIFZ(5, 1), HALT(), PANIC()
+    ]),
+
+    # every compare against 5 (and -1), any wrong answer falls into the PANIC
+    TestCase(Opcode.LTI, "compare_immediate", [
+        LOADI(0, 5),
+        IMM(Opcode.EQI, 1, 0, 5), JMPIFZ(1, 13), IMM(Opcode.NEQI, 1, 0, 5), JMPIF(1, 11),
+        IMM(Opcode.GTI, 1, 0, -1), JMPIFZ(1, 9), IMM(Opcode.GEI, 1, 0, 6), JMPIF(1, 7),
+        IMM(Opcode.LTI, 1, 0, 6), JMPIFZ(1, 5), IMM(Opcode.LEI, 1, 0, 4), JMPIF(1, 3),
+        IMM(Opcode.LEI, 1, 0, 5), JMPIFZ(1, 1), HALT(), PANIC()
+    ]),
+
+    # counted loop with no scratch register for the step, called enough that it gets compiled natively
+    # f counts to 100 then returns (100 * -4) >> 2
+    TestCase(Opcode.ADDI, "counted_loop_immediate", [
+        LOADI(0, 0), LOADI(1, 0), LOADC(2, 0),
+        ins(Opcode.CALL, 2, 0, 3), BIN(Opcode.ADD, 1, 1, 3), IMM(Opcode.ADDI, 0, 0, 1), IMM(Opcode.LTI, 4, 0, 100), JMPIF(4, -5),
+        LOADI(5, -10000), BIN(Opcode.EQ, 6, 1, 5), JMPIFZ(6, 1), HALT(), PANIC(),
+        LOADI(0, 0), IMM(Opcode.SUBI, 0, 0, -1), IMM(Opcode.LTI, 1, 0, 100), JMPIF(1, -3),
+        IMM(Opcode.MULI, 0, 0, -4), IMM(Opcode.SHRI, 0, 0, 2), ins(Opcode.RET, 0)
+    ], consts=(func(13, 0, 3),)),
+]
+
+
+# wide prefix, past the 8 bit operand limits
+TESTS += [
+    # const 299 through the prefix, then a narrow LOADC right after is still const 43
+    TestCase(Opcode.WIDE, "wide_const_index", [
+        WIDE(0, 1), LOADC(0, 43), LOADC(1, 43),
+        LOADI(2, 299), BIN(Opcode.EQ, 3, 0, 2), JMPIFZ(3, 3), LOADI(2, 43), BIN(Opcode.EQ, 3, 1, 2), JMPIF(3, 1), PANIC(), HALT()
+    ], consts=tuple(i64(n) for n in range(300))),
+
+    # store to global 270 and read it back, global 14 (its low byte) stays untouched
+    TestCase(Opcode.WIDE, "wide_global_index", [
+        LOADI(0, 7), WIDE(0, 1), STOREG(0, 14), WIDE(0, 1), LOADG(1, 14), LOADG(2, 14),
+        BIN(Opcode.EQ, 3, 1, 0), JMPIFZ(3, 3), LOADI(4, 0), BIN(Opcode.EQ, 3, 2, 4), JMPIF(3, 1), PANIC(), HALT()
+    ], globs=tuple(i64(0) for _ in range(300))),
+
+    # a function with a 300 register window working in r280/r281
+    TestCase(Opcode.WIDE, "wide_registers", [
+        LOADC(0, 0), ins(Opcode.CALL, 0, 0, 1), LOADI(2, 42), BIN(Opcode.EQ, 3, 1, 2), JMPIF(3, 1), PANIC(), HALT(),
+        WIDE(1), LOADI(24, 40), WIDE(1, 1), IMM(Opcode.ADDI, 25, 24, 2), WIDE(0, 1), COPY(0, 25), ins(Opcode.RET, 0)
+    ], consts=(func(7, 0, 300),)),
+]
+
+
+# numeric for loops
+TESTS += [
+    # sum of 0..9, and the index ends on the limit
+    TestCase(Opcode.FORLOOP, "for_i64_sum", [
+        LOADI(0, 0), LOADI(1, 10), LOADI(2, 1), LOADI(3, 0),
+        FOR(Opcode.FORPREP, 0, 2), BIN(Opcode.ADD, 3, 3, 0), FOR(Opcode.FORLOOP, 0, -2),
+        LOADI(4, 45), BIN(Opcode.EQ, 5, 3, 4), JMPIFZ(5, 3), LOADI(4, 10), BIN(Opcode.EQ, 5, 0, 4), JMPIF(5, 1), PANIC(), HALT()
+    ]),
+
+    # counting down by 3 (10 7 4 1), a loop that runs zero times, and one ending 2 short of i64 max
+    # that has to stop after 2 iterations instead of wrapping around
+    TestCase(Opcode.FORPREP, "for_i64_edges", [
+        LOADI(0, 10), LOADI(1, 0), LOADI(2, -3), LOADI(3, 0),
+        FOR(Opcode.FORPREP, 0, 2), BIN(Opcode.ADD, 3, 3, 0), FOR(Opcode.FORLOOP, 0, -2),
+        LOADI(0, 5), LOADI(1, 5), LOADI(2, 1),
+        FOR(Opcode.FORPREP, 0, 2), PANIC(), FOR(Opcode.FORLOOP, 0, -2),
+        LOADC(0, 0), LOADC(1, 1), LOADI(2, 4), LOADI(6, 0),
+        FOR(Opcode.FORPREP, 0, 2), IMM(Opcode.ADDI, 6, 6, 1), FOR(Opcode.FORLOOP, 0, -2),
+        LOADI(4, 22), BIN(Opcode.EQ, 5, 3, 4), JMPIFZ(5, 3), LOADI(4, 2), BIN(Opcode.EQ, 5, 6, 4), JMPIF(5, 1), PANIC(), HALT()
+    ], consts=(i64(2**63 - 6), i64(2**63 - 1))),
+
+    # the body jumping the index past the limit (0 to 20 of 10), then pulling the limit under it (10 to -5):
+    # each runs once. r6 counts, and panics on a 3rd go round instead of spinning on a wrapped distance
+    TestCase(Opcode.FORLOOP, "for_i64_moved", [
+        LOADI(0, 0), LOADI(1, 10), LOADI(2, 1), LOADI(6, 0),
+        FOR(Opcode.FORPREP, 0, 6), IMM(Opcode.ADDI, 6, 6, 1), IMM(Opcode.LTI, 7, 6, 3), JMPIF(7, 1), PANIC(),
+        LOADI(0, 20), FOR(Opcode.FORLOOP, 0, -6),
+        LOADI(0, 0), LOADI(1, 10),
+        FOR(Opcode.FORPREP, 0, 6), IMM(Opcode.ADDI, 6, 6, 1), IMM(Opcode.LTI, 7, 6, 3), JMPIF(7, 1), PANIC(),
+        LOADI(1, -5), FOR(Opcode.FORLOOP, 0, -6),
+        LOADI(4, 2), BIN(Opcode.EQ, 5, 6, 4), JMPIF(5, 1), PANIC(), HALT()
+    ]),
+
+    # 0 + 0.25 + 0.5 + 0.75
+    TestCase(Opcode.FORLOOP_D, "for_f64_sum", [
+        LOADC(0, 0), LOADC(1, 1), LOADC(2, 2), LOADC(3, 0),
+        FOR(Opcode.FORPREP_D, 0, 2), BIN(Opcode.ADD_D, 3, 3, 0), FOR(Opcode.FORLOOP_D, 0, -2),
+        LOADC(4, 3), BIN(Opcode.EQ_D, 5, 3, 4), JMPIF(5, 1), PANIC(), HALT()
+    ], consts=(f64(0.0), f64(1.0), f64(0.25), f64(1.5))),
+
+    # called 100 times so both loops get compiled: sum of 0..19 plus a count of 2.0 down to 0.0 by -0.5
+    TestCase(Opcode.FORLOOP, "for_hot_function", [
+        LOADI(0, 0), LOADI(1, 0), LOADC(2, 0),
+        ins(Opcode.CALL, 2, 0, 3), BIN(Opcode.ADD, 1, 1, 3), IMM(Opcode.ADDI, 0, 0, 1), IMM(Opcode.LTI, 4, 0, 100), JMPIF(4, -5),
+        LOADI(5, 19400), BIN(Opcode.EQ, 6, 1, 5), JMPIFZ(6, 1), HALT(), PANIC(),
+        LOADI(0, 0), LOADI(1, 20), LOADI(2, 1), LOADI(3, 0),
+        FOR(Opcode.FORPREP, 0, 2), BIN(Opcode.ADD, 3, 3, 0), FOR(Opcode.FORLOOP, 0, -2),
+        LOADC(4, 1), LOADC(5, 2), LOADC(6, 3),
+        FOR(Opcode.FORPREP_D, 4, 2), IMM(Opcode.ADDI, 3, 3, 1), FOR(Opcode.FORLOOP_D, 4, -2),
+        ins(Opcode.RET, 3)
+    ], consts=(func(13, 0, 8), f64(2.0), f64(0.0), f64(-0.5))),
+]
+
+
+# jump tables: consts[k] is the case count, the next count consts are the offsets
+TESTS += [
+    # selectors -1..3 through a 3 case table, -1 and 3 fall through to the default: 16 + 1 + 2 + 4 + 16
+    TestCase(Opcode.JMPTABLE, "jmptable_cases_and_default", [
+        LOADI(0, -1), LOADI(1, 0), LOADI(2, 4),
+        ins(Opcode.JMPTABLE, 0, 0),
+        IMM(Opcode.ADDI, 1, 1, 16), JMP(5),
+        IMM(Opcode.ADDI, 1, 1, 1), JMP(3),
+        IMM(Opcode.ADDI, 1, 1, 2), JMP(1),
+        IMM(Opcode.ADDI, 1, 1, 4),
+        IMM(Opcode.ADDI, 0, 0, 1), BIN(Opcode.LT, 3, 0, 2), JMPIF(3, -11),
+        LOADI(4, 39), BIN(Opcode.EQ, 5, 1, 4), JMPIF(5, 1), PANIC(), HALT()
+    ], consts=(i64(3), i64(2), i64(4), i64(6))),
+
+    # f(i % 5) for i in 0..99 so the table gets compiled natively: cases 0..3 return 10..40, 4 is the default 0
+    TestCase(Opcode.JMPTABLE, "jmptable_hot_function", [
+        LOADI(0, 0), LOADI(1, 0), LOADC(2, 0), LOADI(6, 5),
+        BIN(Opcode.MOD, 3, 0, 6), ins(Opcode.CALL, 2, 1, 4), BIN(Opcode.ADD, 1, 1, 4),
+        IMM(Opcode.ADDI, 0, 0, 1), IMM(Opcode.LTI, 5, 0, 100), JMPIF(5, -6),
+        LOADI(7, 2000), BIN(Opcode.EQ, 8, 1, 7), JMPIFZ(8, 1), HALT(), PANIC(),
+        ins(Opcode.JMPTABLE, 0, 1),
+        LOADI(1, 0), ins(Opcode.RET, 1),
+        LOADI(1, 10), ins(Opcode.RET, 1), LOADI(1, 20), ins(Opcode.RET, 1),
+        LOADI(1, 30), ins(Opcode.RET, 1), LOADI(1, 40), ins(Opcode.RET, 1)
+    ], consts=(func(15, 1, 4), i64(4), i64(2), i64(4), i64(6), i64(8))),
+]
+
+
+# register file: only what frames reach gets committed, but it goes way past 65536
+TESTS += [
+    # f calls g from r50000, so g's window starts ~50k in and it writes ~100k registers deep
+    TestCase(Opcode.CALL, "registers_past_64k", [
+        LOADC(0, 0), ins(Opcode.CALL, 0, 0, 1), LOADI(2, 7), BIN(Opcode.EQ, 3, 1, 2), JMPIF(3, 1), PANIC(), HALT(),
+        WIDE(0xC3), LOADC(0x50, 1), WIDE(0xC3, 0, 0xC3), ins(Opcode.CALL, 0x50, 0, 0x51), WIDE(0xC3), ins(Opcode.RET, 0x51),
+        WIDE(0xC3), LOADI(0x50, 7), WIDE(0xC3), ins(Opcode.RET, 0x50)
+    ], consts=(func(7, 0, 50002), func(13, 0, 50001))),
+]
+
+
+# heap: arrays, and enough garbage to make the collector run (1MB nursery, 8MB before the first major)
+def NEWARR(dst, n, elem=Type.NUL): return ins(Opcode.NEWARR, dst, n, elem)
+def ARRGET(dst, arr, i):  return ins(Opcode.ARRGET, dst, arr, i)
+def ARRSET(arr, i, src):  return ins(Opcode.ARRSET, arr, i, src)
+def ARRLEN(dst, arr):     return ins(Opcode.ARRLEN, dst, arr)
+def ARRFILL(arr, val):    return ins(Opcode.ARRFILL, arr, val)
+def ARRCOPY(dst, src, n): return ins(Opcode.ARRCOPY, dst, src, n)
+def ARRSUM(dst, arr):     return ins(Opcode.ARRSUM, dst, arr)
+def ARRADD(arr, val):     return ins(Opcode.ARRADD, arr, val)
+def NEWTABLE(dst):        return ins(Opcode.NEWTABLE, dst)
+def GETELEM(dst, t, key): return ins(Opcode.GETELEM, dst, t, key)
+def SETELEM(t, key, src): return ins(Opcode.SETELEM, t, key, src)
+def CONCAT(dst, a, b):    return ins(Opcode.CONCAT, dst, a, b)
+def STRLEN(dst, s):       return ins(Opcode.STRLEN, dst, s)
+
+# allocate n arrays of len_reg elements into scratch (a FORPREP/FORLOOP over idx, idx + 1 = limit, idx + 2 = 1)
+def churn(idx, limit_const, len_reg, scratch):
+    return [LOADI(idx, 0), LOADC(idx + 1, limit_const), LOADI(idx + 2, 1),
+            FOR(Opcode.FORPREP, idx, 2), NEWARR(scratch, len_reg), FOR(Opcode.FORLOOP, idx, -2)]
+
+TESTS += [
+    # a[2] = 42 reads back, length is 4, and everything else starts out NUL
+    TestCase(Opcode.NEWARR, "array_basic", [
+        LOADI(0, 4), NEWARR(1, 0), LOADI(2, 2), LOADI(3, 42), ARRSET(1, 2, 3), ARRGET(4, 1, 2),
+        LOADI(10, 0), ARRGET(9, 1, 10), JMPIF(9, 5),
+        BIN(Opcode.EQ, 5, 4, 3), JMPIFZ(5, 3), ARRLEN(6, 1), BIN(Opcode.EQ, 7, 6, 0), JMPIF(7, 1), PANIC(), HALT()
+    ]),
+
+    # packed arrays of every type read back what went in (and start out zeroed)
+    TestCase(Opcode.NEWARR, "array_typed_roundtrip", [
+        LOADI(0, 3), NEWARR(1, 0, Type.I64),
+        LOADI(2, 1), LOADI(3, -5), ARRSET(1, 2, 3), ARRGET(4, 1, 2), BIN(Opcode.EQ, 5, 4, 3), JMPIF(5, 1), PANIC(),
+        LOADI(2, 2), ARRGET(4, 1, 2), LOADI(3, 0), BIN(Opcode.EQ, 5, 4, 3), JMPIF(5, 1), PANIC(),
+        NEWARR(6, 0, Type.DOUBLE), LOADC(7, 0), ARRSET(6, 2, 7), ARRGET(8, 6, 2), BIN(Opcode.EQ_D, 5, 8, 7), JMPIF(5, 1), PANIC(),
+        NEWARR(6, 0, Type.FLOAT), LOADC(7, 1), ARRSET(6, 2, 7), ARRGET(8, 6, 2), BIN(Opcode.EQ_F, 5, 8, 7), JMPIF(5, 1), PANIC(),
+        NEWARR(6, 0, Type.U64), LOADC(7, 2), ARRSET(6, 2, 7), ARRGET(8, 6, 2), BIN(Opcode.EQ_U, 5, 8, 7), JMPIF(5, 1), PANIC(),
+        NEWARR(6, 0, Type.BOOL), LOADI(7, 1), BIN(Opcode.EQ, 7, 7, 7), ARRSET(6, 2, 7), ARRGET(8, 6, 2), JMPIF(8, 1), PANIC(),
+        LOADI(2, 0), ARRGET(8, 6, 2), JMPIFZ(8, 1), PANIC(), HALT()
+    ], consts=(f64(2.5), f32(1.25), u64(9))),
+
+    # fill/add/sum/copy over 37 elements (so every kernel has a tail), one array of each type, and a tagged
+    # copy of object references
+    TestCase(Opcode.ARRSUM, "array_bulk_ops", [
+        LOADI(0, 37), NEWARR(1, 0, Type.I64), LOADI(2, 3), ARRFILL(1, 2), LOADI(2, 4), ARRADD(1, 2),
+        ARRSUM(3, 1), LOADI(4, 259), BIN(Opcode.EQ, 5, 3, 4), JMPIF(5, 1), PANIC(),
+        LOADI(6, 10), NEWARR(7, 6, Type.I64), ARRCOPY(7, 1, 6), ARRSUM(3, 7), LOADI(4, 70), BIN(Opcode.EQ, 5, 3, 4), JMPIF(5, 1), PANIC(),
+        NEWARR(8, 0, Type.DOUBLE), LOADC(9, 0), ARRFILL(8, 9), LOADC(9, 1), ARRADD(8, 9),
+        ARRSUM(10, 8), LOADC(11, 2), BIN(Opcode.EQ_D, 5, 10, 11), JMPIF(5, 1), PANIC(),
+        NEWARR(8, 0, Type.FLOAT), LOADC(9, 3), ARRFILL(8, 9), ARRSUM(10, 8), LOADC(11, 4), BIN(Opcode.EQ_F, 5, 10, 11), JMPIF(5, 1), PANIC(),
+        NEWARR(8, 0, Type.BOOL), LOADI(9, 0), BIN(Opcode.EQ, 9, 9, 9), ARRFILL(8, 9), ARRSUM(10, 8), BIN(Opcode.EQ, 5, 10, 0), JMPIF(5, 1), PANIC(),
+        NEWARR(12, 0), ARRFILL(12, 1), NEWARR(13, 0), ARRCOPY(13, 12, 0), LOADI(2, 36), ARRGET(14, 13, 2),
+        ARRSUM(3, 14), LOADI(4, 259), BIN(Opcode.EQ, 5, 3, 4), JMPIF(5, 1), PANIC(), HALT()
+    ], consts=(f64(0.5), f64(0.25), f64(27.75), f32(1.5), f32(55.5))),
+
+    # t[1] = 7 and t[1u] = 9 are different keys, -0.0 and 0.0 are the same one, a missing key reads nul and
+    # storing nul (r10 is never written) deletes
+    TestCase(Opcode.SETELEM, "table_basic", [
+        LOADI(0, 1), NEWTABLE(1), LOADI(2, 7), SETELEM(1, 0, 2), LOADC(3, 2), LOADI(4, 9), SETELEM(1, 3, 4),
+        GETELEM(5, 1, 0), BIN(Opcode.EQ, 6, 5, 2), JMPIF(6, 1), PANIC(),
+        GETELEM(5, 1, 3), BIN(Opcode.EQ, 6, 5, 4), JMPIF(6, 1), PANIC(),
+        LOADC(7, 0), SETELEM(1, 7, 2), LOADC(8, 1), GETELEM(5, 1, 8), BIN(Opcode.EQ, 6, 5, 2), JMPIF(6, 1), PANIC(),
+        GETELEM(5, 1, 2), JMPIFZ(5, 1), PANIC(),
+        SETELEM(1, 0, 10), GETELEM(5, 1, 0), JMPIFZ(5, 1), PANIC(),
+        GETELEM(5, 1, 3), BIN(Opcode.EQ, 6, 5, 4), JMPIF(6, 1), PANIC(), HALT()
+    ], consts=(f64(-0.0), f64(0.0), u64(1))),
+
+    # 250k node linked list ([next, i]) built while a garbage array gets made every step, then summed.
+    # survivors get promoted, the list outgrows the first major threshold
+    TestCase(Opcode.NEWARR, "gc_linked_list_survives", [
+        LOADC(0, 0), LOADI(1, 0), LOADI(3, 2), LOADI(4, 0), LOADI(5, 1), LOADI(8, 32),
+        NEWARR(6, 3), ARRSET(6, 4, 2), ARRSET(6, 5, 1), COPY(2, 6), NEWARR(7, 8),
+        IMM(Opcode.ADDI, 1, 1, 1), BIN(Opcode.LT, 9, 1, 0), JMPIF(9, -8),
+        LOADI(10, 0), JMPIFZ(2, 4), ARRGET(11, 2, 5), BIN(Opcode.ADD, 10, 10, 11), ARRGET(2, 2, 4), JMP(-5),
+        LOADC(12, 1), BIN(Opcode.EQ, 13, 10, 12), JMPIF(13, 1), PANIC(), HALT()
+    ], consts=(i64(250_000), i64(250_000 * 249_999 // 2))),
+
+    # a gets promoted, then a young b = [7] is stored into it and only a points at b. the next minor collection
+    # has to find b through the remembered set or a[0] ends up pointing into a reused nursery
+    TestCase(Opcode.ARRSET, "gc_old_points_to_young", [
+        LOADI(0, 1), NEWARR(1, 0), LOADI(2, 64),
+        *churn(3, 0, 2, 6),
+        NEWARR(7, 0), LOADI(8, 7), LOADI(9, 0), ARRSET(7, 9, 8), ARRSET(1, 9, 7), LOADI(7, 0),
+        *churn(3, 0, 2, 6),
+        ARRGET(10, 1, 9), ARRGET(11, 10, 9), BIN(Opcode.EQ, 12, 11, 8), JMPIF(12, 1), PANIC(), HALT()
+    ], consts=(i64(5000),)),
+
+    # the caller's array sits below the callee's window while the callee churns through a few collections
+    TestCase(Opcode.CALL, "gc_roots_in_caller_frames", [
+        LOADI(0, 1), NEWARR(1, 0), LOADI(2, 0), LOADI(3, 5), ARRSET(1, 2, 3),
+        LOADC(4, 0), ins(Opcode.CALL, 4, 0, 5),
+        ARRGET(6, 1, 2), BIN(Opcode.EQ, 7, 6, 3), JMPIF(7, 1), PANIC(), HALT(),
+        LOADI(0, 64), *churn(1, 1, 0, 4), ins(Opcode.RET, 0)
+    ], consts=(func(12, 0, 8), i64(5000))),
+
+    # p[i] = [i, next] for 20k i, then a few times over every element gets pushed onto a list hung off a global
+    # (cleared out of p, no register left on it) and walked back into p, with a list of garbage growing and getting
+    # promoted under it. the global was scanned when marking started, so without the STOREG barrier the list
+    # looks dead to whatever marking is still going
+    TestCase(Opcode.STOREG, "gc_list_through_global", [
+        LOADC(0, 0), LOADI(1, 2), NEWARR(2, 0), LOADI(4, 0), LOADI(24, 1), LOADI(13, 8),
+        LOADI(5, 0), COPY(6, 0), LOADI(7, 1),
+        FOR(Opcode.FORPREP, 5, 4), NEWARR(8, 1), ARRSET(8, 4, 5), ARRSET(2, 5, 8), FOR(Opcode.FORLOOP, 5, -4),
+        LOADI(15, 0), LOADC(16, 1), LOADI(17, 1),
+        FOR(Opcode.FORPREP, 15, 4), NEWARR(8, 1), ARRSET(8, 4, 10), COPY(10, 8), FOR(Opcode.FORLOOP, 15, -4),
+        LOADI(20, 0), LOADC(21, 2), LOADI(22, 1),
+        FOR(Opcode.FORPREP, 20, 26),
+            LOADI(3, 0),
+            LOADI(5, 0), COPY(6, 0), LOADI(7, 1),
+            FOR(Opcode.FORPREP, 5, 11), ARRGET(8, 2, 5), ARRSET(2, 5, 30), LOADG(18, 0), ARRSET(8, 24, 18),
+            STOREG(8, 0), LOADI(8, 0), LOADI(18, 0), NEWARR(14, 13), ARRSET(14, 4, 3), MOVE(3, 14),
+            FOR(Opcode.FORLOOP, 5, -11),
+            LOADG(18, 0),
+            JMPIFZ(18, 6), ARRGET(9, 18, 4), ARRGET(11, 18, 24), ARRSET(18, 24, 30), ARRSET(2, 9, 18), COPY(18, 11),
+            JMP(-7),
+            STOREG(30, 0),
+        FOR(Opcode.FORLOOP, 20, -26),
+        LOADI(5, 0), COPY(6, 0), LOADI(7, 1),
+        FOR(Opcode.FORPREP, 5, 5), ARRGET(8, 2, 5), ARRGET(9, 8, 4), BIN(Opcode.NEQ, 11, 9, 5), JMPIF(11, 2),
+        FOR(Opcode.FORLOOP, 5, -5),
+        HALT(), PANIC()
+    ], consts=(i64(20_000), i64(20_000), i64(10)), globs=(nul(),)),
+
+    # p[i] = [i] for 20k i, then every element moves p -> q -> p a few times (cleared behind itself) while a
+    # list of garbage grows and gets promoted under it, so the old generation keeps getting marked. roots are
+    # grayed from the top register down: q, then the ballast list, then p (the garbage sits below all of them).
+    # without the ARRSET barrier whatever moves into q after it's been blackened looks dead
+    TestCase(Opcode.ARRSET, "gc_moves_into_marked_array", [
+        LOADC(0, 0), LOADI(19, 1), NEWARR(2, 0), NEWARR(12, 0), LOADI(4, 0), LOADI(13, 8),
+        LOADI(5, 0), COPY(6, 0), LOADI(7, 1),
+        FOR(Opcode.FORPREP, 5, 4), NEWARR(8, 19), ARRSET(8, 4, 5), ARRSET(2, 5, 8), FOR(Opcode.FORLOOP, 5, -4),
+        LOADI(15, 0), LOADC(16, 1), LOADI(17, 1),
+        FOR(Opcode.FORPREP, 15, 4), NEWARR(8, 19), ARRSET(8, 4, 10), COPY(10, 8), FOR(Opcode.FORLOOP, 15, -4),
+        LOADI(20, 0), LOADC(21, 2), LOADI(22, 1),
+        FOR(Opcode.FORPREP, 20, 24),
+            LOADI(1, 0),
+            LOADI(5, 0), COPY(6, 0), LOADI(7, 1),
+            FOR(Opcode.FORPREP, 5, 7), ARRGET(8, 2, 5), ARRSET(12, 5, 8), ARRSET(2, 5, 30),
+            NEWARR(14, 13), ARRSET(14, 4, 1), MOVE(1, 14), FOR(Opcode.FORLOOP, 5, -7),
+            LOADI(5, 0), COPY(6, 0), LOADI(7, 1),
+            FOR(Opcode.FORPREP, 5, 7), ARRGET(8, 12, 5), ARRSET(2, 5, 8), ARRSET(12, 5, 30),
+            NEWARR(14, 13), ARRSET(14, 4, 1), MOVE(1, 14), FOR(Opcode.FORLOOP, 5, -7),
+        FOR(Opcode.FORLOOP, 20, -24),
+        LOADI(5, 0), COPY(6, 0), LOADI(7, 1),
+        FOR(Opcode.FORPREP, 5, 5), ARRGET(8, 2, 5), ARRGET(9, 8, 4), BIN(Opcode.NEQ, 11, 9, 5), JMPIF(11, 2),
+        FOR(Opcode.FORLOOP, 5, -5),
+        HALT(), PANIC()
+    ], consts=(i64(20_000), i64(20_000), i64(10))),
+
+    # t[i] = [i] for 200k i with garbage made every step, so the table resizes (incrementally) a dozen times with
+    # young arrays going into slots that have been promoted. then every value gets summed back, the first half
+    # deleted, and the second half checked again over the tombstones
+    TestCase(Opcode.SETELEM, "table_grows_under_gc", [
+        LOADC(0, 0), NEWTABLE(1), LOADI(6, 1), LOADI(7, 0), LOADI(9, 8), LOADI(12, 0),
+        LOADI(2, 0), COPY(3, 0), LOADI(4, 1),
+        FOR(Opcode.FORPREP, 2, 5), NEWARR(5, 6), ARRSET(5, 7, 2), SETELEM(1, 2, 5), NEWARR(8, 9), FOR(Opcode.FORLOOP, 2, -5),
+        LOADI(2, 0), COPY(3, 0), LOADI(4, 1),
+        FOR(Opcode.FORPREP, 2, 4), GETELEM(10, 1, 2), ARRGET(11, 10, 7), BIN(Opcode.ADD, 12, 12, 11), FOR(Opcode.FORLOOP, 2, -4),
+        LOADC(13, 1), BIN(Opcode.EQ, 14, 12, 13), JMPIF(14, 1), PANIC(),
+        LOADI(2, 0), LOADC(3, 2), LOADI(4, 1),
+        FOR(Opcode.FORPREP, 2, 2), SETELEM(1, 2, 15), FOR(Opcode.FORLOOP, 2, -2),
+        LOADI(2, 0), COPY(3, 0), LOADI(4, 1), LOADI(12, 0),
+        FOR(Opcode.FORPREP, 2, 5), GETELEM(10, 1, 2), JMPIFZ(10, 2), ARRGET(11, 10, 7), BIN(Opcode.ADD, 12, 12, 11), FOR(Opcode.FORLOOP, 2, -5),
+        LOADC(13, 3), BIN(Opcode.EQ, 14, 12, 13), JMPIF(14, 1), PANIC(), HALT()
+    ], consts=(i64(200_000), i64(200_000 * 199_999 // 2), i64(100_000), i64(200_000 * 199_999 // 2 - 100_000 * 99_999 // 2))),
+
+    # 14 keys fill a 16 slot table to its 7/8 limit, overwriting one of them there doesn't need room (and doesn't
+    # lose anything), a 15th key grows it
+    TestCase(Opcode.SETELEM, "table_overwrite_when_full", [
+        LOADI(0, 14), NEWTABLE(1), LOADI(2, 0), COPY(3, 0), LOADI(4, 1),
+        FOR(Opcode.FORPREP, 2, 2), SETELEM(1, 2, 2), FOR(Opcode.FORLOOP, 2, -2),
+        LOADI(5, 3), LOADI(6, 100), SETELEM(1, 5, 6), GETELEM(7, 1, 5), BIN(Opcode.EQ, 8, 7, 6), JMPIF(8, 1), PANIC(),
+        LOADI(5, 13), GETELEM(7, 1, 5), BIN(Opcode.EQ, 8, 7, 5), JMPIF(8, 1), PANIC(),
+        LOADI(5, 14), SETELEM(1, 5, 5), GETELEM(7, 1, 5), BIN(Opcode.EQ, 8, 7, 5), JMPIF(8, 1), PANIC(),
+        LOADI(5, 0), GETELEM(7, 1, 5), BIN(Opcode.EQ, 8, 7, 5), JMPIF(8, 1), PANIC(), HALT()
+    ]),
+
+    # one string of each form, looked up by contents: "ab" + "cdefgh" is the interned "abcdefgh" constant,
+    # "ab" + "ab" is inline, and long + long + "ab" finds the same key as long + (long + "ab") (two different
+    # ropes, flattened). long + "ab" + long is a different key
+    TestCase(Opcode.CONCAT, "string_concat_forms", [
+        LOADC(0, 0), LOADC(1, 2), CONCAT(2, 0, 1), LOADC(3, 4),
+        STRLEN(4, 2), LOADC(5, 12), BIN(Opcode.EQ, 6, 4, 5), JMPIF(6, 1), PANIC(),
+        NEWTABLE(7), LOADI(8, 1), SETELEM(7, 2, 8), GETELEM(9, 7, 3), BIN(Opcode.EQ, 6, 9, 8), JMPIF(6, 1), PANIC(),
+        CONCAT(10, 0, 0), LOADI(8, 2), SETELEM(7, 10, 8), CONCAT(11, 0, 0), GETELEM(9, 7, 11), BIN(Opcode.EQ, 6, 9, 8), JMPIF(6, 1), PANIC(),
+        GETELEM(9, 7, 0), JMPIFZ(9, 1), PANIC(),
+        LOADC(12, 6), CONCAT(13, 12, 12), STRLEN(4, 13), LOADC(5, 13), BIN(Opcode.EQ, 6, 4, 5), JMPIF(6, 1), PANIC(),
+        CONCAT(14, 13, 0), LOADI(8, 3), SETELEM(7, 14, 8),
+        CONCAT(15, 12, 0), CONCAT(16, 12, 15), STRLEN(4, 16), LOADC(5, 14), BIN(Opcode.EQ, 6, 4, 5), JMPIF(6, 1), PANIC(),
+        GETELEM(9, 7, 16), BIN(Opcode.EQ, 6, 9, 8), JMPIF(6, 1), PANIC(),
+        CONCAT(17, 15, 12), GETELEM(9, 7, 17), JMPIFZ(9, 1), PANIC(), HALT()
+    ], consts=(*string("ab"), *string("cdefgh"), *string("abcdefgh"), *string("0123456789abcdefghijklmnopqrstuvwxyz"),
+               i64(8), i64(72), i64(74))),
+
+    # a 100k byte string appended to a byte at a time and another five at a time, with garbage made every step
+    # so the pieces get promoted (and collected) partway through. same length, and the same key once flattened
+    TestCase(Opcode.CONCAT, "string_build_under_gc", [
+        LOADC(0, 0), COPY(1, 0), LOADI(6, 8),
+        LOADI(2, 0), LOADC(3, 4), LOADI(4, 1),
+        FOR(Opcode.FORPREP, 2, 3), CONCAT(0, 0, 1), NEWARR(5, 6), FOR(Opcode.FORLOOP, 2, -3),
+        LOADC(7, 2), COPY(8, 7),
+        LOADI(2, 0), LOADC(3, 5), LOADI(4, 1),
+        FOR(Opcode.FORPREP, 2, 3), CONCAT(8, 8, 7), NEWARR(5, 6), FOR(Opcode.FORLOOP, 2, -3),
+        STRLEN(9, 0), LOADC(10, 6), BIN(Opcode.EQ, 11, 9, 10), JMPIF(11, 1), PANIC(),
+        STRLEN(9, 8), BIN(Opcode.EQ, 11, 9, 10), JMPIF(11, 1), PANIC(),
+        NEWTABLE(12), LOADI(13, 1), SETELEM(12, 0, 13), GETELEM(14, 12, 8), BIN(Opcode.EQ, 11, 14, 13), JMPIF(11, 1), PANIC(),
+        GETELEM(14, 12, 7), JMPIFZ(14, 1), PANIC(), HALT()
+    ], consts=(*string("x"), *string("xxxxx"), i64(99_999), i64(19_999), i64(100_000))),
+]
+
+
 # NEW: call and return. getting better at this
 TESTS += [
     # function returns 42, caller checks it
@@ -420,27 +860,106 @@ TESTS += [
         HALT(), PANIC(),
         LOADI(0, 999), STOREG(0, 1), ins(Opcode.RET, 0)
     ], consts=(func(10, 0, 4),), globs=(i64(0), i64(0))),
+
+    # sum(n, acc) tail recursing 1000 deep, all in the one frame that gets reused
+    TestCase(Opcode.TAILCALL, "tailcall_deep_recursion", [
+        LOADC(0, 0), LOADC(1, 1), LOADI(2, 0), ins(Opcode.TAILCALL, 0, 2),
+        LOADI(2, 0), BIN(Opcode.EQ_N, 3, 0, 2), JMPIF(3, 5),
+        LOADC(6, 0), LOADI(4, 1), BIN(Opcode.SUB_N, 7, 0, 4), BIN(Opcode.ADD_N, 8, 1, 0),
+        ins(Opcode.TAILCALL, 6, 2),
+        LOADC(4, 2), BIN(Opcode.EQ_N, 5, 1, 4), JMPIF(5, 1), PANIC(), HALT()
+    ], consts=(func(4, 2, 9), i64(1000), i64(500500))),
+
+    # f(n) = n ? f(n - 1) + 1 : 0 for n = 100000, a real frame per level (~100 stack segments up and back down)
+    TestCase(Opcode.CALL, "call_deep_recursion", [
+        LOADC(0, 0), LOADC(1, 1), ins(Opcode.CALL, 0, 1, 2), BIN(Opcode.EQ, 3, 2, 1), JMPIF(3, 1), PANIC(), HALT(),
+        JMPIF(0, 2), LOADI(1, 0), ins(Opcode.RET, 1),
+        LOADC(1, 0), IMM(Opcode.SUBI, 2, 0, 1), ins(Opcode.CALL, 1, 1, 3), IMM(Opcode.ADDI, 3, 3, 1), ins(Opcode.RET, 3)
+    ], consts=(func(7, 1, 4), i64(100000))),
+
+    # args in f+1.. are the callee's r0.., f(20, 22) = 42
+    TestCase(Opcode.CALL, "call_args_window", [
+        LOADI(0, 7), LOADC(1, 0), LOADI(2, 20), LOADI(3, 22), ins(Opcode.CALL, 1, 2, 4),
+        LOADI(5, 42), BIN(Opcode.EQ, 6, 4, 5), JMPIFZ(6, 3),
+        LOADI(5, 7), BIN(Opcode.EQ, 6, 0, 5), JMPIF(6, 1), PANIC(), HALT(),
+        BIN(Opcode.ADD_N, 2, 0, 1), ins(Opcode.RET, 2)
+    ], consts=(func(13, 2, 4),)),
+
+    # nested, f(x) = g(x) + 1 and g(x) = x + x, so f(20) = 41
+    TestCase(Opcode.CALL, "call_nested_args", [
+        LOADC(0, 0), LOADI(1, 20), ins(Opcode.CALL, 0, 1, 2),
+        LOADI(3, 41), BIN(Opcode.EQ, 4, 2, 3), JMPIF(4, 1), PANIC(), HALT(),
+        LOADC(1, 1), COPY(2, 0), ins(Opcode.CALL, 1, 1, 3), LOADI(4, 1), BIN(Opcode.ADD_N, 5, 3, 4), ins(Opcode.RET, 5),
+        BIN(Opcode.ADD_N, 1, 0, 0), ins(Opcode.RET, 1)
+    ], consts=(func(8, 1, 6), func(14, 1, 2))),
+
+    # plain (not tail) recursion, fib(15) = 610. each level's window sits right above its caller's
+    TestCase(Opcode.CALL, "call_recursive_fib", [
+        LOADC(0, 0), LOADI(1, 15), ins(Opcode.CALL, 0, 1, 2),
+        LOADI(3, 610), BIN(Opcode.EQ, 4, 2, 3), JMPIF(4, 1), PANIC(), HALT(),
+        LOADI(1, 2), BIN(Opcode.LT_N, 2, 0, 1), JMPIFZ(2, 1), ins(Opcode.RET, 0),
+        LOADC(3, 0), LOADI(5, 1), BIN(Opcode.SUB_N, 4, 0, 5), ins(Opcode.CALL, 3, 1, 1),
+        LOADI(5, 2), BIN(Opcode.SUB_N, 4, 0, 5), ins(Opcode.CALL, 3, 1, 2),
+        BIN(Opcode.ADD_N, 6, 1, 2), ins(Opcode.RET, 6)
+    ], consts=(func(8, 1, 7),)),
+
+    # called 200 times so it gets jitted partway through. globals, f64 constants, div/mod, a generic op, MOVE and
+    # NEG all have to come out the same natively: sum of i*i, 200 * 0.5, and the last return
+    TestCase(Opcode.CALL, "call_hot_function_jit", [
+        LOADI(0, 0), LOADI(1, 200), LOADC(2, 0),
+        COPY(3, 0), ins(Opcode.CALL, 2, 1, 5), LOADI(6, 1), BIN(Opcode.ADD, 0, 0, 6), BIN(Opcode.LT, 7, 0, 1), JMPIF(7, -6),
+        LOADG(8, 0), LOADC(9, 1), BIN(Opcode.EQ, 10, 8, 9), JMPIFZ(10, 8),
+        LOADG(8, 1), LOADC(9, 2), BIN(Opcode.EQ_D, 10, 8, 9), JMPIFZ(10, 4),
+        LOADI(9, 199), BIN(Opcode.EQ, 10, 5, 9), JMPIFZ(10, 1), HALT(), PANIC(),
+        BIN(Opcode.MUL, 1, 0, 0), LOADG(2, 0), BIN(Opcode.ADD, 2, 2, 1), STOREG(2, 0),
+        LOADG(3, 1), LOADC(4, 3), BIN(Opcode.ADD_D, 3, 3, 4), STOREG(3, 1),
+        LOADI(5, 7), BIN(Opcode.MOD, 6, 0, 5), BIN(Opcode.DIV, 7, 0, 5), BIN(Opcode.MUL, 7, 7, 5), BIN(Opcode.ADD_N, 7, 7, 6),
+        BIN(Opcode.EQ, 6, 7, 0), JMPIF(6, 1), PANIC(2),
+        MOVE(1, 0), UN(Opcode.NEG, 1), UN(Opcode.NEG, 1), ins(Opcode.RET, 1)
+    ], consts=(func(22, 1, 8), i64(2646700), f64(100.0), f64(0.5)), globs=(i64(0), f64(0.0))),
+
+    # one call site that hits f then g, the inline cache has to notice the callee changed
+    TestCase(Opcode.CALL, "call_site_two_callees", [
+        LOADI(0, 0), LOADI(1, 0), LOADC(4, 0),
+        ins(Opcode.CALL, 4, 0, 2), BIN(Opcode.ADD_N, 1, 1, 2), JMPIF(0, 3),
+        LOADI(0, 1), LOADC(4, 1), JMP(-6),
+        LOADI(3, 43), BIN(Opcode.EQ_N, 2, 1, 3), JMPIF(2, 1), PANIC(), HALT(),
+        LOADI(0, 1), ins(Opcode.RET, 0),
+        LOADI(0, 42), ins(Opcode.RET, 0)
+    ], consts=(func(14, 0, 2), func(16, 0, 2))),
+
+    # main calls f, f tail calls g, g's return has to land in main's dest register
+    TestCase(Opcode.TAILCALL, "tailcall_keeps_return_reg", [
+        LOADC(0, 0), ins(Opcode.CALL, 0, 0, 1),
+        LOADI(2, 42), BIN(Opcode.EQ, 3, 1, 2), JMPIF(3, 1), PANIC(), HALT(),
+        LOADC(0, 1), ins(Opcode.TAILCALL, 0, 0),
+        LOADI(0, 42), ins(Opcode.RET, 0)
+    ], consts=(func(7, 0, 4), func(9, 0, 4))),
 ]
 
+def write_stk(filename, words, consts=(), globs=()) -> None:
+    """write a single .stk file (header, instructions, then the optional pools)"""
+    with open(filename, "wb") as f:
+        # header
+        f.write(pack("<4sHHIII", HEADER, VERSION, FLAGS, len(words), len(consts), len(globs)))
+
+        # instructions
+        f.write(pack(f"<{len(words)}I", *words))
+
+        # optional consts/globals
+        for c in consts: f.write(c)
+        for g in globs: f.write(g)
+
 # ensure dir then run each test inside
 def main() -> None:
     Path("tests").mkdir(exist_ok=True)
 
     for t in TESTS:
         filename = f"tests/testop{int(t.tag)}_{t.name}.stk"
-        with open(filename, "wb") as f:
-            # header
-            f.write(pack("<4sHHIII", HEADER, VERSION, FLAGS, len(t.words), len(t.consts), len(t.globs)))
-
-            # instructions
-            f.write(pack(f"<{len(t.words)}I", *t.words))
-
-            # optional consts/globals
-            for c in t.consts: f.write(c)
-            for g in t.globs: f.write(g)
+        write_stk(filename, t.words, t.consts, t.globs)
 
         # log if verbose
-        if VERBOSE: print(f"Created {filename} ({name})")
+        if VERBOSE: print(f"Created {filename} ({t.name})")
 
 if __name__ == "__main__":
     main()
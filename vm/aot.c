@@ -0,0 +1,71 @@
+/**
+ * @file aot.c
+ * @author Noah Mingolelli
+ * @brief matching a loaded program to its transpiled functions. see aot.h
+ * License: GPLv3
+ */
+#include "aot.h"
+
+// fnv-1a, nothing fancy, it just has to tell programs apart
+static u64 mix(u64 h, const void* data, size_t n) {
+    const u8* p = (const u8*)data;
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+u64 aot_checksum(const VM* vm) {
+    u64 h = 0xCBF29CE484222325ull;
+    h = mix(h, &vm->icount, sizeof vm->icount);
+    if (vm->istream) h = mix(h, vm->istream, vm->icount * sizeof(Instruction));
+
+    for (u32 i = 0; i < vm->constcount; i++) {
+        u8 type = vm->consttypes[i];
+        h = mix(h, &type, sizeof type);
+        // a string constant is a pointer that changes every run. its bytes are the U64s right after it, those count
+        if (type == OBJ && !obj_inline(vm->consts[i])) continue;
+        if (type != CALLABLE) {
+            h = mix(h, &vm->consts[i], sizeof vm->consts[i]);
+            continue;
+        }
+
+        Func* fn = vm->consts[i].fn;
+        if (fn && fn->kind == BYTECODE) {
+            h = mix(h, &fn->as.bc.entry_ip, sizeof fn->as.bc.entry_ip);
+            h = mix(h, &fn->as.bc.argc, sizeof fn->as.bc.argc);
+            h = mix(h, &fn->as.bc.regc, sizeof fn->as.bc.regc);
+        }
+    }
+    return h;
+}
+
+u32 aot_bind(VM* vm) {
+#if VM_AOT
+    if (!vm || !vm->funcs) return 0;
+    u64 sum = aot_checksum(vm);
+
+    for (u32 p = 0; p < aot_programcount; p++) {
+        const AotProgram* prog = &aot_programs[p];
+        if (prog->checksum != sum) continue;
+        if (!prog->checked && !vm->verified) return 0;
+
+        u32 bound = 0;
+        for (u32 i = 0; i < vm->funccount; i++) {
+            Func* fn = vm->funcs[i];
+            if (!fn || fn->kind != BYTECODE) continue;
+            for (u32 j = 0; j < prog->funccount; j++) {
+                if (prog->funcs[j].entry_ip != fn->as.bc.entry_ip) continue;
+                fn->as.bc.aot = prog->funcs[j].fn;
+                bound++;
+                break;
+            }
+        }
+        return bound;
+    }
+#else
+    (void)vm;
+#endif
+    return 0;
+}
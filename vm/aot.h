@@ -0,0 +1,76 @@
+/**
+ * @file aot.h
+ * @author Noah Mingolelli
+ * @brief ahead of time transpiled functions. the runtime half of utils/stk2c.c
+ * License: GPLv3
+ *
+ * for fixed bytecode you ship, stk2c turns a .stk into a C file with one function per CALLABLE (see the
+ * Makefile's aot target). that file gets compiled into the vm (VM_AOT=1) and on load, if the program being loaded
+ * is one it was generated from, its bytecode functions are bound to the native versions.
+ *
+ * a transpiled function works on the same register window as the interpreter, with the same Registers layout
+ * and the same typing rules, and hands off exactly like the jit does (see jit.h): it's entered with an ip, runs
+ * until a call, a return, or anything it doesn't cover, and gives back the ip for the interpreter to carry on
+ * from. it can be entered at its entry or right after any of its calls, which is everywhere the interpreter
+ * lands after a CALL/TAILCALL/RET.
+ *
+ * programs are matched by aot_checksum (code and constants), so a build never runs code it wasn't generated
+ * for. code generated from a program that verified leaves the type checks out, so it's only bound when the
+ * program verifies at runtime too.
+ */
+#ifndef AOT_H
+#define AOT_H
+
+#include "vm.h"
+
+// off unless the generated functions are linked in (make aot)
+#ifndef VM_AOT
+#define VM_AOT 0
+#endif
+
+// transpiled functions use R/T straight, same as the jit
+#if VM_AOT && VM_NANBOX
+  #error "aot functions only work on split registers, build VM_NANBOX=1 without VM_AOT"
+#endif
+
+// one transpiled function
+typedef struct {
+    u32   entry_ip;
+    AotFn fn;
+} AotFunc;
+
+// one transpiled program
+typedef struct {
+    u64            checksum;   // aot_checksum of the program it came from
+    bool           checked;    // type checks are in (the program didn't verify when it was transpiled)
+    const AotFunc* funcs;
+    u32            funccount;
+} AotProgram;
+
+// defined by the generated file
+#if VM_AOT
+extern const AotProgram aot_programs[];
+extern const u32 aot_programcount;
+#endif
+
+/**
+ * fingerprint a loaded program: the instruction stream and the constant pool (callables by entry, argc and regc,
+ * since their payloads are pointers by now)
+ * @param vm a vm that's been through vm_load_file
+ */
+u64 aot_checksum(const VM* vm);
+
+/**
+ * bind the loaded program's bytecode functions to their transpiled versions, if this build has them
+ * @return how many functions were bound
+ */
+u32 aot_bind(VM* vm);
+
+// doubles get baked into generated code as their bits
+static inline double aot_f64(u64 bits) {
+    double d;
+    memcpy(&d, &bits, sizeof d);
+    return d;
+}
+
+#endif
@@ -0,0 +1,232 @@
+/**
+ * @file array.c
+ * @author Noah Mingolelli
+ * @brief the bulk array kernels. see array.h
+ * License: GPLv3
+ */
+#include "array.h"
+
+#if VM_SIMD
+#include <emmintrin.h>
+#endif
+
+// kernels, one per element width. everything's unaligned (items sit 8 bytes into a 16 byte block)
+
+static void fill_u64(u64* p, size_t n, u64 x) {
+    size_t i = 0;
+#if VM_SIMD
+    __m128i v = _mm_set1_epi64x((long long)x);
+    for (; i + 2 <= n; i += 2) _mm_storeu_si128((__m128i*)(p + i), v);
+#endif
+    for (; i < n; i++) p[i] = x;
+}
+
+static void fill_u32(u32* p, size_t n, u32 x) {
+    size_t i = 0;
+#if VM_SIMD
+    __m128i v = _mm_set1_epi32((int)x);
+    for (; i + 4 <= n; i += 4) _mm_storeu_si128((__m128i*)(p + i), v);
+#endif
+    for (; i < n; i++) p[i] = x;
+}
+
+static u64 sum_u64(const u64* p, size_t n) {
+    size_t i = 0;
+    u64 sum = 0;
+#if VM_SIMD
+    __m128i a = _mm_setzero_si128(), b = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4) {
+        a = _mm_add_epi64(a, _mm_loadu_si128((const __m128i*)(p + i)));
+        b = _mm_add_epi64(b, _mm_loadu_si128((const __m128i*)(p + i + 2)));
+    }
+    u64 lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, _mm_add_epi64(a, b));
+    sum = lanes[0] + lanes[1];
+#endif
+    for (; i < n; i++) sum += p[i];
+    return sum;
+}
+
+// how many bytes are set (bool arrays only ever hold 0 or 1)
+static u64 sum_u8(const u8* p, size_t n) {
+    size_t i = 0;
+    u64 sum = 0;
+#if VM_SIMD
+    __m128i acc = _mm_setzero_si128(), zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(p + i)), zero));
+    u64 lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    sum = lanes[0] + lanes[1];
+#endif
+    for (; i < n; i++) sum += p[i];
+    return sum;
+}
+
+// float sums always go through the same 4 lanes (see array.h), simd or not
+static double sum_f64(const double* p, size_t n) {
+    size_t i = 0;
+    double sum;
+#if VM_SIMD
+    __m128d a = _mm_setzero_pd(), b = _mm_setzero_pd();
+    for (; i + 4 <= n; i += 4) {
+        a = _mm_add_pd(a, _mm_loadu_pd(p + i));
+        b = _mm_add_pd(b, _mm_loadu_pd(p + i + 2));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(a, b));
+    sum = lanes[0] + lanes[1];
+#else
+    double l[4] = {0, 0, 0, 0};
+    for (; i + 4 <= n; i += 4) {
+        l[0] += p[i]; l[1] += p[i + 1]; l[2] += p[i + 2]; l[3] += p[i + 3];
+    }
+    sum = (l[0] + l[2]) + (l[1] + l[3]);
+#endif
+    for (; i < n; i++) sum += p[i];
+    return sum;
+}
+
+static double sum_f32(const float* p, size_t n) {
+    size_t i = 0;
+    double sum;
+#if VM_SIMD
+    __m128d a = _mm_setzero_pd(), b = _mm_setzero_pd();
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_loadu_ps(p + i);
+        a = _mm_add_pd(a, _mm_cvtps_pd(x));
+        b = _mm_add_pd(b, _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(a, b));
+    sum = lanes[0] + lanes[1];
+#else
+    double l[4] = {0, 0, 0, 0};
+    for (; i + 4 <= n; i += 4) {
+        l[0] += p[i]; l[1] += p[i + 1]; l[2] += p[i + 2]; l[3] += p[i + 3];
+    }
+    sum = (l[0] + l[2]) + (l[1] + l[3]);
+#endif
+    for (; i < n; i++) sum += p[i];
+    return sum;
+}
+
+static void add_u64(u64* p, size_t n, u64 x) {
+    size_t i = 0;
+#if VM_SIMD
+    __m128i v = _mm_set1_epi64x((long long)x);
+    for (; i + 2 <= n; i += 2) {
+        __m128i* q = (__m128i*)(p + i);
+        _mm_storeu_si128(q, _mm_add_epi64(_mm_loadu_si128(q), v));
+    }
+#endif
+    for (; i < n; i++) p[i] += x;
+}
+
+static void add_f64(double* p, size_t n, double x) {
+    size_t i = 0;
+#if VM_SIMD
+    __m128d v = _mm_set1_pd(x);
+    for (; i + 2 <= n; i += 2) _mm_storeu_pd(p + i, _mm_add_pd(_mm_loadu_pd(p + i), v));
+#endif
+    for (; i < n; i++) p[i] += x;
+}
+
+static void add_f32(float* p, size_t n, float x) {
+    size_t i = 0;
+#if VM_SIMD
+    __m128 v = _mm_set1_ps(x);
+    for (; i + 4 <= n; i += 4) _mm_storeu_ps(p + i, _mm_add_ps(_mm_loadu_ps(p + i), v));
+#endif
+    for (; i < n; i++) p[i] += x;
+}
+
+static bool mismatch(VM* vm) {
+    vm->panic_code = PANIC_TYPE_MISMATCH;
+    return false;
+}
+
+bool array_fill(VM* vm, ObjArray* arr, u8 tag, TypedValue val) {
+    size_t n = arr->length;
+
+    // one barrier covers the lot, it's the same value in every slot
+    if (arr->elem == NUL) {
+        gc_barrier(&vm->gc, &arr->header, tag, val);
+        fill_u64((u64*)arr->items, n, val.u);
+        memset(array_types(arr), tag, n);
+        return true;
+    }
+
+    if (tag != arr->elem) return mismatch(vm);
+    switch (tag) {
+        case FLOAT: {
+            u32 bits;
+            memcpy(&bits, &val.f, sizeof(bits));
+            fill_u32((u32*)arr->items, n, bits);
+            break;
+        }
+        case BOOL:
+            memset(arr->items, val.u != 0, n);
+            break;
+        default:
+            fill_u64((u64*)arr->items, n, val.u);
+            break;
+    }
+    return true;
+}
+
+bool array_copy(VM* vm, ObjArray* dst, ObjArray* src, i64 n) {
+    if (dst->elem != src->elem) return mismatch(vm);
+    if ((u64)n > dst->length || (u64)n > src->length) {
+        vm->panic_code = PANIC_INDEX;
+        return false;
+    }
+
+    size_t count = (size_t)n;
+    if (dst->elem != NUL) {
+        memmove(dst->items, src->items, count * array_stride(dst->elem));
+        return true;
+    }
+
+    memmove(dst->items, src->items, count * sizeof(TypedValue));
+    memmove(array_types(dst), array_types(src), count);
+
+    // objects moving in go through the barrier like any other store (it's a no-op for a young dst)
+    if (dst->header.generation == GEN_OLD) {
+        u8* types = array_types(dst);
+        for (size_t i = 0; i < count; i++) {
+            if (types[i] == OBJ) gc_barrier(&vm->gc, &dst->header, OBJ, dst->items[i]);
+        }
+    }
+    return true;
+}
+
+bool array_sum(VM* vm, ObjArray* arr, u8* tag, TypedValue* sum) {
+    size_t n = arr->length;
+    TypedValue v = { .u = 0 };
+    switch (arr->elem) {
+        case I64: case U64: v.u = sum_u64((const u64*)arr->items, n); break;
+        case DOUBLE:        v.d = sum_f64((const double*)arr->items, n); break;
+        case FLOAT:         v.f = (float)sum_f32((const float*)arr->items, n); break;
+        case BOOL:
+            *tag = I64;
+            sum->i = (i64)sum_u8((const u8*)arr->items, n);
+            return true;
+        default:
+            return mismatch(vm);
+    }
+    *tag = arr->elem;
+    *sum = v;
+    return true;
+}
+
+bool array_add(VM* vm, ObjArray* arr, u8 tag, TypedValue val) {
+    if (tag != arr->elem) return mismatch(vm);
+    size_t n = arr->length;
+    switch (tag) {
+        case I64: case U64: add_u64((u64*)arr->items, n, val.u); break;
+        case DOUBLE:        add_f64((double*)arr->items, n, val.d); break;
+        case FLOAT:         add_f32((float*)arr->items, n, val.f); break;
+        default:            return mismatch(vm);
+    }
+    return true;
+}
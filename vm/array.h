@@ -0,0 +1,84 @@
+/**
+ * @file array.h
+ * @author Noah Mingolelli
+ * @brief array element access and the bulk array ops (ARRFILL, ARRCOPY, ARRSUM, ARRADD)
+ * License: GPLv3
+ *
+ * typed arrays (see ObjArray) keep their elements packed, so a bulk op over one is a straight loop over plain
+ * i64s/u64s/floats/doubles/bytes that runs at memory speed. with VM_SIMD (sse2, on by default wherever the
+ * compiler has it) those loops are written with intrinsics, two or four elements an instruction, otherwise they're
+ * plain C that the compiler is free to vectorize itself. both sides give the same answer bit for bit: float sums
+ * always add in 4 lanes (element i goes to lane i % 4, the lanes get combined as (0 + 2) + (1 + 3), then the tail
+ * in order), so a sum doesn't change with the build. f32 sums are carried in doubles.
+ *
+ * every op checks its types and bounds up front (a typed array only takes its own type, tagged arrays can't be
+ * summed or added to), then runs without another check.
+ */
+#ifndef ARRAY_H
+#define ARRAY_H
+
+#include "vm.h"
+
+// element i of arr (already bounds checked) as a split value. returns its tag
+static inline u8 array_load(ObjArray* arr, u32 i, TypedValue* out) {
+    TypedValue v = { .u = 0 };
+    switch (arr->elem) {
+        case I64:    v.i = ((i64*)arr->items)[i]; break;
+        case U64:    v.u = ((u64*)arr->items)[i]; break;
+        case DOUBLE: v.d = ((double*)arr->items)[i]; break;
+        case FLOAT:  v.f = ((float*)arr->items)[i]; break;
+        case BOOL:   v.u = ((u8*)arr->items)[i]; break;
+        default:
+            *out = arr->items[i];
+            return array_types(arr)[i];
+    }
+    *out = v;
+    return arr->elem;
+}
+
+// store (tag, val) as element i of arr (already bounds checked). false (a type mismatch) if it can't hold it
+static inline bool array_store(VM* vm, ObjArray* arr, u32 i, u8 tag, TypedValue val) {
+    if (arr->elem == NUL) {
+        gc_barrier(&vm->gc, &arr->header, tag, val);
+        array_types(arr)[i] = tag;
+        arr->items[i] = val;
+        return true;
+    }
+    if (LIKELYFALSE(tag != arr->elem)) {
+        vm->panic_code = PANIC_TYPE_MISMATCH;
+        return false;
+    }
+    switch (tag) {
+        case FLOAT: ((float*)arr->items)[i] = val.f; break;
+        case BOOL:  ((u8*)arr->items)[i] = val.u != 0; break;
+        default:    arr->items[i] = val; break;
+    }
+    return true;
+}
+
+/**
+ * every element of arr = (tag, val)
+ * @return false with vm->panic_code set if arr can't hold it
+ */
+bool array_fill(VM* vm, ObjArray* arr, u8 tag, TypedValue val);
+
+/**
+ * the first n elements of src into dst (they can be the same array). both have to be the same element type
+ * @return false with vm->panic_code set on a type mismatch, or n past either length
+ */
+bool array_copy(VM* vm, ObjArray* dst, ObjArray* src, i64 n);
+
+/**
+ * sum every element of a numeric or bool array (ints wrap, a bool array counts its trues as an i64)
+ * @param tag where the sum's tag goes
+ * @return false with vm->panic_code set for a tagged array
+ */
+bool array_sum(VM* vm, ObjArray* arr, u8* tag, TypedValue* sum);
+
+/**
+ * add (tag, val) to every element of a numeric array (ints wrap)
+ * @return false with vm->panic_code set if it's not numeric or val isn't its type
+ */
+bool array_add(VM* vm, ObjArray* arr, u8 tag, TypedValue val);
+
+#endif
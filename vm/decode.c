@@ -0,0 +1,297 @@
+/**
+ * @file decode.c
+ * @author Noah Mingolelli
+ * @brief turns the packed on-disk stream into Insts. see decode.h for the layout
+ * License: GPLv3
+ */
+#include "decode.h"
+
+// a trap fires panic code `code` when (and only when) it gets executed
+static inline Inst trap(u32 code) {
+    return (Inst){ .op = TRAP, .a = (u16)code };
+}
+
+/**
+ * resolve a relative jump into an absolute index. the offset is relative to the NEXT instruction
+ * (same as when ip was incremented before the handler ran), anything out of range goes to the oob trap
+ */
+static inline u32 resolve_target(VM* vm, u32 at, i32 off) {
+    i64 next = (i64)at + 1 + (i64)off;
+    if (next < 0 || next >= (i64)vm->icount) return DECODE_OOB(vm);
+    return (u32)next;
+}
+
+// which operands a WIDE prefix is allowed to extend
+enum { WIDE_A = 1, WIDE_B = 2, WIDE_C = 4 };
+
+// true unless the prefix carries high bits for an operand that can't take them
+static inline bool widens(Instruction pre, u32 mask) {
+    return (!(op_a(pre)) || (mask & WIDE_A)) && (!(op_b(pre)) || (mask & WIDE_B)) && (!(op_c(pre)) || (mask & WIDE_C));
+}
+
+// track the highest register an instruction touches
+static inline void span(u32* regspan, u32 reg) {
+    if (reg + 1 > *regspan) *regspan = reg + 1;
+}
+
+/**
+ * decode a single packed instruction
+ * @param vm the vm being loaded (for pools and jump bounds)
+ * @param at index of this instruction
+ * @param ins the packed word
+ * @param pre the WIDE prefix in front of it (0 if there isn't one, which widens nothing)
+ * @param regspan running max of registers touched
+ * running out of memory sets vm->panic_code to PANIC_OOM, vm_decode fails the load on it
+ */
+static Inst decode_one(VM* vm, u32 at, Instruction ins, Instruction pre, u32* regspan) {
+    Inst out = {
+        .op = (u8)opcode(ins),
+        .a  = (u16)(op_a(ins) | op_a(pre) << 8),
+        .b  = (u16)(op_b(ins) | op_b(pre) << 8),
+        .c  = (u16)(op_c(ins) | op_c(pre) << 8),
+    };
+
+    // nothing from disk gets to name an internal opcode
+    if (opcode(ins) >= OPCODE_COUNT) return trap(PANIC_INVALID_OPCODE);
+
+    // a prefix on something with nothing to widen (or on another prefix) is as bad as a bad opcode
+    #define WIDENS(MASK) do { if (!widens(pre, (MASK))) return trap(PANIC_INVALID_OPCODE); } while (0)
+
+    switch ((Opcode)out.op) {
+        // no registers
+        case HALT:
+        case PANIC:
+        case WIDE:
+            WIDENS(0);
+            break;
+
+        case JMP:
+            WIDENS(0);
+            out.a = out.b = out.c = 0;
+            out.x.target = resolve_target(vm, at, op_signed_i24(ins));
+            break;
+
+        case JMPIF:
+        case JMPIFZ:
+            WIDENS(WIDE_A);
+            span(regspan, out.a);
+            out.b = out.c = 0;
+            out.x.target = resolve_target(vm, at, op_signed_i16(ins));
+            break;
+
+        // index, limit and step sit in a..a+2
+        case FORPREP: case FORLOOP:
+        case FORPREP_D: case FORLOOP_D:
+            WIDENS(WIDE_A);
+            span(regspan, (u32)out.a + 2);
+            out.b = out.c = 0;
+            out.x.target = resolve_target(vm, at, op_signed_i16(ins));
+            break;
+
+        // the table's count and offsets all have to be i64 consts that fit, anything else is a bad pool index.
+        // cases that land outside the stream go to the oob trap, same as a jump
+        case JMPTABLE: {
+            u32 idx = op_b(ins) | op_b(pre) << 8 | op_c(pre) << 16;
+            const TypedValue* k = vm->consts;
+            const u8* kt = vm->consttypes;
+            if (!k || idx >= vm->constcount || kt[idx] != I64) return trap(PANIC_OOB);
+
+            i64 count = k[idx].i;
+            if (count < 0 || (u64)count >= vm->constcount - idx) return trap(PANIC_OOB);
+
+            JumpTable* jt = (JumpTable*)malloc(sizeof(JumpTable) + ((size_t)count + 1) * sizeof(u32));
+            if (!jt) {
+                vm->panic_code = PANIC_OOM;
+                return trap(PANIC_OOM);
+            }
+            jt->count = (u32)count;
+            for (u32 i = 0; i < jt->count; i++) {
+                i64 off = k[idx + 1 + i].i;
+                if (kt[idx + 1 + i] != I64) {
+                    free(jt);
+                    return trap(PANIC_OOB);
+                }
+                jt->targets[i] = off >= INT32_MIN && off <= INT32_MAX ? resolve_target(vm, at, (i32)off) : DECODE_OOB(vm);
+            }
+            jt->targets[jt->count] = at + 1;
+
+            vm->tables[vm->tablecount++] = jt;
+            span(regspan, out.a);
+            out.b = out.c = 0;
+            out.x.jt = jt;
+            break;
+        }
+
+        case LOADI:
+            WIDENS(WIDE_A);
+            span(regspan, out.a);
+            out.b = out.c = 0;
+            out.x.imm = op_signed_i16(ins);
+            break;
+
+        // const indices get resolved to the payload (and its tag, constants don't change), global ones are just
+        // range checked. bad index = oob trap, same as before
+        case LOADC: {
+            u32 idx = op_b(ins) | op_b(pre) << 8 | op_c(pre) << 16;
+            if (!vm->consts || idx >= vm->constcount) return trap(PANIC_OOB);
+            span(regspan, out.a);
+            out.b = out.c = 0;
+            out.aux = vm->consttypes[idx];
+            out.x.k = &vm->consts[idx];
+            break;
+        }
+
+        case LOADG:
+        case STOREG: {
+            u32 idx = op_b(ins) | op_b(pre) << 8 | op_c(pre) << 16;
+            if (!vm->globals || idx >= vm->globalcount) return trap(PANIC_OOB);
+            span(regspan, out.a);
+            out.b = out.c = 0;
+            out.x.slot = idx;
+            break;
+        }
+
+        // CALL func argc dest (argc isn't a register, the args live in the callee's window)
+        case CALL:
+            span(regspan, out.a);
+            span(regspan, out.c);
+            out.x.ic = &vm->ics[vm->iccount++];
+            break;
+
+        // TAILCALL func argc. the args (func+1..func+argc) get moved down into the frame, so they count too
+        case TAILCALL:
+            WIDENS(WIDE_A | WIDE_B);
+            span(regspan, out.a);
+            span(regspan, (u32)out.a + out.b);
+            out.c = 0;
+            out.x.ic = &vm->ics[vm->iccount++];
+            break;
+
+        // dest, src, and an immediate in place of the last register (shifts only keep the low 6 bits)
+        case ADDI: case SUBI: case MULI:
+        case EQI: case NEQI: case GTI: case GEI: case LTI: case LEI:
+            WIDENS(WIDE_A | WIDE_B);
+            span(regspan, out.a);
+            span(regspan, out.b);
+            out.c = 0;
+            out.x.imm = (i8)op_c(ins);
+            break;
+
+        case SHLI: case SHRI:
+            WIDENS(WIDE_A | WIDE_B);
+            span(regspan, out.a);
+            span(regspan, out.b);
+            out.c = 0;
+            out.x.imm = op_c(ins) & 63;
+            break;
+
+        // single register
+        case RET: case NEWTABLE:
+        case LNOT: case BNOT: case BNOT_U:
+        case NEG: case NEG_U: case NEG_F: case NEG_D:
+            WIDENS(WIDE_A);
+            span(regspan, out.a);
+            break;
+
+        // NEWARR dest len elem. an element type arrays can't hold is a type mismatch, if it's ever reached
+        case NEWARR:
+            WIDENS(WIDE_A | WIDE_B);
+            if (!array_stride((u8)out.c)) return trap(PANIC_TYPE_MISMATCH);
+            span(regspan, out.a);
+            span(regspan, out.b);
+            break;
+
+        // arr, val
+        case ARRFILL: case ARRADD:
+            WIDENS(WIDE_A | WIDE_B);
+            span(regspan, out.a);
+            span(regspan, out.b);
+            out.c = 0;
+            break;
+
+        // dest, src
+        case ARRLEN: case ARRSUM: case STRLEN:
+        case COPY: case MOVE:
+        case I2D: case I2F: case D2I: case F2I: case I2U:
+        case U2I: case U2D: case U2F: case D2U: case F2U:
+            WIDENS(WIDE_A | WIDE_B);
+            span(regspan, out.a);
+            span(regspan, out.b);
+            break;
+
+        // everything else is dest, lhs, rhs (or unimplemented, and it'll hit the invalid opcode handler)
+        default:
+            span(regspan, out.a);
+            span(regspan, out.b);
+            span(regspan, out.c);
+            break;
+    }
+    #undef WIDENS
+
+    return out;
+}
+
+// out of memory partway: everything decoding allocated goes, the load fails
+static bool decode_oom(VM* vm, Inst* code) {
+    free(code);
+    for (u32 i = 0; i < vm->tablecount; i++) free(vm->tables[i]);
+    free(vm->ics);
+    free(vm->tables);
+    vm->ics = NULL;
+    vm->tables = NULL;
+    vm->iccount = vm->tablecount = 0;
+    vm->panic_code = PANIC_OOM;
+    return false;
+}
+
+bool vm_decode(VM* vm) {
+    if (!vm || !vm->istream) return false;
+
+    Inst* code = (Inst*)malloc(((size_t)vm->icount + DECODE_PAD) * sizeof(Inst));
+    if (!code) {
+        vm->panic_code = PANIC_OOM;
+        return false;
+    }
+
+    // every call site gets its own (empty) inline cache, every JMPTABLE its own table
+    u32 sites = 0, switches = 0;
+    for (u32 i = 0; i < vm->icount; i++) {
+        u32 op = opcode(vm->istream[i]);
+        if (op == CALL || op == TAILCALL) sites++;
+        if (op == JMPTABLE) switches++;
+    }
+
+    vm->iccount = 0;
+    vm->ics = sites ? (CallCache*)calloc(sites, sizeof(CallCache)) : NULL;
+    vm->tablecount = 0;
+    vm->tables = switches ? (JumpTable**)calloc(switches, sizeof(JumpTable*)) : NULL;
+    if ((sites && !vm->ics) || (switches && !vm->tables)) return decode_oom(vm, code);
+
+    // a WIDE's operands get folded into the instruction after it, the prefix slot stays as a no-op
+    // (ips don't move, and a jump to either slot does the same thing)
+    u32 regspan = 0;
+    for (u32 i = 0; i < vm->icount; i++) {
+        Instruction pre = i > 0 && opcode(vm->istream[i - 1]) == WIDE ? vm->istream[i - 1] : 0;
+        code[i] = decode_one(vm, i, vm->istream[i], pre, &regspan);
+        if (LIKELYFALSE(vm->panic_code == PANIC_OOM)) return decode_oom(vm, code);
+        if (code[i].op == WIDE) code[i].a = code[i].b = code[i].c = 0;
+    }
+
+    // running off the end, and jumping off the end
+    code[DECODE_END(vm)] = trap(PANIC_NO_HALT);
+    code[DECODE_OOB(vm)] = trap(PANIC_OOB);
+
+    // a function whose entry is past the stream ran off the end before, so it still does
+    if (vm->funcs) {
+        for (u32 i = 0; i < vm->constcount; i++) {
+            Func* fn = vm->funcs[i];
+            if (fn && fn->kind == BYTECODE && fn->as.bc.entry_ip >= vm->icount) {
+                fn->as.bc.entry_ip = DECODE_END(vm);
+            }
+        }
+    }
+
+    vm->code = code;
+    vm->regspan = regspan;
+    return true;
+}
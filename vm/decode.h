@@ -0,0 +1,75 @@
+/**
+ * @file decode.h
+ * @author Noah Mingolelli
+ * @brief load time translation of the packed 32-bit stream into decoded Insts
+ * License: GPLv3
+ *
+ * the file format stays packed ([op:8][a:8][b:8][c:8]), but nothing in vm_run should have to pull it apart.
+ * vm_decode walks the stream once after vm_load and builds vm->code:
+ * - operands are widened out into Inst.a/b/c
+ * - LOADI immediates are sign extended
+ * - jump offsets become absolute targets
+ * - LOADC/LOADG/STOREG indices become pointers into the pools
+ * - every CALL/TAILCALL gets a pointer to its own inline cache (vm->ics)
+ * - every JMPTABLE gets its cases checked and resolved into a JumpTable (vm->tables)
+ * - a WIDE prefix gets folded into the operands of the instruction after it
+ *
+ * anything that is wrong but only matters if it runs (a jump past the end, a bad pool index, an opcode
+ * that doesn't exist) is turned into a TRAP with the panic code it would have raised, so the runtime
+ * behavior is identical and the handlers never check.
+ *
+ * layout of vm->code (icount + DECODE_PAD entries):
+ * [0, icount)  decoded instructions (1:1 with istream, so ips and entry points dont move)
+ * icount       TRAP(PANIC_NO_HALT), where execution lands if it runs off the end
+ * icount + 1   TRAP(PANIC_OOB), where every out of range jump points
+ */
+#ifndef DECODE_H
+#define DECODE_H
+
+#include "vm.h"
+
+// trailing trap slots after the real instructions
+#define DECODE_PAD 2
+#define DECODE_END(vm) ((vm)->icount)
+#define DECODE_OOB(vm) ((vm)->icount + 1)
+
+// no successor (see decoded_next/decoded_target)
+#define DECODE_NONE 0xFFFFFFFFu
+
+// where a decoded instruction goes when it doesn't jump, DECODE_NONE if it never falls through.
+// fused pairs skip their second slot
+static inline u32 decoded_next(const Inst* in, u32 ip) {
+    switch (in->op) {
+        case HALT: case PANIC: case TRAP: case RET: case TAILCALL: case JMP:
+            return DECODE_NONE;
+        default:
+            if ((in->op >= JEQ && in->op <= JLE_D) || (in->op >= ADD_KI && in->op <= SUB_KD)) return ip + 2;
+            return ip + 1;
+    }
+}
+
+// where it jumps to, DECODE_NONE if it never does
+static inline u32 decoded_target(const Inst* in) {
+    if (in->op == JMP || in->op == JMPIF || in->op == JMPIFZ || (in->op >= JEQ && in->op <= JLE_D)) return in->x.target;
+    if (in->op >= FORPREP && in->op <= FORLOOP_D) return in->x.target;
+    return DECODE_NONE;
+}
+
+// a JMPTABLE's case targets (its fallthrough is decoded_next), NULL and 0 cases for anything else
+static inline const u32* decoded_cases(const Inst* in, u32* n) {
+    if (in->op != JMPTABLE) {
+        *n = 0;
+        return NULL;
+    }
+    *n = in->x.jt->count;
+    return in->x.jt->targets;
+}
+
+/**
+ * build vm->code from vm->istream. pools and globals must already be loaded
+ * @param vm a vm that has had vm_load called on it
+ * @return false (with panic_code set) if the decoded stream couldn't be allocated
+ */
+bool vm_decode(VM* vm);
+
+#endif
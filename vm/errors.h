@@ -27,6 +27,8 @@ typedef enum {
     PANIC_CALL_FAILED,
     PANIC_TYPE_MISMATCH,
     PANIC_INVALID_OPCODE,
+    PANIC_FOR_STEP,
+    PANIC_INDEX,
     PANIC_CODE_COUNT
 } Panic;
 
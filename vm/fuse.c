@@ -0,0 +1,209 @@
+/**
+ * @file fuse.c
+ * @author Noah Mingolelli
+ * @brief superinstruction fusion. see fuse.h for the patterns and the rules
+ * License: GPLv3
+ */
+#include "fuse.h"
+#include "decode.h"
+
+// is op one of the three consecutive compare families (and which fused family does it map to)
+static bool compare_family(u8 op, u8* fused) {
+    if (op >= EQ && op <= LE)       { *fused = (u8)(JEQ + (op - EQ));     return true; }
+    if (op >= EQ_U && op <= LE_U)   { *fused = (u8)(JEQ_U + (op - EQ_U)); return true; }
+    if (op >= EQ_D && op <= LE_D)   { *fused = (u8)(JEQ_D + (op - EQ_D)); return true; }
+    return false;
+}
+
+/**
+ * which of reg's uses an (unfused) instruction has
+ * @param in the instruction
+ * @param reg frame relative register
+ * @param reads set if the instruction reads reg
+ * @param writes set if it overwrites reg
+ */
+static void uses(const Inst* in, u16 reg, bool* reads, bool* writes) {
+    *reads = *writes = false;
+
+    switch (in->op) {
+        case LOADI: case LOADC: case LOADG: case NEWTABLE:
+            *writes = in->a == reg;
+            break;
+
+        case STOREG: case JMPIF: case JMPIFZ: case RET: case JMPTABLE:
+            *reads = in->a == reg;
+            break;
+
+        // MOVE nulls its source, but it has to read it first
+        case COPY: case MOVE:
+        case ADDI: case SUBI: case MULI: case SHLI: case SHRI:
+        case EQI: case NEQI: case GTI: case GEI: case LTI: case LEI:
+        case I2D: case I2F: case D2I: case F2I: case I2U:
+        case U2I: case U2D: case U2F: case D2U: case F2U:
+            *reads = in->b == reg;
+            *writes = in->a == reg;
+            break;
+
+        // index, limit, step (the index gets written, but only after it's read)
+        case FORPREP: case FORLOOP: case FORPREP_D: case FORLOOP_D:
+            *reads = reg >= in->a && reg <= in->a + 2;
+            break;
+
+        // stores into an array or table read every operand and write none
+        case ARRSET: case ARRFILL: case ARRCOPY: case ARRADD: case SETELEM:
+            *reads = in->a == reg || in->b == reg || in->c == reg;
+            break;
+
+        case NEG: case NEG_U: case NEG_F: case NEG_D: case NEG_N:
+        case BNOT: case BNOT_U: case LNOT:
+            *reads = in->a == reg;
+            break;
+
+        case HALT: case PANIC: case JMP: case TRAP: case WIDE:
+            break;
+
+        // CALL and anything unrecognized: assume it reads everything
+        case CALL: case TAILCALL:
+            *reads = true;
+            break;
+
+        // three operand ops
+        default:
+            *reads = in->b == reg || in->c == reg;
+            *writes = in->a == reg;
+            break;
+    }
+}
+
+/**
+ * is reg dead from ip on? (overwritten before it's read on every path, or the program ends first)
+ * gives up (returns false) on calls, returns, or when the shared budget runs out
+ */
+static bool dead_from(VM* vm, u32 ip, u16 reg, u32* budget) {
+    while (*budget > 0) {
+        (*budget)--;
+
+        // past the end is the no halt trap
+        if (ip >= vm->icount) return true;
+
+        const Inst* in = &vm->code[ip];
+        bool reads, writes;
+        uses(in, reg, &reads, &writes);
+        if (reads) return false;
+        if (writes) return true;
+
+        switch (in->op) {
+            case HALT: case PANIC: case TRAP:
+                return true;
+
+            case JMP:
+                ip = in->x.target;
+                break;
+
+            case JMPIF: case JMPIFZ:
+            case FORPREP: case FORLOOP: case FORPREP_D: case FORLOOP_D:
+                return dead_from(vm, in->x.target, reg, budget) && dead_from(vm, ip + 1, reg, budget);
+
+            // too many ways out to bother following
+            case RET: case CALL: case TAILCALL: case JMPTABLE:
+                return false;
+
+            default:
+                ip++;
+                break;
+        }
+    }
+    return false;
+}
+
+// dead after a fused pair, on every path out of it (taken, and skipping the second instruction)
+static bool dead_after(VM* vm, u32 second, u16 reg, const u32* target) {
+    u32 budget = FUSE_LOOKAHEAD;
+    if (target && !dead_from(vm, *target, reg, &budget)) return false;
+    return dead_from(vm, second + 1, reg, &budget);
+}
+
+/**
+ * try to fuse code[i] and code[i + 1]
+ * @param out the fused instruction, if it returns true
+ */
+static bool fuse_pair(VM* vm, u32 i, Inst* out) {
+    const Inst* first = &vm->code[i];
+    const Inst* second = &vm->code[i + 1];
+    u8 fused;
+
+    // compare into a branch on the same register
+    if (compare_family(first->op, &fused) && (second->op == JMPIF || second->op == JMPIFZ)) {
+        if (second->a != first->a) return false;
+
+        *out = *first;
+        out->op = fused;
+        out->x.target = second->x.target;
+        out->aux = second->op == JMPIF ? FUSE_SENSE : 0;
+        if (!dead_after(vm, i + 1, first->a, &second->x.target)) out->aux |= FUSE_KEEP;
+        return true;
+    }
+
+    // a load of a constant that the next add/sub uses
+    bool loadi = first->op == LOADI;
+    bool loadc_i = first->op == LOADC && first->aux == I64;
+    bool loadc_d = first->op == LOADC && first->aux == DOUBLE;
+    if (!loadi && !loadc_i && !loadc_d) return false;
+
+    u8 op = second->op;
+    bool is_int = (op == ADD || op == SUB) && (loadi || loadc_i);
+    bool is_dbl = (op == ADD_D || op == SUB_D) && loadc_d;
+    if (!is_int && !is_dbl) return false;
+
+    // the loaded register has to be exactly one operand. adds can take it on either side, subs on the right
+    u16 k = first->a;
+    u16 other;
+    bool add = op == ADD || op == ADD_D;
+    if (second->c == k && second->b != k) other = second->b;
+    else if (add && second->b == k && second->c != k) other = second->c;
+    else return false;
+
+    *out = (Inst){
+        .op = is_int ? (add ? ADD_KI : SUB_KI) : (add ? ADD_KD : SUB_KD),
+        .a = second->a,
+        .b = other,
+        .c = k,
+    };
+    if (loadi) out->x.imm = first->x.imm;
+    else if (loadc_i) out->x.imm = first->x.k->i;
+    else out->x.d = first->x.k->d;
+
+    // the add overwriting the loaded register is the common case (ADD r, x, r)
+    if (second->a != k && !dead_after(vm, i + 1, k, NULL)) out->aux |= FUSE_KEEP;
+    return true;
+}
+
+void vm_fuse(VM* vm) {
+    if (!vm || !vm->code || vm->icount < 2) return;
+
+    // decide everything against the untouched stream first, then rewrite. liveness scans can
+    // wander backwards through loops, and they need to see the original instructions there
+    Inst* fused = (Inst*)malloc(vm->icount * sizeof(Inst));
+    bool* hit = (bool*)calloc(vm->icount, sizeof(bool));
+    if (!fused || !hit) {
+        free(fused);
+        free(hit);
+        return;
+    }
+
+    for (u32 i = 0; i + 1 < vm->icount; i++) {
+        if (fuse_pair(vm, i, &fused[i])) {
+            hit[i] = true;
+            i++;  // second half is taken, dont start a pair on it
+        }
+    }
+
+    for (u32 i = 0; i < vm->icount; i++) {
+        if (!hit[i]) continue;
+        vm->code[i] = fused[i];
+        vm->stats.pairs++;
+    }
+
+    free(fused);
+    free(hit);
+}
@@ -0,0 +1,34 @@
+/**
+ * @file fuse.h
+ * @author Noah Mingolelli
+ * @brief load time peephole pass that fuses common instruction pairs into superinstructions
+ * License: GPLv3
+ *
+ * runs on the decoded stream after the verifier (so the verifier only ever sees real opcodes). fuses:
+ * - EQ..LE (i64, u64, f64) followed by JMPIF/JMPIFZ on the result -> JEQ..JLE(_U/_D)
+ * - LOADI, or LOADC of an I64/DOUBLE, followed by ADD/SUB (ADD_D/SUB_D) using it -> ADD_KI/SUB_KI, ADD_KD/SUB_KD
+ *
+ * the fused op replaces the FIRST instruction of the pair and skips the second when it runs. the second
+ * slot is left exactly as it was, so a jump that lands in the middle of a pair just runs the original
+ * instruction on its own. nothing moves, ips and jump targets stay valid.
+ *
+ * the intermediate (the BOOL a compare leaves for its branch, the register a load wrote) is still
+ * written unless a short forward scan proves every path overwrites it before reading it (FUSE_KEEP).
+ *
+ * VMStats.pairs counts what the pass did, STATS=1 builds also count fused dispatches at runtime.
+ */
+#ifndef FUSE_H
+#define FUSE_H
+
+#include "vm.h"
+
+// how many instructions the liveness scan will look at per question before assuming the value is read
+#define FUSE_LOOKAHEAD 16
+
+/**
+ * fuse pairs in vm->code in place
+ * @param vm a vm with a decoded (and verified, if it's going to be) stream
+ */
+void vm_fuse(VM* vm);
+
+#endif
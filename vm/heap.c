@@ -0,0 +1,730 @@
+/**
+ * @file heap.c
+ * @author Noah Mingolelli
+ * @brief the garbage collector and the builtin objects. see heap.h for the design
+ * License: GPLv3
+ */
+// clock_gettime isn't c99, ask for it before anything pulls in a libc header
+#define _DEFAULT_SOURCE
+#include <time.h>
+#include "vm.h"
+
+#if VM_GC_THREAD
+#include <pthread.h>
+#endif
+
+// the sweeper reads colors while the mutator remembers holders, so mark bytes get touched atomically. plain
+// loads and stores without a thread (the slab's free lists look after themselves)
+#if VM_GC_THREAD
+#define mark_load(obj)     __atomic_load_n(&(obj)->mark, __ATOMIC_RELAXED)
+#define mark_set(obj, bit) __atomic_fetch_or(&(obj)->mark, (u8)(bit), __ATOMIC_RELAXED)
+#define mark_clear(obj, bit) __atomic_fetch_and(&(obj)->mark, (u8)~(bit), __ATOMIC_RELAXED)
+#else
+#define mark_load(obj)     ((obj)->mark)
+#define mark_set(obj, bit) ((obj)->mark |= (u8)(bit))
+#define mark_clear(obj, bit) ((obj)->mark &= (u8)~(bit))
+#endif
+
+// one sweep: the last cycle's slab pages and large objects in, the survivors (pages that still have anything
+// alive in them, large objects compacted in place) out
+struct Sweeper {
+    SlabPage* pages[SLAB_CLASSES];
+    ObjHeader** objs;
+    size_t objc, objcap;
+    u8 black;
+    size_t live, freed;
+    u64 frees[SLAB_CLASSES];    // blocks freed per class
+    u32 dropped[SLAB_CLASSES];  // empty pages given back to the system
+
+#if VM_GC_THREAD
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake, finished;
+    bool running;   // the thread got made
+    bool queued;    // a sweep is waiting for it (under lock)
+    bool quit;      // under lock
+    bool done;      // atomic, the survivors are ready
+#endif
+};
+
+ObjInfo obj_builtins[OBJ_KIND_COUNT] = {
+    [OBJ_NONE]   = { .name = "none" },
+    [OBJ_ARRAY]  = { .name = "array",  .type = OBJ_ARRAY },
+    [OBJ_STRING] = { .name = "string", .type = OBJ_STRING },
+    [OBJ_ROPE]   = { .name = "rope",   .type = OBJ_ROPE },
+    [OBJ_TABLE]  = { .name = "table",  .type = OBJ_TABLE },
+    [OBJ_SLOTS]  = { .name = "slots",  .type = OBJ_SLOTS },
+};
+
+static bool push(ObjStack* s, ObjHeader* obj) {
+    if (s->count == s->cap) {
+        size_t cap = s->cap ? s->cap * 2 : 256;
+        ObjHeader** grown = (ObjHeader**)realloc(s->items, cap * sizeof(ObjHeader*));
+        if (!grown) return false;
+        s->items = grown;
+        s->cap = cap;
+    }
+    s->items[s->count++] = obj;
+    return true;
+}
+
+bool gc_init(VM* vm, GC* gc) {
+    (void)vm;
+    *gc = (GC){ .threshold = GC_MIN_HEAP, .step_us = GC_STEP_US, .black = MARK_BLACK };
+    return true;
+}
+
+// monotonic microseconds, only ever compared against each other
+static u64 now_us(void) {
+#if defined(__unix__) || defined(__APPLE__)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000u + (u64)ts.tv_nsec / 1000u;
+#else
+    return (u64)clock() * 1000000u / CLOCKS_PER_SEC;
+#endif
+}
+
+// where the fast path has to stop: the end of the nursery, or the next step while marking
+static void pace(GC* gc) {
+    if (!gc->nursery) return;
+    size_t left = (size_t)(gc->ceiling - gc->top);
+    gc->end = gc->marking && left > GC_STEP_BYTES ? gc->top + GC_STEP_BYTES : gc->ceiling;
+}
+
+static void sweeper_stop(GC* gc);
+
+bool gc_free(VM* vm, GC* gc) {
+    (void)vm;
+    // survivors that couldn't be put back (out of memory) are still the sweeper's
+    if (!gc_sweep_collect(gc, true)) {
+        for (size_t i = 0; i < gc->sweeper->objc; i++) free(gc->sweeper->objs[i]);
+    }
+    sweeper_stop(gc);
+    for (size_t i = 0; i < gc->objc; i++) free(gc->objs[i]);
+    free(gc->objs);
+    slab_release(&gc->slab);
+    free(gc->nursery);
+    free(gc->gray.items);
+    free(gc->remembered.items);
+    free(gc->scan.items);
+    free(gc->roots);
+    *gc = (GC){0};
+    return true;
+}
+
+// a block in the old generation (uninitialized). small ones come out of the slab, big ones get tracked in the
+// large object space so the sweep can find them
+static ObjHeader* old_alloc(GC* gc, u32 size) {
+    if (size <= SLAB_MAX) {
+        ObjHeader* obj = (ObjHeader*)slab_alloc(&gc->slab, size);
+        if (obj) gc->allocated += size;
+        return obj;
+    }
+
+    if (gc->objc == gc->objcap) {
+        size_t cap = gc->objcap ? gc->objcap * 2 : 256;
+        ObjHeader** grown = (ObjHeader**)realloc(gc->objs, cap * sizeof(ObjHeader*));
+        if (!grown) return NULL;
+        gc->objs = grown;
+        gc->objcap = cap;
+    }
+
+    ObjHeader* obj = (ObjHeader*)malloc(size);
+    if (!obj) return NULL;
+    gc->objs[gc->objc++] = obj;
+    gc->allocated += size;
+    return obj;
+}
+
+// copy a nursery object into the old generation (once, anything else pointing at it follows the forward)
+static ObjHeader* evacuate(GC* gc, ObjHeader* obj) {
+    if (obj->mark & GC_FORWARDED) return (ObjHeader*)obj->info;
+
+    ObjHeader* copy = old_alloc(gc, obj->size);
+    if (!copy) {
+        gc->failed = true;
+        return obj;
+    }
+    memcpy(copy, obj, obj->size);
+    copy->generation = GEN_OLD;
+    copy->mark = MARK_WHITE;
+    obj->info = (ObjInfo*)copy;
+    obj->mark |= GC_FORWARDED;
+    gc->promoted += copy->size;
+
+    // its fields can still point into the nursery. while marking they can also point at white old objects
+    // nothing has scanned yet, so it has to be traced like anything else reachable
+    if (!push(&gc->scan, copy)) gc->failed = true;
+    if (gc->marking) {
+        gc_set_color(copy, MARK_GRAY);
+        if (!push(&gc->gray, copy)) gc->failed = true;
+    }
+    return copy;
+}
+
+// one pointer found in a root or an object. a minor collection moves young objects out, marking grays white
+// old ones (young ones are left to their promotion, which grays them). returns where the object lives now
+static ObjHeader* visit(GC* gc, ObjHeader* obj) {
+    if (!obj || ((uintptr_t)obj & OBJ_INLINE)) return obj;
+    if (gc->state == SCAVENGE) return obj->generation == GEN_YOUNG ? evacuate(gc, obj) : obj;
+    if (obj->generation == GEN_YOUNG) return obj;
+
+    if (gc_is_white(gc, obj)) {
+        gc_set_color(obj, MARK_GRAY);
+        if (!push(&gc->gray, obj)) gc->failed = true;
+    }
+    return obj;
+}
+
+// split payload/tag slots (the pools, array elements), only OBJ tagged payloads are pointers
+static void visit_slots(GC* gc, TypedValue* vals, const u8* types, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (types[i] == OBJ) vals[i].obj = visit(gc, (ObjHeader*)vals[i].obj);
+    }
+}
+
+// top of the current frame's window. every frame below it lives under that (a callee's window starts above
+// its function register and covers at least as much as the caller's), so it bounds everything live
+static u32 live_registers(VM* vm) {
+    if (!vm->current || !vm->regs) return 0;
+    u32 regc = vm->current->fn == FRAME_ENTRY ? BASE_REGISTERS : vm->funcs[vm->current->fn]->as.bc.regc;
+    u32 top = vm->current->base + (regc > vm->regspan ? regc : vm->regspan);
+    return top < vm->regs->committed ? top : vm->regs->committed;
+}
+
+// live registers are roots, objects left above them by frames that already returned get nulled. only up to where
+// windows have reached since the last time, everything past that was cleared then and nothing's written it since
+static void visit_registers(VM* vm, GC* gc) {
+    Registers* regs = vm->regs;
+    if (!regs) return;
+    u32 top = live_registers(vm);
+    u32 dirty = regs->dirty < regs->committed ? regs->dirty : regs->committed;
+
+#if VM_NANBOX
+    TypedValue* B = regs->payloads;
+    TypedValue* W = regs->wide;
+    for (u32 r = 0; r < top; r++) {
+        if (nb_tag(B[r].u) == OBJ) nb_set_obj(B, W, r, OBJ, visit(gc, (ObjHeader*)nb_get_obj(B, W, r)));
+    }
+    for (u32 r = top; r < dirty; r++) {
+        if (nb_tag(B[r].u) == OBJ) B[r].u = 0;
+    }
+#else
+    visit_slots(gc, regs->payloads, regs->types, top);
+    for (u32 r = top; r < dirty; r++) {
+        if (regs->types[r] == OBJ) {
+            regs->types[r] = NUL;
+            regs->payloads[r].u = 0;
+        }
+    }
+#endif
+    regs->dirty = top;
+}
+
+static void visit_c_roots(GC* gc) {
+    for (size_t i = 0; i < gc->rootcount; i++) *gc->roots[i] = visit(gc, *gc->roots[i]);
+}
+
+static void visit_roots(VM* vm, GC* gc) {
+    visit_registers(vm, gc);
+    if (vm->globals) visit_slots(gc, vm->globals, vm->globaltypes, vm->globalcount);
+    if (vm->consts) visit_slots(gc, (TypedValue*)vm->consts, vm->consttypes, vm->constcount);
+    visit_c_roots(gc);
+}
+
+// visit every pointer an object holds
+static void trace(GC* gc, ObjHeader* obj) {
+    switch (obj_kind(obj)) {
+        case OBJ_ARRAY: {
+            ObjArray* arr = (ObjArray*)obj;
+            if (arr->elem == NUL) visit_slots(gc, arr->items, array_types(arr), arr->length);
+            break;
+        }
+
+        case OBJ_ROPE: {
+            ObjRope* rope = (ObjRope*)obj;
+            rope->left.obj = visit(gc, (ObjHeader*)rope->left.obj);
+            rope->right.obj = visit(gc, (ObjHeader*)rope->right.obj);
+            rope->flat = (ObjString*)visit(gc, (ObjHeader*)rope->flat);
+            break;
+        }
+
+        case OBJ_TABLE: {
+            ObjTable* t = (ObjTable*)obj;
+            t->slots = (ObjSlots*)visit(gc, (ObjHeader*)t->slots);
+            t->old = (ObjSlots*)visit(gc, (ObjHeader*)t->old);
+            break;
+        }
+
+        case OBJ_SLOTS: {
+            ObjSlots* s = (ObjSlots*)obj;
+            visit_slots(gc, slots_keys(s), slots_keytypes(s), s->cap);
+            visit_slots(gc, slots_vals(s), slots_valtypes(s), s->cap);
+            break;
+        }
+
+        // strings don't point at anything
+        default:
+            break;
+    }
+}
+
+bool gc_scavenge(VM* vm, GC* gc) {
+    // nothing young, and so nothing remembered either
+    if (!gc->nursery || gc->top == gc->nursery) return true;
+    GC_STATE state = gc->state;
+    gc->state = SCAVENGE;
+    visit_roots(vm, gc);
+
+    // old objects that had young ones stored into them. once scanned everything they point at is old
+    for (size_t i = 0; i < gc->remembered.count; i++) {
+        ObjHeader* obj = gc->remembered.items[i];
+        mark_clear(obj, GC_REMEMBERED);
+        trace(gc, obj);
+    }
+    gc->remembered.count = 0;
+
+    // and whatever got copied out can point back into the nursery too
+    while (gc->scan.count > 0) trace(gc, gc->scan.items[--gc->scan.count]);
+    gc->state = state;
+
+    if (gc->failed) {
+        vm->panic_code = PANIC_OOM;
+        return false;
+    }
+    gc->top = gc->nursery;
+    gc->minors++;
+    pace(gc);
+    return true;
+}
+
+bool gc_mark(VM* vm, GC* gc) {
+    // last cycle's black is white now, so nothing has to be whitened
+    gc->black = gc->black == MARK_BLACK ? MARK_BLACK_ALT : MARK_BLACK;
+    gc->state = MARK;
+    visit_roots(vm, gc);
+    gc->state = PROCESS;
+    gc->marking = true;
+    pace(gc);
+    return !gc->failed;
+}
+
+// blacken one gray object. a regrayed object can be on the stack twice, the second time there's nothing to do
+static void blacken(GC* gc, ObjHeader* obj) {
+    if (gc_get_color(obj) != MARK_GRAY) return;
+    gc_set_color(obj, gc->black);
+    trace(gc, obj);
+}
+
+bool gc_trace(VM* vm, GC* gc) {
+    (void)vm;
+    GC_STATE state = gc->state;
+    gc->state = TRACE;
+    while (gc->gray.count > 0) blacken(gc, gc->gray.items[--gc->gray.count]);
+    gc->state = state;
+    return !gc->failed;
+}
+
+// how many objects get blackened between looks at the clock
+#define STEP_CHUNK 64
+
+bool gc_step(VM* vm, GC* gc) {
+    if (!gc->marking) return true;
+    u64 start = now_us();
+
+    // no budget, or marking has fallen so far behind allocation that the old generation has doubled past the
+    // threshold: finish it in one go rather than let the heap keep growing
+    if (gc->step_us == 0 || gc->allocated / GC_GROWTH >= gc->threshold) {
+        if (!gc_trace(vm, gc)) return false;
+    } else {
+        // always gets a chunk done, however small the budget
+        do {
+            for (u32 n = 0; n < STEP_CHUNK && gc->gray.count > 0; n++) {
+                blacken(gc, gc->gray.items[--gc->gray.count]);
+            }
+
+            // young objects aren't marked, and the only way to some old ones can run through them. promoting
+            // them now (they come out gray) keeps that work out of gc_finish's pause
+            if (gc->gray.count == 0 && !gc_scavenge(vm, gc)) return false;
+        } while (gc->gray.count > 0 && now_us() - start < gc->step_us);
+        if (gc->failed) return false;
+    }
+
+    bool done = gc->gray.count == 0;
+    if (done && !gc_finish(vm, gc)) return false;
+
+    u64 pause = now_us() - start;
+    if (pause > gc->longest) gc->longest = pause;
+    gc->steps++;
+    pace(gc);
+    return true;
+}
+
+// the intern set doesn't keep anything alive, whatever's still white is about to be swept
+static void prune_interns(GC* gc, Interns* in) {
+    for (u32 i = 0; i < in->cap; i++) {
+        ObjString* str = in->items[i];
+        if (!str || str == INTERN_TOMB || !gc_is_white(gc, &str->header)) continue;
+        in->items[i] = INTERN_TOMB;
+        in->count--;
+    }
+}
+
+bool gc_finish(VM* vm, GC* gc) {
+    // young objects aren't marked, so the nursery gets emptied out first (anything promoted comes out gray)
+    if (!gc_scavenge(vm, gc)) return false;
+
+    // registers and C roots could have picked up anything since gc_mark. globals went through their barrier,
+    // and constants never change
+    gc->state = REMARK;
+    visit_registers(vm, gc);
+    visit_c_roots(gc);
+    if (gc->failed || !gc_trace(vm, gc)) return false;
+    prune_interns(gc, &vm->interns);
+    return gc_sweep(vm, gc);
+}
+
+// alive this cycle. anything else in a page (a free block, a dead object) is up for reuse
+static bool survives(const Sweeper* s, ObjHeader* obj) {
+    return obj->generation == GEN_OLD && (mark_load(obj) & 0x03) == s->black;
+}
+
+// walk one page, every block in order. its dead ones go back to the slab in one chain as soon as it's done (the
+// mutator can start reusing them straight away, nothing here looks at the page again). returns how many lived
+static u32 sweep_page(GC* gc, Sweeper* s, SlabPage* page) {
+    void* head = NULL;
+    void* tail = NULL;
+    u32 live = 0;
+
+    // backwards, so the chain comes out lowest address first. past used has never been handed out
+    for (u32 i = page->cap; i-- > 0;) {
+        ObjHeader* obj = (ObjHeader*)slab_block(page, i);
+        if (i < page->used) {
+            if (survives(s, obj)) {
+                live++;
+                s->live += obj->size;
+                continue;
+            }
+            if (obj->generation == GEN_OLD) {
+                s->freed += obj->size;
+                s->frees[page->cls]++;
+            }
+        }
+        obj->generation = GEN_FREE;
+        slab_next(obj) = head;
+        if (!tail) tail = obj;
+        head = obj;
+    }
+
+    page->used = page->cap;
+    page->live = live;
+    if (live && head) slab_give(&gc->slab, page->cls, head, tail);
+    return live;
+}
+
+// the sweep itself, on whichever thread. only reads survivors (their colors, their sizes), and only writes to
+// dead blocks, pages nobody else is looking at and its own list
+static void sweep(GC* gc, Sweeper* s) {
+    s->live = s->freed = 0;
+
+    for (u32 c = 0; c < SLAB_CLASSES; c++) {
+        SlabPage** link = &s->pages[c];
+        while (*link) {
+            SlabPage* page = *link;
+            if (sweep_page(gc, s, page)) {
+                link = &page->next;
+                continue;
+            }
+
+            // nothing alive in it, so it goes back whole
+            *link = page->next;
+            free(page);
+            s->dropped[c]++;
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < s->objc; i++) {
+        ObjHeader* obj = s->objs[i];
+        if (survives(s, obj)) {
+            s->live += obj->size;
+            s->objs[kept++] = obj;
+        } else {
+            s->freed += obj->size;
+            free(obj);
+        }
+    }
+    s->objc = kept;
+}
+
+#if VM_GC_THREAD
+static void* sweeper_main(void* arg) {
+    GC* gc = (GC*)arg;
+    Sweeper* s = gc->sweeper;
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        while (!s->queued && !s->quit) pthread_cond_wait(&s->wake, &s->lock);
+        if (s->quit) break;
+        s->queued = false;
+        pthread_mutex_unlock(&s->lock);
+
+        sweep(gc, s);
+
+        pthread_mutex_lock(&s->lock);
+        __atomic_store_n(&s->done, true, __ATOMIC_RELEASE);
+        pthread_cond_signal(&s->finished);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+#endif
+
+// made the first time there's something to sweep. if the thread can't be made, sweeps happen inline instead
+static Sweeper* sweeper_start(GC* gc) {
+    if (gc->sweeper) return gc->sweeper;
+    Sweeper* s = (Sweeper*)calloc(1, sizeof(Sweeper));
+    if (!s) return NULL;
+    gc->sweeper = s;
+#if VM_GC_THREAD
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wake, NULL);
+    pthread_cond_init(&s->finished, NULL);
+    s->running = pthread_create(&s->thread, NULL, sweeper_main, gc) == 0;
+#endif
+    return s;
+}
+
+static void sweeper_stop(GC* gc) {
+    Sweeper* s = gc->sweeper;
+    if (!s) return;
+#if VM_GC_THREAD
+    if (s->running) {
+        pthread_mutex_lock(&s->lock);
+        s->quit = true;
+        pthread_cond_signal(&s->wake);
+        pthread_mutex_unlock(&s->lock);
+        pthread_join(s->thread, NULL);
+    }
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->wake);
+    pthread_cond_destroy(&s->finished);
+#endif
+    free(s->objs);
+    free(s);
+    gc->sweeper = NULL;
+}
+
+bool gc_sweep(VM* vm, GC* gc) {
+    gc->state = SWEEP;
+    Sweeper* s = sweeper_start(gc);
+    if (!s) {
+        vm->panic_code = PANIC_OOM;
+        return false;
+    }
+
+    // the sweeper takes every page and the whole large object list, everything allocated from here on goes on
+    // fresh ones. allocated counts from zero again until the survivors come back (gc_sweep_collect)
+    slab_detach(&gc->slab, s->pages);
+    free(s->objs);
+    s->objs = gc->objs;
+    s->objc = gc->objc;
+    s->objcap = gc->objcap;
+    s->black = gc->black;
+    gc->objs = NULL;
+    gc->objc = gc->objcap = 0;
+    gc->allocated = 0;
+    gc->sweeping = true;
+
+#if VM_GC_THREAD
+    if (s->running) {
+        pthread_mutex_lock(&s->lock);
+        __atomic_store_n(&s->done, false, __ATOMIC_RELAXED);
+        s->queued = true;
+        pthread_cond_signal(&s->wake);
+        pthread_mutex_unlock(&s->lock);
+    } else
+#endif
+    {
+        sweep(gc, s);
+        gc_sweep_collect(gc, true);
+    }
+
+    gc->state = IDLE;
+    gc->marking = false;
+    gc->majors++;
+    pace(gc);
+    return true;
+}
+
+bool gc_sweep_collect(GC* gc, bool wait) {
+    if (!gc->sweeping) return true;
+    Sweeper* s = gc->sweeper;
+
+#if VM_GC_THREAD
+    if (s->running && !__atomic_load_n(&s->done, __ATOMIC_ACQUIRE)) {
+        if (!wait) return false;
+        pthread_mutex_lock(&s->lock);
+        while (!s->done) pthread_cond_wait(&s->finished, &s->lock);
+        pthread_mutex_unlock(&s->lock);
+    }
+#else
+    (void)wait;
+#endif
+
+    // pages go back behind the ones allocated from since, with what they freed and dropped counted
+    slab_attach(&gc->slab, s->pages);
+    for (u32 c = 0; c < SLAB_CLASSES; c++) {
+        gc->slab.stats[c].frees += s->frees[c];
+        gc->slab.stats[c].pages -= s->dropped[c];
+        s->frees[c] = 0;
+        s->dropped[c] = 0;
+    }
+
+    // the large survivors and whatever got allocated since go back on one list, the shorter one copied onto
+    // the other
+    if (s->objc > gc->objc) {
+        ObjHeader** objs = gc->objs;
+        size_t objc = gc->objc, objcap = gc->objcap;
+        gc->objs = s->objs;
+        gc->objc = s->objc;
+        gc->objcap = s->objcap;
+        s->objs = objs;
+        s->objc = objc;
+        s->objcap = objcap;
+    }
+    if (gc->objc + s->objc > gc->objcap) {
+        ObjHeader** grown = (ObjHeader**)realloc(gc->objs, (gc->objc + s->objc) * sizeof(ObjHeader*));
+        if (!grown) return false;
+        gc->objs = grown;
+        gc->objcap = gc->objc + s->objc;
+    }
+    if (s->objc) memcpy(gc->objs + gc->objc, s->objs, s->objc * sizeof(ObjHeader*));
+    gc->objc += s->objc;
+    s->objc = 0;
+
+    gc->allocated += s->live;
+    gc->freed += s->freed;
+    gc_adjust_threshold(gc, s->live);
+    gc->sweeping = false;
+    return true;
+}
+
+// kick off or continue a major collection. marking only ever starts on an empty nursery, so it never has to
+// look at young objects. the last sweep has to be back first, which only gets waited on once it's due
+static bool major(VM* vm, GC* gc) {
+    if (gc->sweeping && !gc_sweep_collect(gc, gc_at_threshold(gc))) return true;
+    bool ok = gc->marking ? gc_step(vm, gc) : !gc_at_threshold(gc) || (gc_mark(vm, gc) && gc_step(vm, gc));
+    if (!ok) {
+        gc->state = IDLE;
+        vm->panic_code = PANIC_OOM;
+    }
+    return ok;
+}
+
+bool gc_poll(VM* vm, GC* gc) {
+    if (!gc_scavenge(vm, gc)) return false;
+    return major(vm, gc);
+}
+
+ObjHeader* gc_alloc_slow(VM* vm, GC* gc, ObjKind kind, u32 size) {
+    // big ones go straight to the old generation, copying them out of the nursery would cost more than it saves
+    if (size > GC_LARGE) return gc_alloc_old(vm, gc, kind, size);
+
+    // first object ever gets the nursery made. after that we're here because it's full, or it's time for a step
+    if (!gc->nursery) {
+        gc->nursery = (u8*)malloc(GC_NURSERY);
+        if (!gc->nursery) {
+            vm->panic_code = PANIC_OOM;
+            return NULL;
+        }
+        gc->top = gc->nursery;
+        gc->ceiling = gc->nursery + GC_NURSERY;
+        pace(gc);
+    } else if (gc->marking && (size_t)(gc->ceiling - gc->top) >= size) {
+        if (!major(vm, gc)) return NULL;
+    } else if (!gc_poll(vm, gc)) {
+        return NULL;
+    }
+    return gc_alloc(vm, gc, kind, size);
+}
+
+// old objects count towards pacing a major collection too
+ObjHeader* gc_alloc_old(VM* vm, GC* gc, ObjKind kind, u32 size) {
+    size = (size + GC_ALIGN - 1) & ~(u32)(GC_ALIGN - 1);
+    if ((gc->marking || gc_at_threshold(gc)) && !(gc->marking ? major(vm, gc) : gc_poll(vm, gc))) return NULL;
+    ObjHeader* obj = old_alloc(gc, size);
+    if (!obj) {
+        vm->panic_code = PANIC_OOM;
+        return NULL;
+    }
+    *obj = (ObjHeader){ .info = &obj_builtins[kind], .size = size,
+                        .mark = gc->marking ? gc->black : MARK_WHITE, .generation = GEN_OLD };
+    return obj;
+}
+
+void gc_remember(GC* gc, ObjHeader* holder) {
+    mark_set(holder, GC_REMEMBERED);
+    if (!push(&gc->remembered, holder)) gc->failed = true;
+}
+
+void gc_regray(GC* gc, ObjHeader* holder) {
+    gc_set_color(holder, MARK_GRAY);
+    if (!push(&gc->gray, holder)) gc->failed = true;
+}
+
+void gc_shade(GC* gc, ObjHeader* obj) {
+    if (obj->generation != GEN_OLD || !gc_is_white(gc, obj)) return;
+    gc_set_color(obj, MARK_GRAY);
+    if (!push(&gc->gray, obj)) gc->failed = true;
+}
+
+bool gc_add_root(GC* gc, ObjHeader** slot) {
+    if (gc->rootcount == gc->rootcap) {
+        size_t cap = gc->rootcap ? gc->rootcap * 2 : 16;
+        ObjHeader*** grown = (ObjHeader***)realloc(gc->roots, cap * sizeof(ObjHeader**));
+        if (!grown) return false;
+        gc->roots = grown;
+        gc->rootcap = cap;
+    }
+    gc->roots[gc->rootcount++] = slot;
+    return true;
+}
+
+void gc_remove_root(GC* gc, ObjHeader** slot) {
+    // roots come and go in stack order, so search from the top
+    for (size_t i = gc->rootcount; i-- > 0;) {
+        if (gc->roots[i] != slot) continue;
+        memmove(&gc->roots[i], &gc->roots[i + 1], (gc->rootcount - i - 1) * sizeof(ObjHeader**));
+        gc->rootcount--;
+        return;
+    }
+}
+
+bool gc_at_threshold(GC* gc) {
+    return gc->allocated >= gc->threshold;
+}
+
+void gc_adjust_threshold(GC* gc, size_t live) {
+    gc->threshold = live * GC_GROWTH > GC_MIN_HEAP ? live * GC_GROWTH : GC_MIN_HEAP;
+}
+
+ObjArray* array_new(VM* vm, i64 length, u8 elem) {
+    u32 stride = array_stride(elem);
+    if (!stride) {
+        vm->panic_code = PANIC_TYPE_MISMATCH;
+        return NULL;
+    }
+    if (length < 0 || (u64)length > array_max(elem)) {
+        vm->panic_code = PANIC_INDEX;
+        return NULL;
+    }
+
+    size_t bytes = (size_t)length * stride;
+    ObjArray* arr = (ObjArray*)gc_alloc(vm, &vm->gc, OBJ_ARRAY, (u32)(sizeof(ObjArray) + bytes));
+    if (!arr) return NULL;
+    arr->length = (u32)length;
+    arr->elem = elem;
+    memset(arr->items, 0, bytes);
+    return arr;
+}
@@ -1,49 +1,128 @@
 /**
  * @file heap.h
  * @author Noah Mingolelli
- * @brief header used for heap and garbage collection. will doc later
- * uncertain if im even gonna use all of this, just some common things i need before actually implementing this.
- * the plan is deffo a lot longer than the impl
- * 
+ * @brief heap objects and the garbage collector (generational: a bump allocated nursery, a mark-sweep old gen)
+ * License: GPLv3
+ *
+ * every heap object starts with an ObjHeader and lives in one of two generations:
+ * - young: the nursery, one block allocated by bumping a pointer (gc_alloc's fast path is a compare and an add).
+ *   when it fills up a minor collection (gc_scavenge) copies whatever is still reachable into the old generation
+ *   and the whole block is reused from the bottom. most objects die young, so most of it never gets looked at
+ * - old: survivors of one minor collection (and anything too big to be worth copying, which is allocated old
+ *   straight away). collected by mark-sweep once it grows past its threshold. anything up to SLAB_MAX bytes lives
+ *   in a size class slab (slab.h) the sweep walks page by page, bigger objects get a malloc each and a slot in
+ *   the large object space
+ *
+ * roots are precise. registers are walked up to the top of the current frame's window and only slots tagged OBJ
+ * are followed (the tag array says exactly which payloads are pointers), then the globals and the constants.
+ * anything OBJ tagged above the window is dead and gets nulled, so a frame pushed over it later can't see it. that
+ * only goes as high as windows have reached since the last collection (Registers.dirty), one deep recursion
+ * doesn't make every collection after it walk the whole committed file.
+ *
+ * old objects that get a young object stored into them go in the remembered set (gc_barrier), which a minor
+ * collection treats as extra roots.
+ *
+ * the old generation is marked incrementally. gc_mark grays the roots and then the mutator keeps running, with
+ * gc_step blackening gray objects for at most step_us microseconds every GC_STEP_BYTES of allocation (the fast
+ * path's end is pulled in to make that happen, so it's still a compare and an add). stores keep the tri-color
+ * invariant (no black object points at a white one) by going through a barrier:
+ * - gc_barrier (array elements, anything else stored inside an object): a black holder goes back to gray
+ * - gc_barrier_global (STOREG): the stored object gets grayed, globals were scanned when marking started
+ * registers don't have a barrier, so once the gray stack runs dry gc_finish rescans them (and the gc_add_root
+ * slots) and drains whatever that found before sweeping. that pause is the size of the live window (plus however
+ * far windows have reached since the last collection, see Registers.dirty), not the heap.
+ * objects promoted while marking start gray, old objects allocated while marking start black.
+ *
+ * sweeping happens on a background thread (VM_GC_THREAD). gc_sweep hands it every slab page and the large object
+ * list, and the old generation starts over on fresh ones for whatever gets allocated meanwhile, so the mutator
+ * never waits on it unless the next major collection comes due first. it never writes to a survivor: black
+ * alternates between two values every cycle (gc->black), so last cycle's survivors are white again the moment the
+ * next mark starts. a page's dead blocks go back to the slab (slab_give, lock free) as soon as it's been walked,
+ * pages with nothing left alive and dead large objects get freed.
+ *
+ * collections only happen inside an allocation, so anything holding an object pointer in C across gc_alloc has
+ * to re-read it from its register (or register the slot with gc_add_root). objects never move once they're old.
  */
 #ifndef HEAP_H
 #define HEAP_H
 
 #include "typing.h"
+#include "slab.h"
 
 // I HAVE TWO OPTIONS FOR EXPOSING POINTERS TO OBJECTS ON THE HEAP.
 // VIRTUAL POINTERS - store pointers to a specific index in a list, do pointer arithmetic. could pointer pack (or cap @ 4b vals on the heap)
 // OR
 // RAW POINTERS - store pointers to the actual raw object in memory. then its just a reference, though i would want to add guards which could cost cycles.
-// choice is likely raw though i will add a light safety element
+// went with raw. an OBJ register's payload is the ObjHeader* itself
 
 // ALSO TWO OPTIONS FOR HEAP:
 // BUMP ALLOC, FREE GENERATIONALLY. allocate young objects that die often together (heap objects only used in a local scope, other shit). cons are i'm locked into generational frees
 // OR
-// FREELIST, GENERATIONAL AND OCCASIONAL DIRECT FREES BASED ON LIFETIME: (i could have an optional lifetime system for better gc handling, 
-// and objects can be freed at specific timings by the compiler), cons if i do compiler timings i would have to bake it into the bytecode (dont know how), allocs and frees would cost more than
-// a bump allocator (which is the cost for better handling)
-// choice is uncertain. free list might make it easier to make a lighter gc op using threading, though i have to figure out if i can ever avoid the pause
+// FREELIST, GENERATIONAL AND OCCASIONAL DIRECT FREES BASED ON LIFETIME
+// went with both: bump alloc for the young ones, and the old ones get freed individually by the sweep
 
-// can only be one of 3 colors: 
+// nursery size (bytes). objects bigger than an eighth of it skip it and get allocated old
+#ifndef GC_NURSERY
+#define GC_NURSERY ((size_t)1 << 20)
+#endif
+#define GC_LARGE (GC_NURSERY / 8)
+
+// old gen bytes before the first major collection, after that it's GC_GROWTH x whatever survived the last one
+#ifndef GC_MIN_HEAP
+#define GC_MIN_HEAP ((size_t)8 << 20)
+#endif
+#define GC_GROWTH 2
+
+// longest an incremental step gets to pause for (microseconds), 0 marks everything in one go
+#ifndef GC_STEP_US
+#define GC_STEP_US 500
+#endif
+
+// bytes allocated between steps while marking. has to be at least GC_LARGE so any young object fits a step
+#define GC_STEP_BYTES (GC_NURSERY / 4)
+
+// every object is rounded up to this, payloads inside are 8 byte aligned
+#define GC_ALIGN 8
+
+// sweep on a background thread (pthreads, gcc/clang atomics). -DVM_GC_THREAD=0 (make GC_THREAD=0) to sweep on
+// the vm's thread instead
+#ifndef VM_GC_THREAD
+  #if (defined(__unix__) || defined(__APPLE__)) && defined(__GNUC__)
+    #define VM_GC_THREAD 1
+  #else
+    #define VM_GC_THREAD 0
+  #endif
+#endif
+
+// can only be one of 3 colors:
 // - white = proven unreachable
 // - gray = proven reachable but pointers not scanned
 // - black = proven reachable and scanned
-#define MARK_WHITE 0
-#define MARK_GRAY  1
-#define MARK_BLACK 2
+// black is MARK_BLACK or MARK_BLACK_ALT depending on the cycle (gc->black), anything else not gray is white
+#define MARK_WHITE     0
+#define MARK_GRAY      1
+#define MARK_BLACK     2
+#define MARK_BLACK_ALT 3
+
+// the rest of the mark byte
+#define GC_FORWARDED  0x04  // copied out of the nursery, info holds the new address
+#define GC_REMEMBERED 0x08  // old object in the remembered set
+
+// ObjHeader.generation
+#define GEN_YOUNG 0
+#define GEN_OLD   1
+#define GEN_FREE  2   // a slab block nothing lives in (the sweep sets it, so the next walk knows)
 
 typedef enum {
     IDLE = 0, // standard gc state, nothing happening.
     MARK,     // mark directly accessible objects (not necessary to go thru heap)
     TRACE,    // starting from roots, follow their pointers to mark everything reachable. this could be one alloc, or a graph of multiple allocs.
     PREPARE,  // pause the world. pause execution with a flag or call to gc_prepare, and set everything up to sweep (may not stick w this)
-    SWEEP,    // walk all heap objects, and free any unmarked objects. this will be done by checking a marked bit
+    SWEEP,    // walk all old objects and free the unmarked ones (on the sweeper thread, see gc_sweep)
     RESUME,   // an "in between" between sweep and idle, allows the program to catch up and the gc to reset its state
-
-    // may add incremental/tri color gc
-    // PROCESS, (process gray objects)
-    // REMARK, (for mutations during mark)
+    SCAVENGE, // minor collection, copying the nursery's survivors out
+    PROCESS,  // incremental marking, gray objects get processed a step at a time between instructions
+    REMARK,   // rescanning the registers once the gray stack runs out (they don't have a barrier)
 
     // look into weak refs. leave options open
 } GC_STATE;
@@ -83,126 +162,348 @@ typedef struct MethodInfo {
     u16 flags;              // 4 bytes - static, virtual, etc.
 } MethodInfo;               // = 24 bytes (div by 8 valid)
 
+// builtin type ids (ObjInfo.type), the collector switches on these to find an object's pointers
+typedef enum {
+    OBJ_NONE = 0,
+    OBJ_ARRAY,
+    OBJ_STRING,
+    OBJ_ROPE,
+    OBJ_TABLE,
+    OBJ_SLOTS,      // a table's storage, never in a register
+    OBJ_KIND_COUNT
+} ObjKind;
+
+// one shared ObjInfo per builtin, indexed by ObjKind
+extern ObjInfo obj_builtins[OBJ_KIND_COUNT];
+
 // per-instance header (one per object)
-// stack objects die with frames, anything on the heap will be marked with a header (TODO figure out how to point to the object without using 24 fucking bytes)
 // heap has been hellish for me
 typedef struct ObjHeader {
-    ObjInfo *info;          // 8 bytes - points to shared type metadata
-    u32 size;               // 4 bytes - allocation size
+    ObjInfo *info;          // 8 bytes - points to shared type metadata (the new copy while GC_FORWARDED)
+    u32 size;               // 4 bytes - allocation size (header included, GC_ALIGN rounded)
     u8  mark;               // 1 byte  - gc mark bits
     u8  tid;                // 1 byte  - thread id
     u8  state;              // 1 byte  - lock state
     u8  generation;         // 1 byte  - gc generation
 } ObjHeader;                // = 16 bytes (one per INSTANCE, div by 8)
 
+// a growable stack of objects (gray objects, the remembered set)
 typedef struct {
-    // current alloc size
-    size_t allocated;
+    ObjHeader** items;
+    size_t count;
+    size_t cap;
+} ObjStack;
+
+// the background sweeper (heap.c)
+typedef struct Sweeper Sweeper;
+
+typedef struct {
+    // nursery, bumped from top to end. NULL until the first allocation. end is ceiling except while marking,
+    // when it's pulled in so the slow path (and gc_step) comes around every GC_STEP_BYTES
+    u8* nursery;
+    u8* top;
+    u8* end;
+    u8* ceiling;
 
-    // all objects currently managed by the GC
-    ObjHeader *objs;
+    // old generation: objects up to SLAB_MAX in the slab, anything bigger in the large object space (objs, one
+    // malloc each). allocated is their total size
+    Slab slab;
+    ObjHeader** objs;
     size_t objc;
+    size_t objcap;
+    size_t allocated;
+    size_t threshold;   // major collection once allocated passes this
 
-    // color management
-    ObjHeader **gray;
-    size_t graycount;
-    size_t graycap;
+    // color management, old objects pointing into the nursery, and promoted objects a minor collection
+    // still has to scan
+    ObjStack gray;
+    ObjStack remembered;
+    ObjStack scan;
     GC_STATE state;
+    bool marking;       // a major collection is in progress (scavenges can still run in the middle of one)
+    bool sweeping;      // the sweeper has the last cycle's objects, and hasn't given them back yet
+    u8 black;           // what black is this cycle
+    bool failed;        // a collection ran out of memory part way
+    u32 step_us;        // pause budget per incremental step, GC_STEP_US unless changed after gc_init
+
+    Sweeper* sweeper;
 
-    // maybe a VM ref idk yet it's 2 am and i'm tired
-    // VM *vm;
+    // slots C code holds objects in (gc_add_root)
+    ObjHeader*** roots;
+    size_t rootcount;
+    size_t rootcap;
+
+    // counters
+    u32 minors;
+    u32 majors;
+    u64 promoted;       // bytes copied out of the nursery
+    u64 freed;          // bytes the sweep gave back
+    u64 steps;          // incremental steps taken
+    u64 longest;        // longest step (gc_finish included) in microseconds
 } GC;
 
 // builtin object types (god i understand why rust has 16 string types now. C ownership interoperability hard)
+// strings (str.h) come three ways: up to 7 bytes right in the OBJ payload (OBJ_INLINE set, never a pointer),
+// flat, or a rope that gets flattened the first time something needs its bytes in one piece
+#define OBJ_INLINE 1
+
+// an OBJ payload that's a string in itself, not a pointer (objects are GC_ALIGN aligned, the low bit's free)
+static inline bool obj_inline(TypedValue val) {
+    return val.u & OBJ_INLINE;
+}
+
 typedef struct {
     ObjHeader header;       // 16 bytes
     size_t length;          // 8 byte char count
-    char data[];            // string OWNS the data (MIGHT MAKE BORROWED STRINGS TOO CIRCA RUST)
+    u64 hash;               // 8 bytes - 0 until something hashes it (see str_hash)
+    char data[];            // string OWNS the data (MIGHT MAKE BORROWED STRINGS TOO CIRCA RUST). nul terminated
 } ObjString;
 
+// left + right, not copied until it's flattened. length and hash sit where a flat string's do
+typedef struct {
+    ObjHeader header;       // 16 bytes
+    size_t length;          // 8 bytes
+    u64 hash;               // 8 bytes
+    TypedValue left;        // 8 bytes - both halves are strings (inline or not), dropped once it's flat
+    TypedValue right;       // 8 bytes
+    ObjString* flat;        // 8 bytes - the whole thing in one piece, NULL until something asked for it
+} ObjRope;
+
+// the vm's intern set (str.h), open addressing by hash. it's weak: the collector drops whatever it's about to
+// sweep (interned strings are always old, so they never move)
+#define INTERN_TOMB ((ObjString*)(uintptr_t)1)
+
+typedef struct {
+    ObjString** items;      // NULL, INTERN_TOMB or a string
+    u32 cap;                // a power of two (0 until the first string)
+    u32 count;              // strings
+    u32 used;               // strings and tombstones
+} Interns;
+
+// fixed length array. elem says how the elements are stored:
+// - I64, U64, DOUBLE: packed 8 byte values, FLOAT: packed 4 byte ones, BOOL: a byte each (0 or 1)
+// - NUL: tagged, anything goes. split like the register file: payloads, then a tag per element right after
+// typed arrays hold no pointers (the collector never looks inside them) and only take their own type
 typedef struct {
     ObjHeader header;       // 16 bytes
-    size_t length;          // 8 bytes - item count
-    size_t capacity;        // 8 bytes - allocated capacity
-    void *data[];           // flexible array member
+    u32 length;             // 4 bytes - item count
+    u8  elem;               // 1 byte  - element type, NUL for tagged
+    u8  pad[3];
+    TypedValue items[];     // payloads, packed or tagged (tags follow, see array_types)
 } ObjArray;
 
-typedef struct ObjTable ObjTable;  // write a hashtable impl for this
+// a table's slots (see table.h). one block, split like the register file: key payloads, value payloads, then a
+// control byte, key tag and value tag per slot. only full slots have non NUL tags
+typedef struct {
+    ObjHeader header;       // 16 bytes
+    u32 cap;                // 4 bytes - slot count, a power of two
+    u32 used;               // 4 bytes - full or deleted slots (empty ones are what end a probe)
+    u32 live;               // 4 bytes - full slots
+    u32 pad;
+    TypedValue data[];      // see slots_keys and friends
+} ObjSlots;
+
+// hash table (table.h). the slots get swapped out when it resizes, the table itself never moves (for that)
+typedef struct ObjTable {
+    ObjHeader header;       // 16 bytes
+    ObjSlots* slots;        // 8 bytes - where new keys go, NULL until the first one
+    ObjSlots* old;          // 8 bytes - the slots being moved out of while it resizes, NULL otherwise
+    u32 next;               // 4 bytes - old's next group to move
+    u32 stride;             // 4 bytes - groups moved per SETELEM
+} ObjTable;
+
+static inline TypedValue* slots_keys(ObjSlots* s)  { return s->data; }
+static inline TypedValue* slots_vals(ObjSlots* s)  { return s->data + s->cap; }
+static inline u8* slots_ctrl(ObjSlots* s)          { return (u8*)(s->data + 2 * (size_t)s->cap); }
+static inline u8* slots_keytypes(ObjSlots* s)      { return slots_ctrl(s) + s->cap; }
+static inline u8* slots_valtypes(ObjSlots* s)      { return slots_ctrl(s) + 2 * (size_t)s->cap; }
+
+// bytes per element (the tag included for tagged arrays), 0 for a type arrays can't hold
+static inline u32 array_stride(u8 elem) {
+    switch (elem) {
+        case NUL:    return sizeof(TypedValue) + 1;
+        case BOOL:   return 1;
+        case FLOAT:  return sizeof(float);
+        case I64: case U64: case DOUBLE: return sizeof(TypedValue);
+        default:     return 0;
+    }
+}
+
+// longest array of elem that still fits an ObjHeader's u32 size
+static inline u64 array_max(u8 elem) {
+    return (UINT32_MAX - sizeof(ObjArray) - GC_ALIGN) / array_stride(elem);
+}
+
+// tags of a tagged array's elements
+static inline u8* array_types(ObjArray* arr) {
+    return (u8*)(arr->items + arr->length);
+}
 
 /**
- * runs at program startup to initialize the gc
+ * allocate an array of length elements, NUL (tagged) or zero (typed)
+ * @param elem element type (see ObjArray), anything else is a type mismatch
+ * @return the array, or NULL with vm->panic_code set (a bad length or type, out of memory)
+ */
+ObjArray* array_new(VM* vm, i64 length, u8 elem);
+
+// object kind of a live (not forwarded) object
+static inline ObjKind obj_kind(const ObjHeader* obj) {
+    return (ObjKind)obj->info->type;
+}
+
+/**
+ * runs at vm init. nothing gets allocated until the first object does
  * @param vm the instance of the vm to check
  * @param gc the gc to check it with
  */
 bool gc_init(VM *vm, GC* gc);
 
 /**
- * runs at program shutdown to stop and free the gc
+ * runs at program shutdown to stop and free the gc (every object, both generations)
  * @param vm the instance of the vm to check
  * @param gc the gc to check it with
  */
 bool gc_free(VM *vm, GC* gc);
 
 /**
- * poll for a potential sweep by checking the allocation counter, marked objects, and then if necessary sweep
- * this will be light on the hot path but the actual sweep will probably be a little extensive
- * trying to decide on stop the world or concurrent
+ * run whatever collection is due: a minor one (the nursery is full), then start marking if that pushed the old
+ * generation past its threshold (or take a step if it's already going). gc_alloc calls this on its slow path,
+ * never mid instruction
  * @param vm the instance of the vm to check
  * @param gc the gc to check it with
+ * @return false if a collection ran out of memory (vm->panic_code is set)
  */
 bool gc_poll(VM *vm, GC* gc);
 
 /**
- * mark only the roots (lighter, and will be done often) i like the tri color model, where a lot of objects 
- * sit in gray space and then are sifted back into white/black so that may be what is used here.
- * tri color means roots are marked and potential grays are identified, and then the actual trace will be a sorting process. 
- * then when prepare is called, either the world is stopped or a thread is spawned
+ * minor collection. copies every nursery object reachable from the roots and the remembered set into the old
+ * generation (forwarding pointers left behind so each one is copied once), then resets the nursery
+ * @param vm the instance of the vm to check
+ * @param gc the gc to check it with
+ */
+bool gc_scavenge(VM *vm, GC* gc);
+
+/**
+ * start a major collection: mark the roots gray (registers in use, globals, constants, gc_add_root slots).
+ * only runs on an empty nursery
  * @param vm the instance of the vm to check
  * @param gc the gc to check it with
  */
 bool gc_mark(VM *vm, GC* gc);
 
 /**
- * do a full trace. on every root marked, go through and see what instances can be marked for collection
- * this will potentially contain a black/white/gray sort
+ * one incremental step: process gray objects until the gray stack is empty or step_us is up. runs gc_finish
+ * once there's nothing gray left
+ * @param vm the instance of the vm to check
+ * @param gc the gc to check it with
+ */
+bool gc_step(VM *vm, GC* gc);
+
+/**
+ * end a major collection: empty the nursery, rescan the registers and C roots, trace what that found, sweep
+ * @param vm the instance of the vm to check
+ * @param gc the gc to check it with
+ */
+bool gc_finish(VM *vm, GC* gc);
+
+/**
+ * drain the gray stack: blacken each object and gray whatever white objects it points to
  * @param vm the instance of the vm to check
  * @param gc the gc to check it with
  */
 bool gc_trace(VM *vm, GC* gc);
 
 /**
- * sweep every item marked for collection
+ * hand every old object to the sweeper, which frees the ones still white after a trace. returns straight away
+ * (unless there's no thread to hand them to)
  * @param vm the instance of the vm to check
  * @param gc the gc to check it with
  */
 bool gc_sweep(VM *vm, GC* gc);
 
 /**
- * allocate a header to the gc, used for tracking an object 
+ * take the survivors back from the sweeper once it's done and set the next threshold from them
+ * @param gc the gc to check it with
+ * @param wait block until it's done instead of only checking
+ * @return false if it's still going
+ */
+bool gc_sweep_collect(GC* gc, bool wait);
+
+// slow path of gc_alloc: collect (or set the nursery up), then allocate young or old
+ObjHeader* gc_alloc_slow(VM *vm, GC* gc, ObjKind kind, u32 size);
+
+/**
+ * allocate an object of kind with size bytes (header included). only the header is initialized
  * @param vm the instance of the vm to check
  * @param gc the gc to check it with
- * @return true if successfully allocated, false if not (error)
- * TODO: decide on how to pack all this into a 64 bit val
+ * @return the object, or NULL with vm->panic_code set
+ */
+static inline ObjHeader* gc_alloc(VM *vm, GC* gc, ObjKind kind, u32 size) {
+    size = (size + GC_ALIGN - 1) & ~(u32)(GC_ALIGN - 1);
+    if (LIKELYTRUE(size <= GC_LARGE && (size_t)(gc->end - gc->top) >= size)) {
+        ObjHeader* obj = (ObjHeader*)gc->top;
+        gc->top += size;
+        *obj = (ObjHeader){ .info = &obj_builtins[kind], .size = size, .generation = GEN_YOUNG };
+        return obj;
+    }
+    return gc_alloc_slow(vm, gc, kind, size);
+}
+
+/**
+ * allocate an object of kind straight into the old generation, where it'll never move (starts black while
+ * marking, same as a large one). only the header is initialized
+ * @return the object, or NULL with vm->panic_code set
  */
-bool gc_alloc(VM *vm, GC* gc);
+ObjHeader* gc_alloc_old(VM *vm, GC* gc, ObjKind kind, u32 size);
 
-// assorted root shit that i CBA to doc rn
-void gc_add_root(GC *gc, ObjHeader *obj);
-void gc_remove_root(GC *gc, ObjHeader *obj);
+// remember an old object that just got a young one stored into it (see gc_barrier)
+void gc_remember(GC* gc, ObjHeader* holder);
+
+// gray a black object again, something white got stored into it while marking (see gc_barrier)
+void gc_regray(GC* gc, ObjHeader* holder);
+
+// gray a white old object while marking (see gc_barrier_global)
+void gc_shade(GC* gc, ObjHeader* obj);
+
+// write barrier for storing (tag, val) into holder. old -> young stores get remembered, anything stored into
+// a black object while marking grays it again (a whole array rescanned beats graying every element stored)
+static inline void gc_barrier(GC* gc, ObjHeader* holder, u8 tag, TypedValue val) {
+    if (tag != OBJ || !val.obj || obj_inline(val) || holder->generation != GEN_OLD) return;
+    if (((ObjHeader*)val.obj)->generation == GEN_YOUNG) {
+        if (!(holder->mark & GC_REMEMBERED)) gc_remember(gc, holder);
+    } else if (gc->marking && (holder->mark & 0x03) == gc->black) {
+        gc_regray(gc, holder);
+    }
+}
+
+// write barrier for storing (tag, val) into a global. globals are always roots, so only marking cares
+static inline void gc_barrier_global(GC* gc, u8 tag, TypedValue val) {
+    if (tag == OBJ && gc->marking && val.obj && !obj_inline(val)) gc_shade(gc, (ObjHeader*)val.obj);
+}
+
+// slots C code keeps objects in across allocations. the collector reads (and updates) *slot
+bool gc_add_root(GC *gc, ObjHeader **slot);
+void gc_remove_root(GC *gc, ObjHeader **slot);
 
 // and sweep threshold too (TODO look into potentially capping, tho may not cuz execution stalls...)
 bool gc_at_threshold(GC *gc);
-void gc_adjust_threshold(GC *gc);
+void gc_adjust_threshold(GC *gc, size_t live);
 
 // gonna throw these inside GC but this is color management
-// gets the bottom 2 bits to check 0-3 mark (0 means white, 1 means gray, 2 means black, 3 means huh)
+// gets the bottom 2 bits to check 0-3 mark (0 means white, 1 means gray, 2 or 3 means black depending on the cycle)
 static inline u8 gc_get_color(ObjHeader *obj) {
     return obj->mark & 0x03;
 }
 
-// sets the mark provided 0-2 (3 is just gonna be unused idk what it'd be for)
+// sets the mark provided 0-3
 static inline void gc_set_color(ObjHeader *obj, u8 color) {
     obj->mark = (obj->mark & 0xFC) | color; // assuming color already masked
 }
 
-#endif
\ No newline at end of file
+// white this cycle: never marked, or last cycle's black
+static inline bool gc_is_white(const GC* gc, ObjHeader *obj) {
+    u8 color = gc_get_color(obj);
+    return color != MARK_GRAY && color != gc->black;
+}
+
+#endif
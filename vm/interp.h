@@ -0,0 +1,604 @@
+/**
+ * @file interp.h
+ * @author Noah Mingolelli
+ * @brief the body of the run loop. NOT a normal header, there's deliberately no include guard
+ * License: GPLv3
+ *
+ * vm.c includes this twice to stamp out two copies of the same loop:
+ * - VM_CHECKED 1: every runtime type requirement is enforced (anything that didn't pass the verifier)
+ * - VM_CHECKED 0: type requirements are compiled out, only for programs vm_verify proved
+ *
+ * define RUN_LOOP (the function name) and VM_CHECKED before including. the dispatch macros
+ * (CASE/NEXT/DEFAULT/LABEL/...), SYNC_FRAME and the NATIVE_ENTER/NATIVE_CALLED hand offs are defined in vm.c.
+ */
+
+/**
+ * execute from vm->ip with the entry frame already pushed
+ * @param vm the `VM` to run
+ */
+static bool RUN_LOOP(VM* vm) {
+#if THREADED_DISPATCH
+    // one label per implemented opcode, anything unlisted lands on the invalid opcode handler.
+    // ranged initializers are gnu only, same as labels as values so it lives behind the same flag
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Woverride-init"
+    static const void* const labels[256] = {
+        [0 ... 255] = &&op_DEFAULT,
+        LABEL(HALT), LABEL(PANIC), LABEL(TRAP),
+        LABEL(JMP), LABEL(JMPIF), LABEL(JMPIFZ),
+        LABEL(COPY), LABEL(MOVE), LABEL(LOADI), LABEL(LOADC), LABEL(LOADG), LABEL(STOREG),
+        LABEL(CALL), LABEL(TAILCALL), LABEL(RET),
+        LABEL(I2D), LABEL(I2F), LABEL(D2I), LABEL(F2I), LABEL(I2U),
+        LABEL(U2I), LABEL(U2D), LABEL(U2F), LABEL(D2U), LABEL(F2U),
+        LABEL(ADD), LABEL(SUB), LABEL(MUL), LABEL(DIV), LABEL(MOD),
+        LABEL(AND), LABEL(OR), LABEL(XOR), LABEL(SHL), LABEL(SHR),
+        LABEL(ADD_U), LABEL(SUB_U), LABEL(MUL_U), LABEL(DIV_U), LABEL(MOD_U),
+        LABEL(AND_U), LABEL(OR_U), LABEL(XOR_U), LABEL(SHL_U), LABEL(SHR_U),
+        LABEL(EQ), LABEL(NEQ), LABEL(GT), LABEL(GE), LABEL(LT), LABEL(LE),
+        LABEL(EQ_U), LABEL(NEQ_U), LABEL(GT_U), LABEL(GE_U), LABEL(LT_U), LABEL(LE_U),
+        LABEL(ADD_F), LABEL(SUB_F), LABEL(MUL_F), LABEL(DIV_F),
+        LABEL(EQ_F), LABEL(NEQ_F), LABEL(GT_F), LABEL(GE_F), LABEL(LT_F), LABEL(LE_F),
+        LABEL(ADD_D), LABEL(SUB_D), LABEL(MUL_D), LABEL(DIV_D),
+        LABEL(EQ_D), LABEL(NEQ_D), LABEL(GT_D), LABEL(GE_D), LABEL(LT_D), LABEL(LE_D),
+        LABEL(NEG), LABEL(NEG_U), LABEL(NEG_F), LABEL(NEG_D), LABEL(BNOT), LABEL(BNOT_U),
+        LABEL(LNOT),
+        LABEL(JEQ), LABEL(JNEQ), LABEL(JGT), LABEL(JGE), LABEL(JLT), LABEL(JLE),
+        LABEL(JEQ_U), LABEL(JNEQ_U), LABEL(JGT_U), LABEL(JGE_U), LABEL(JLT_U), LABEL(JLE_U),
+        LABEL(JEQ_D), LABEL(JNEQ_D), LABEL(JGT_D), LABEL(JGE_D), LABEL(JLT_D), LABEL(JLE_D),
+        LABEL(ADD_KI), LABEL(SUB_KI), LABEL(ADD_KD), LABEL(SUB_KD),
+        LABEL(ADD_N), LABEL(SUB_N), LABEL(MUL_N), LABEL(DIV_N), LABEL(MOD_N), LABEL(NEG_N),
+        LABEL(EQ_N), LABEL(NEQ_N), LABEL(GT_N), LABEL(GE_N), LABEL(LT_N), LABEL(LE_N),
+        LABEL(ADDI), LABEL(SUBI), LABEL(MULI), LABEL(SHLI), LABEL(SHRI),
+        LABEL(EQI), LABEL(NEQI), LABEL(GTI), LABEL(GEI), LABEL(LTI), LABEL(LEI),
+        LABEL(WIDE),
+        LABEL(FORPREP), LABEL(FORLOOP), LABEL(FORPREP_D), LABEL(FORLOOP_D),
+        LABEL(JMPTABLE),
+        LABEL(NEWARR), LABEL(ARRGET), LABEL(ARRSET), LABEL(ARRLEN),
+        LABEL(ARRFILL), LABEL(ARRCOPY), LABEL(ARRSUM), LABEL(ARRADD),
+        LABEL(NEWTABLE), LABEL(GETELEM), LABEL(SETELEM),
+        LABEL(CONCAT), LABEL(STRLEN),
+        LABEL(ADD_QI), LABEL(ADD_QU), LABEL(ADD_QF), LABEL(ADD_QD),
+        LABEL(SUB_QI), LABEL(SUB_QU), LABEL(SUB_QF), LABEL(SUB_QD),
+        LABEL(MUL_QI), LABEL(MUL_QU), LABEL(MUL_QF), LABEL(MUL_QD),
+        LABEL(DIV_QI), LABEL(DIV_QU), LABEL(DIV_QF), LABEL(DIV_QD),
+        LABEL(MOD_QI), LABEL(MOD_QU),
+        LABEL(NEG_QI), LABEL(NEG_QU), LABEL(NEG_QF), LABEL(NEG_QD),
+        LABEL(EQ_QI), LABEL(EQ_QU), LABEL(EQ_QF), LABEL(EQ_QD),
+        LABEL(NEQ_QI), LABEL(NEQ_QU), LABEL(NEQ_QF), LABEL(NEQ_QD),
+        LABEL(GT_QI), LABEL(GT_QU), LABEL(GT_QF), LABEL(GT_QD),
+        LABEL(GE_QI), LABEL(GE_QU), LABEL(GE_QF), LABEL(GE_QD),
+        LABEL(LT_QI), LABEL(LT_QU), LABEL(LT_QF), LABEL(LT_QD),
+        LABEL(LE_QI), LABEL(LE_QU), LABEL(LE_QF), LABEL(LE_QD),
+    };
+    #pragma GCC diagnostic pop
+#endif
+
+    // hot state lives in locals: the decoded stream, where we are in it, and the current register window
+    Inst* const code = vm->code;
+    Inst* pc = code + vm->ip;
+    const Inst* in;
+    TypedValue* R;
+#if VM_NANBOX
+    TypedValue* W;
+#else
+    u8* T;
+#endif
+    SYNC_FRAME();
+
+    DISPATCH_BEGIN
+            // normal halt returns with no issues
+            CASE(HALT)
+                return true;
+
+            // panic on failure, panic returns a code from 0-256 with op_a
+            CASE(PANIC)
+                vm->panic_code = in->a;
+                return false;
+
+            // load time errors that only count once they're reached (bad jumps, bad indices, running off the end)
+            CASE(TRAP)
+                vm->panic_code = in->a;
+                return false;
+
+            // jump (target was resolved at load)
+            CASE(JMP)
+                pc = code + in->x.target;
+                NEXT;
+
+            // index the table (resolved at load), out of range lands on the fallthrough at the end of it
+            CASE(JMPTABLE) {
+                if (!CHECK_TYPE(RTAG(in->a), I64)) return false;
+                const JumpTable* jt = in->x.jt;
+                u64 i = (u64)RGET(in->a, i);
+                pc = code + jt->targets[i < jt->count ? i : jt->count];
+                NEXT;
+            }
+
+            // just check if val isnt zero or false
+            CASE(JMPIF)
+                if (!value_falsy(RTAG(in->a), RLOAD(in->a))) pc = code + in->x.target;
+                NEXT;
+
+            CASE(JMPIFZ)
+                if (value_falsy(RTAG(in->a), RLOAD(in->a))) pc = code + in->x.target;
+                NEXT;
+
+            // copy WITHOUT nulling
+            CASE(COPY)
+                RCOPY(in->a, in->b);
+                NEXT;
+
+            // copy AND null source
+            CASE(MOVE)
+                RCOPY(in->a, in->b);
+                RSET(in->b, NUL, u, 0);
+                NEXT;
+
+            // load an immediate to a register (16 bit, already sign extended)
+            CASE(LOADI)
+                RSET(in->a, I64, i, in->x.imm);
+                NEXT;
+
+            // load a constant from the CONSTANT pool (slot resolved at load)
+            CASE(LOADC)
+                RSTORE(in->a, in->aux, *in->x.k);
+                NEXT;
+
+            // load a global from the pool
+            CASE(LOADG)
+                RSTORE(in->a, vm->globaltypes[in->x.slot], vm->globals[in->x.slot]);
+                NEXT;
+
+            // store a global to the pool (copy with this ugly shite). objects go through the marking barrier
+            CASE(STOREG)
+                gc_barrier_global(&vm->gc, RTAG(in->a), RLOAD(in->a));
+                vm->globaltypes[in->x.slot] = RTAG(in->a);
+                vm->globals[in->x.slot] = RLOAD(in->a);
+                NEXT;
+
+            // call a function: CALL func_reg argc dest
+            CASE(CALL) {
+                CallCache* ic = in->x.ic;
+                u32 base = vm->current->base + in->a + 1;
+
+                // vm_call (and the cached path) want the return address in vm->ip
+                vm->ip = (u32)(pc - code);
+
+                // same function as last time at this site: bytecode, argc already matched, go straight in
+                if (LIKELYTRUE(RTAG(in->a) == CALLABLE && RGET(in->a, fn) == ic->fn && ic->fn)) {
+                    STAT(vm->stats.ic_hits++);
+                    if (!call_cached(vm, ic, base, in->c)) {
+                        if (vm->panic_code == 0) vm->panic_code = PANIC_CALL_FAILED;
+                        return false;
+                    }
+                } else {
+                    // yoink from register
+                    if (RTAG(in->a) != CALLABLE) {
+                        vm->panic_code = PANIC_INVALID_CALLABLE;
+                        return false;
+                    }
+
+                    // extract pointer
+                    Func* fn = RGET(in->a, fn);
+                    if (!fn) {
+                        vm->panic_code = PANIC_INVALID_CALLABLE;
+                        return false;
+                    }
+
+                    // pull args and call, then remember who we called
+                    STAT(vm->stats.ic_misses++);
+                    if (!vm_call(vm, fn, base, in->b, in->c)) {
+                        if (vm->panic_code == 0) vm->panic_code = PANIC_CALL_FAILED;
+                        return false;
+                    }
+                    cache_callee(vm, ic, fn);
+                }
+
+                pc = code + vm->ip;
+                SYNC_FRAME();
+                NATIVE_CALLED();
+                NEXT;
+            }
+
+            // tail call: TAILCALL func_reg argc. the callee takes over this frame (see vm_tailcall)
+            CASE(TAILCALL) {
+                CallCache* ic = in->x.ic;
+                u32 base = vm->current->base + in->a + 1;
+
+                if (LIKELYTRUE(RTAG(in->a) == CALLABLE && RGET(in->a, fn) == ic->fn && ic->fn)) {
+                    STAT(vm->stats.ic_hits++);
+                    if (!tailcall_cached(vm, ic, base, in->b)) {
+                        if (vm->panic_code == 0) vm->panic_code = PANIC_CALL_FAILED;
+                        return false;
+                    }
+                } else {
+                    if (RTAG(in->a) != CALLABLE || !RGET(in->a, fn)) {
+                        vm->panic_code = PANIC_INVALID_CALLABLE;
+                        return false;
+                    }
+
+                    Func* fn = RGET(in->a, fn);
+                    STAT(vm->stats.ic_misses++);
+                    if (!vm_tailcall(vm, fn, base, in->b)) {
+                        if (vm->panic_code == 0) vm->panic_code = PANIC_CALL_FAILED;
+                        return false;
+                    }
+                    cache_callee(vm, ic, fn);
+
+                    // a native tail call out of the entry frame ends the program, same as RET would
+                    if (vm->framecount == 0) return true;
+                }
+
+                pc = code + vm->ip;
+                SYNC_FRAME();
+                NATIVE_CALLED();
+                NEXT;
+            }
+
+            // return from function: RET register
+            CASE(RET) {
+                // get return val then pop
+                u8 type = RTAG(in->a);
+                TypedValue returned = RLOAD(in->a);
+
+                // if pop somehow failed GET OUT.
+                Frame popped;
+                if (!pop_frame(vm, &popped)) return false;
+
+                // jump ip back and restore previous state (pop already made the caller current)
+                if (vm->framecount == 0) return true;
+                pc = code + popped.jump;
+                SYNC_FRAME();
+
+                // store return value in caller spec
+                RSTORE(popped.reg, type, returned);
+                NATIVE_ENTER();
+                NEXT;
+            }
+
+            // cast helpers
+            CASE(I2D) CAST_TYPED(I64, i, DOUBLE, d, double); NEXT;
+            CASE(I2F) CAST_TYPED(I64, i, FLOAT,  f, float);  NEXT;
+            CASE(D2I) CAST_TYPED(DOUBLE, d, I64, i, i64);    NEXT;
+            CASE(F2I) CAST_TYPED(FLOAT,  f, I64, i, i64);    NEXT;
+            CASE(I2U) CAST_TYPED(I64, i, U64, u, u64);       NEXT;
+            CASE(U2I) CAST_TYPED(U64, u, I64, i, i64);       NEXT;
+            CASE(U2D) CAST_TYPED(U64, u, DOUBLE, d, double); NEXT;
+            CASE(U2F) CAST_TYPED(U64, u, FLOAT,  f, float);  NEXT;
+            CASE(D2U) CAST_TYPED(DOUBLE, d, U64, u, u64);    NEXT;
+            CASE(F2U) CAST_TYPED(FLOAT,  f, U64, u, u64);    NEXT;
+
+            // all operators muahahaha (i think) 
+            // binary ops, arithmetic and bitwise (default to signed 64-bit)
+            CASE(ADD)   BINOP_I64(+);  NEXT;
+            CASE(SUB)   BINOP_I64(-);  NEXT;
+            CASE(MUL)   BINOP_I64(*);  NEXT;
+            CASE(DIV)   BINOP_I64(/);  NEXT;
+            CASE(MOD)   BINOP_I64(%);  NEXT;
+            CASE(AND)   BINOP_I64(&);  NEXT;
+            CASE(OR)    BINOP_I64(|);  NEXT;
+            CASE(XOR)   BINOP_I64(^);  NEXT;
+            CASE(SHL)   BINOP_I64(<<); NEXT;
+            CASE(SHR)   BINOP_I64(>>); NEXT;
+            // CASE(SAR) figure out what to allow
+
+            // unsigned ops (u64)
+            CASE(ADD_U) BINOP_U64(+);  NEXT;
+            CASE(SUB_U) BINOP_U64(-);  NEXT;
+            CASE(MUL_U) BINOP_U64(*);  NEXT;
+            CASE(DIV_U) BINOP_U64(/);  NEXT;
+            CASE(MOD_U) BINOP_U64(%);  NEXT;
+            CASE(AND_U) BINOP_U64(&);  NEXT;
+            CASE(OR_U)  BINOP_U64(|);  NEXT;
+            CASE(XOR_U) BINOP_U64(^);  NEXT;
+            CASE(SHL_U) BINOP_U64(<<); NEXT;
+            CASE(SHR_U) BINOP_U64(>>); NEXT;
+            
+            // boolean comparison ops
+            CASE(EQ)    CMPOP_I64(==); NEXT;
+            CASE(NEQ)   CMPOP_I64(!=); NEXT;
+            CASE(GT)    CMPOP_I64(>);  NEXT;
+            CASE(GE)    CMPOP_I64(>=); NEXT;
+            CASE(LT)    CMPOP_I64(<);  NEXT;
+            CASE(LE)    CMPOP_I64(<=); NEXT;
+
+            // u64 comparisons
+            CASE(EQ_U)  CMPOP_U64(==); NEXT;
+            CASE(NEQ_U) CMPOP_U64(!=); NEXT;
+            CASE(GT_U)  CMPOP_U64(>);  NEXT;
+            CASE(GE_U)  CMPOP_U64(>=); NEXT;
+            CASE(LT_U)  CMPOP_U64(<);  NEXT;
+            CASE(LE_U)  CMPOP_U64(<=); NEXT;
+
+            // float ops (f32)
+            CASE(ADD_F) BINOP_F32(+);  NEXT;
+            CASE(SUB_F) BINOP_F32(-);  NEXT;
+            CASE(MUL_F) BINOP_F32(*);  NEXT;
+            CASE(DIV_F) BINOP_F32(/);  NEXT;
+            CASE(EQ_F)  CMPOP_F32(==); NEXT;
+            CASE(NEQ_F) CMPOP_F32(!=); NEXT;
+            CASE(GT_F)  CMPOP_F32(>);  NEXT;
+            CASE(GE_F)  CMPOP_F32(>=); NEXT;
+            CASE(LT_F)  CMPOP_F32(<);  NEXT;
+            CASE(LE_F)  CMPOP_F32(<=); NEXT;
+
+            // float ops (f64)
+            CASE(ADD_D) BINOP_F64(+);  NEXT;
+            CASE(SUB_D) BINOP_F64(-);  NEXT;
+            CASE(MUL_D) BINOP_F64(*);  NEXT;
+            CASE(DIV_D) BINOP_F64(/);  NEXT;
+            CASE(EQ_D)  CMPOP_F64(==); NEXT;
+            CASE(NEQ_D) CMPOP_F64(!=); NEXT;
+            CASE(GT_D)  CMPOP_F64(>);  NEXT;
+            CASE(GE_D)  CMPOP_F64(>=); NEXT;
+            CASE(LT_D)  CMPOP_F64(<);  NEXT;
+            CASE(LE_D)  CMPOP_F64(<=); NEXT;
+
+            // unary ops
+            CASE(NEG)    UNOP_I64(-);  NEXT;
+            CASE(NEG_U)  UNOP_U64(-);  NEXT;
+            CASE(NEG_F)  UNOP_F32(-);  NEXT;
+            CASE(NEG_D)  UNOP_F64(-);  NEXT;
+            CASE(BNOT)   UNOP_I64(~);  NEXT;
+            CASE(BNOT_U) UNOP_U64(~);  NEXT;
+            
+            // immediate forms, x.imm stands in for the second source
+            CASE(ADDI)  BINI_I64(+);  NEXT;
+            CASE(SUBI)  BINI_I64(-);  NEXT;
+            CASE(MULI)  BINI_I64(*);  NEXT;
+            CASE(SHLI)  BINI_I64(<<); NEXT;
+            CASE(SHRI)  BINI_I64(>>); NEXT;
+            CASE(EQI)   CMPI_I64(==); NEXT;
+            CASE(NEQI)  CMPI_I64(!=); NEXT;
+            CASE(GTI)   CMPI_I64(>);  NEXT;
+            CASE(GEI)   CMPI_I64(>=); NEXT;
+            CASE(LTI)   CMPI_I64(<);  NEXT;
+            CASE(LEI)   CMPI_I64(<=); NEXT;
+
+            // already folded into the next instruction at decode
+            CASE(WIDE)
+                NEXT;
+
+            // counted loops, the target is past the loop for the preps and the top of the body for the loops
+            CASE(FORPREP)   FORPREP_TYPED(I64, i);    NEXT;
+            CASE(FORLOOP)   FORLOOP_I64();            NEXT;
+            CASE(FORPREP_D) FORPREP_TYPED(DOUBLE, d); NEXT;
+            CASE(FORLOOP_D) FORLOOP_F64();            NEXT;
+
+            // logical not has special cases. ONLY can be used on boolean values. gonna fix jmpif and jmpifz to be the same mayb
+            CASE(LNOT)
+                if (!CHECK_TYPE(RTAG(in->a), BOOL)) return false;
+                RSET(in->a, BOOL, u, RGET(in->a, u) ? 0u : 1u);
+                NEXT;
+
+            // arrays: NEWARR dst len elem, ARRGET dst arr idx, ARRSET arr idx val, ARRLEN dst arr. allocating can
+            // run the collector (which rewrites OBJ registers in place), so nothing holds an object across it.
+            // the index is unsigned compared, so a negative one is out of bounds with the same compare
+            CASE(NEWARR) {
+                if (!CHECK_TYPE(RTAG(in->b), I64)) return false;
+                ObjArray* arr = array_new(vm, RGET(in->b, i), (u8)in->c);
+                if (!arr) return false;
+                RSET(in->a, OBJ, obj, arr);
+                NEXT;
+            }
+
+            CASE(ARRGET) {
+                if (!CHECK_TYPE(RTAG(in->c), I64)) return false;
+                ObjArray* arr = as_array(vm, RTAG(in->b), RLOAD(in->b));
+                if (!arr) return false;
+                u64 i = (u64)RGET(in->c, i);
+                if (LIKELYFALSE(i >= arr->length)) {
+                    vm->panic_code = PANIC_INDEX;
+                    return false;
+                }
+                TypedValue val;
+                u8 tag = array_load(arr, (u32)i, &val);
+                RSTORE(in->a, tag, val);
+                NEXT;
+            }
+
+            CASE(ARRSET) {
+                if (!CHECK_TYPE(RTAG(in->b), I64)) return false;
+                ObjArray* arr = as_array(vm, RTAG(in->a), RLOAD(in->a));
+                if (!arr) return false;
+                u64 i = (u64)RGET(in->b, i);
+                if (LIKELYFALSE(i >= arr->length)) {
+                    vm->panic_code = PANIC_INDEX;
+                    return false;
+                }
+                if (!array_store(vm, arr, (u32)i, RTAG(in->c), RLOAD(in->c))) return false;
+                NEXT;
+            }
+
+            CASE(ARRLEN) {
+                ObjArray* arr = as_array(vm, RTAG(in->b), RLOAD(in->b));
+                if (!arr) return false;
+                RSET(in->a, I64, i, (i64)arr->length);
+                NEXT;
+            }
+
+            // bulk ops (array.h). the array's element type is checked against the value once, up front
+            CASE(ARRFILL) {
+                ObjArray* arr = as_array(vm, RTAG(in->a), RLOAD(in->a));
+                if (!arr || !array_fill(vm, arr, RTAG(in->b), RLOAD(in->b))) return false;
+                NEXT;
+            }
+
+            CASE(ARRCOPY) {
+                if (!CHECK_TYPE(RTAG(in->c), I64)) return false;
+                ObjArray* dst = as_array(vm, RTAG(in->a), RLOAD(in->a));
+                ObjArray* src = dst ? as_array(vm, RTAG(in->b), RLOAD(in->b)) : NULL;
+                if (!src || !array_copy(vm, dst, src, RGET(in->c, i))) return false;
+                NEXT;
+            }
+
+            CASE(ARRSUM) {
+                ObjArray* arr = as_array(vm, RTAG(in->b), RLOAD(in->b));
+                u8 tag;
+                TypedValue sum;
+                if (!arr || !array_sum(vm, arr, &tag, &sum)) return false;
+                RSTORE(in->a, tag, sum);
+                NEXT;
+            }
+
+            CASE(ARRADD) {
+                ObjArray* arr = as_array(vm, RTAG(in->a), RLOAD(in->a));
+                if (!arr || !array_add(vm, arr, RTAG(in->b), RLOAD(in->b))) return false;
+                NEXT;
+            }
+
+            // tables (table.h): NEWTABLE dst, GETELEM dst tbl key, SETELEM tbl key val. only a store of a new key into
+            // a full table allocates (the rest of the resize happens a bit at a time in later SETELEMs), key and val
+            // get read from their registers after it
+            CASE(NEWTABLE) {
+                ObjTable* t = table_new(vm);
+                if (!t) return false;
+                RSET(in->a, OBJ, obj, t);
+                NEXT;
+            }
+
+            // a rope key gets flattened first (that allocates, so nothing's read out of a register before it)
+            CASE(GETELEM) {
+                if (LIKELYFALSE(str_unflat(RTAG(in->c), RLOAD(in->c))) && !str_flatten(vm, RLOAD(in->c).obj)) {
+                    return false;
+                }
+                ObjTable* t = as_table(vm, RTAG(in->b), RLOAD(in->b));
+                u8 tag;
+                TypedValue val;
+                if (!t || !table_get(vm, t, RTAG(in->c), RLOAD(in->c), &tag, &val)) return false;
+                RSTORE(in->a, tag, val);
+                NEXT;
+            }
+
+            CASE(SETELEM) {
+                if (LIKELYFALSE(str_unflat(RTAG(in->b), RLOAD(in->b))) && !str_flatten(vm, RLOAD(in->b).obj)) {
+                    return false;
+                }
+                ObjTable* t = as_table(vm, RTAG(in->a), RLOAD(in->a));
+                if (!t) return false;
+                if (LIKELYFALSE(table_full(t)) && RTAG(in->c) != NUL) {
+                    // a key that's already there is overwritten in place, no room needed (stored values are never
+                    // nul, so a nul read back means it's missing)
+                    u8 tag;
+                    TypedValue old;
+                    if (!table_get(vm, t, RTAG(in->b), RLOAD(in->b), &tag, &old)) return false;
+                    if (tag == NUL && !table_grow(vm, &t)) return false;
+                }
+                if (!table_set(vm, t, RTAG(in->b), RLOAD(in->b), RTAG(in->c), RLOAD(in->c))) return false;
+                NEXT;
+            }
+
+            // strings (str.h): CONCAT dst a b, STRLEN dst str. CONCAT can allocate, both sides are read before it
+            // and only the result's stored after
+            CASE(CONCAT) {
+                TypedValue out;
+                if (!str_concat(vm, RTAG(in->b), RLOAD(in->b), RTAG(in->c), RLOAD(in->c), &out)) return false;
+                RSTORE(in->a, OBJ, out);
+                NEXT;
+            }
+
+            CASE(STRLEN) {
+                if (LIKELYFALSE(!str_is(RTAG(in->b), RLOAD(in->b)))) {
+                    vm->panic_code = PANIC_TYPE_MISMATCH;
+                    return false;
+                }
+                RSET(in->a, I64, i, (i64)str_length(RLOAD(in->b)));
+                NEXT;
+            }
+
+            // fused pairs (see fuse.h). compare + branch
+            CASE(JEQ)    CMPJMP_I64(==); NEXT;
+            CASE(JNEQ)   CMPJMP_I64(!=); NEXT;
+            CASE(JGT)    CMPJMP_I64(>);  NEXT;
+            CASE(JGE)    CMPJMP_I64(>=); NEXT;
+            CASE(JLT)    CMPJMP_I64(<);  NEXT;
+            CASE(JLE)    CMPJMP_I64(<=); NEXT;
+            CASE(JEQ_U)  CMPJMP_U64(==); NEXT;
+            CASE(JNEQ_U) CMPJMP_U64(!=); NEXT;
+            CASE(JGT_U)  CMPJMP_U64(>);  NEXT;
+            CASE(JGE_U)  CMPJMP_U64(>=); NEXT;
+            CASE(JLT_U)  CMPJMP_U64(<);  NEXT;
+            CASE(JLE_U)  CMPJMP_U64(<=); NEXT;
+            CASE(JEQ_D)  CMPJMP_F64(==); NEXT;
+            CASE(JNEQ_D) CMPJMP_F64(!=); NEXT;
+            CASE(JGT_D)  CMPJMP_F64(>);  NEXT;
+            CASE(JGE_D)  CMPJMP_F64(>=); NEXT;
+            CASE(JLT_D)  CMPJMP_F64(<);  NEXT;
+            CASE(JLE_D)  CMPJMP_F64(<=); NEXT;
+
+            // load + add/sub
+            CASE(ADD_KI) BINK_TYPED(I64, i, imm, +);  NEXT;
+            CASE(SUB_KI) BINK_TYPED(I64, i, imm, -);  NEXT;
+            CASE(ADD_KD) BINK_TYPED(DOUBLE, d, d, +); NEXT;
+            CASE(SUB_KD) BINK_TYPED(DOUBLE, d, d, -); NEXT;
+
+            // generic numeric ops (see quicken.h). quicken on the sources' type and rerun
+            CASE(ADD_N)   QUICKEN_BINARY(); NEXT;
+            CASE(SUB_N)   QUICKEN_BINARY(); NEXT;
+            CASE(MUL_N)   QUICKEN_BINARY(); NEXT;
+            CASE(DIV_N)   QUICKEN_BINARY(); NEXT;
+            CASE(MOD_N)   QUICKEN_BINARY(); NEXT;
+            CASE(NEG_N)   QUICKEN_UNARY();  NEXT;
+            CASE(EQ_N)    QUICKEN_BINARY(); NEXT;
+            CASE(NEQ_N)   QUICKEN_BINARY(); NEXT;
+            CASE(GT_N)    QUICKEN_BINARY(); NEXT;
+            CASE(GE_N)    QUICKEN_BINARY(); NEXT;
+            CASE(LT_N)    QUICKEN_BINARY(); NEXT;
+            CASE(LE_N)    QUICKEN_BINARY(); NEXT;
+
+            // quickened generic ops, a guard miss de-specializes back to the generic op
+            CASE(ADD_QI)  QBINOP(I64, i, +);        NEXT;
+            CASE(ADD_QU)  QBINOP(U64, u, +);        NEXT;
+            CASE(ADD_QF)  QBINOP(FLOAT, f, +);      NEXT;
+            CASE(ADD_QD)  QBINOP(DOUBLE, d, +);     NEXT;
+            CASE(SUB_QI)  QBINOP(I64, i, -);        NEXT;
+            CASE(SUB_QU)  QBINOP(U64, u, -);        NEXT;
+            CASE(SUB_QF)  QBINOP(FLOAT, f, -);      NEXT;
+            CASE(SUB_QD)  QBINOP(DOUBLE, d, -);     NEXT;
+            CASE(MUL_QI)  QBINOP(I64, i, *);        NEXT;
+            CASE(MUL_QU)  QBINOP(U64, u, *);        NEXT;
+            CASE(MUL_QF)  QBINOP(FLOAT, f, *);      NEXT;
+            CASE(MUL_QD)  QBINOP(DOUBLE, d, *);     NEXT;
+            CASE(DIV_QI)  QBINOP(I64, i, /);        NEXT;
+            CASE(DIV_QU)  QBINOP(U64, u, /);        NEXT;
+            CASE(DIV_QF)  QBINOP(FLOAT, f, /);      NEXT;
+            CASE(DIV_QD)  QBINOP(DOUBLE, d, /);     NEXT;
+            CASE(MOD_QI)  QBINOP(I64, i, %);        NEXT;
+            CASE(MOD_QU)  QBINOP(U64, u, %);        NEXT;
+            CASE(NEG_QI)  QUNOP(I64, i, -);         NEXT;
+            CASE(NEG_QU)  QUNOP(U64, u, -);         NEXT;
+            CASE(NEG_QF)  QUNOP(FLOAT, f, -);       NEXT;
+            CASE(NEG_QD)  QUNOP(DOUBLE, d, -);      NEXT;
+            CASE(EQ_QI)   QCMPOP(I64, i, ==);       NEXT;
+            CASE(EQ_QU)   QCMPOP(U64, u, ==);       NEXT;
+            CASE(EQ_QF)   QCMPOP(FLOAT, f, ==);     NEXT;
+            CASE(EQ_QD)   QCMPOP(DOUBLE, d, ==);    NEXT;
+            CASE(NEQ_QI)  QCMPOP(I64, i, !=);       NEXT;
+            CASE(NEQ_QU)  QCMPOP(U64, u, !=);       NEXT;
+            CASE(NEQ_QF)  QCMPOP(FLOAT, f, !=);     NEXT;
+            CASE(NEQ_QD)  QCMPOP(DOUBLE, d, !=);    NEXT;
+            CASE(GT_QI)   QCMPOP(I64, i, >);        NEXT;
+            CASE(GT_QU)   QCMPOP(U64, u, >);        NEXT;
+            CASE(GT_QF)   QCMPOP(FLOAT, f, >);      NEXT;
+            CASE(GT_QD)   QCMPOP(DOUBLE, d, >);     NEXT;
+            CASE(GE_QI)   QCMPOP(I64, i, >=);       NEXT;
+            CASE(GE_QU)   QCMPOP(U64, u, >=);       NEXT;
+            CASE(GE_QF)   QCMPOP(FLOAT, f, >=);     NEXT;
+            CASE(GE_QD)   QCMPOP(DOUBLE, d, >=);    NEXT;
+            CASE(LT_QI)   QCMPOP(I64, i, <);        NEXT;
+            CASE(LT_QU)   QCMPOP(U64, u, <);        NEXT;
+            CASE(LT_QF)   QCMPOP(FLOAT, f, <);      NEXT;
+            CASE(LT_QD)   QCMPOP(DOUBLE, d, <);     NEXT;
+            CASE(LE_QI)   QCMPOP(I64, i, <=);       NEXT;
+            CASE(LE_QU)   QCMPOP(U64, u, <=);       NEXT;
+            CASE(LE_QF)   QCMPOP(FLOAT, f, <=);     NEXT;
+            CASE(LE_QD)   QCMPOP(DOUBLE, d, <=);    NEXT;
+
+            // nothing matched (9 = invalid opcode)
+            DEFAULT {
+                vm->panic_code = PANIC_INVALID_OPCODE;
+                return false;
+            }
+    DISPATCH_END
+}
+
@@ -0,0 +1,755 @@
+/**
+ * @file jit.c
+ * @author Noah Mingolelli
+ * @brief the stencils and the copy-and-patch compiler. see jit.h for what gets compiled and how it hands off
+ * License: GPLv3
+ */
+// mmap/mprotect aren't c99, ask for them before anything pulls in a libc header
+#define _DEFAULT_SOURCE
+#include "jit.h"
+
+#if VM_JIT
+
+#include <sys/mman.h>
+#include "decode.h"
+
+// while native code runs the window lives in two callee saved registers:
+// rbx = TypedValue* (payload of frame register r at [rbx + r*8]), r12 = u8* (its tag at [r12 + r]).
+// the entry stub sets them up and jumps to start, every exit puts the ip to resume at in eax and returns
+typedef u32 (*JitEntry)(TypedValue* R, u8* T, const u8* start);
+
+// a stencil is a finished instruction sequence with up to two holes. the wide hole at at32 takes a displacement,
+// imm32 or rel32 (or the imm64 of a movabs), the byte at at8 gets OR'd with an imm8, condition code or sse opcode
+#define HOLE 0xFF
+typedef struct {
+    u8 len;
+    u8 at32;
+    u8 at8;
+    u8 bytes[13];
+} Stencil;
+
+#define STENCIL(AT32, AT8, ...) { sizeof((u8[]){ __VA_ARGS__ }), (AT32), (AT8), { __VA_ARGS__ } }
+#define D32 0, 0, 0, 0
+#define Q64 0, 0, 0, 0, 0, 0, 0, 0
+
+// push rbx; push r12; mov rbx, rdi; mov r12, rsi; jmp rdx
+static const Stencil PROLOGUE   = STENCIL(HOLE, HOLE, 0x53, 0x41, 0x54, 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4, 0xFF, 0xE2);
+// mov eax, ip; pop r12; pop rbx; ret
+static const Stencil EXIT       = STENCIL(1, HOLE, 0xB8, D32, 0x41, 0x5C, 0x5B, 0xC3);
+
+// control flow (rel32 holes, cc goes in the low nibble)
+static const Stencil JMP_REL    = STENCIL(1, HOLE, 0xE9, D32);
+static const Stencil JCC_REL    = STENCIL(2, 1, 0x0F, 0x80, D32);
+
+// jump tables: rcx = the table right after the jmp (rel32 entries, relative to the table), rax = the case
+static const Stencil CMP_RAX_I  = STENCIL(2, HOLE, 0x48, 0x3D, D32);
+static const Stencil LEA_TABLE  = STENCIL(HOLE, HOLE, 0x48, 0x8D, 0x0D, 0x09, 0x00, 0x00, 0x00);
+static const Stencil LOAD_CASE  = STENCIL(HOLE, HOLE, 0x48, 0x63, 0x04, 0x81);
+static const Stencil JMP_RAX    = STENCIL(HOLE, HOLE, 0xFF, 0xE0);
+
+// payloads: op rax/rcx/rdx against [rbx + disp32]
+static const Stencil LOAD_RAX   = STENCIL(3, HOLE, 0x48, 0x8B, 0x83, D32);
+static const Stencil STORE_RAX  = STENCIL(3, HOLE, 0x48, 0x89, 0x83, D32);
+static const Stencil STORE_RDX  = STENCIL(3, HOLE, 0x48, 0x89, 0x93, D32);
+static const Stencil LOAD_RCX   = STENCIL(3, HOLE, 0x48, 0x8B, 0x8B, D32);
+static const Stencil LOAD_RDX   = STENCIL(3, HOLE, 0x48, 0x8B, 0x93, D32);
+static const Stencil STORE_RCX  = STENCIL(3, HOLE, 0x48, 0x89, 0x8B, D32);
+static const Stencil ZERO_M     = STENCIL(3, HOLE, 0x48, 0xC7, 0x83, D32, 0x00, 0x00, 0x00, 0x00);
+static const Stencil CMP0_M     = STENCIL(3, HOLE, 0x48, 0x83, 0xBB, D32, 0x00);
+
+// integer arithmetic, rax op= [rbx + disp32]
+static const Stencil ADD_M      = STENCIL(3, HOLE, 0x48, 0x03, 0x83, D32);
+static const Stencil SUB_M      = STENCIL(3, HOLE, 0x48, 0x2B, 0x83, D32);
+static const Stencil IMUL_M     = STENCIL(4, HOLE, 0x48, 0x0F, 0xAF, 0x83, D32);
+static const Stencil AND_M      = STENCIL(3, HOLE, 0x48, 0x23, 0x83, D32);
+static const Stencil OR_M       = STENCIL(3, HOLE, 0x48, 0x0B, 0x83, D32);
+static const Stencil XOR_M      = STENCIL(3, HOLE, 0x48, 0x33, 0x83, D32);
+static const Stencil CMP_M      = STENCIL(3, HOLE, 0x48, 0x3B, 0x83, D32);
+static const Stencil CQO        = STENCIL(HOLE, HOLE, 0x48, 0x99);
+static const Stencil IDIV_M     = STENCIL(3, HOLE, 0x48, 0xF7, 0xBB, D32);
+static const Stencil ZERO_EDX   = STENCIL(HOLE, HOLE, 0x31, 0xD2);
+static const Stencil DIV_M      = STENCIL(3, HOLE, 0x48, 0xF7, 0xB3, D32);
+static const Stencil NEG_M      = STENCIL(3, HOLE, 0x48, 0xF7, 0x9B, D32);
+static const Stencil NOT_M      = STENCIL(3, HOLE, 0x48, 0xF7, 0x93, D32);
+static const Stencil ADD_M_RCX  = STENCIL(3, HOLE, 0x48, 0x01, 0x8B, D32);
+
+// for loops: rdx = distance to the limit, rcx = stride, rsi = the step's sign mask
+static const Stencil SUB_RDX_RAX = STENCIL(HOLE, HOLE, 0x48, 0x29, 0xC2);
+static const Stencil MOV_RSI_RCX = STENCIL(HOLE, HOLE, 0x48, 0x89, 0xCE);
+static const Stencil SAR_RSI_63  = STENCIL(HOLE, HOLE, 0x48, 0xC1, 0xFE, 0x3F);
+static const Stencil XOR_RDX_RSI = STENCIL(HOLE, HOLE, 0x48, 0x31, 0xF2);
+static const Stencil SUB_RDX_RSI = STENCIL(HOLE, HOLE, 0x48, 0x29, 0xF2);
+static const Stencil XOR_RCX_RSI = STENCIL(HOLE, HOLE, 0x48, 0x31, 0xF1);
+static const Stencil SUB_RCX_RSI = STENCIL(HOLE, HOLE, 0x48, 0x29, 0xF1);
+static const Stencil CMP_RDX_RCX = STENCIL(HOLE, HOLE, 0x48, 0x39, 0xCA);
+static const Stencil ADD_RCX_RCX = STENCIL(HOLE, HOLE, 0x48, 0x01, 0xC9);
+
+// immediates (imm64 holes)
+static const Stencil MOV_RAX_Q  = STENCIL(2, HOLE, 0x48, 0xB8, Q64);
+static const Stencil MOV_RCX_Q  = STENCIL(2, HOLE, 0x48, 0xB9, Q64);
+static const Stencil ADD_RAX_RCX = STENCIL(HOLE, HOLE, 0x48, 0x01, 0xC8);
+static const Stencil SUB_RAX_RCX = STENCIL(HOLE, HOLE, 0x48, 0x29, 0xC8);
+static const Stencil IMUL_RAX_RCX = STENCIL(HOLE, HOLE, 0x48, 0x0F, 0xAF, 0xC1);
+static const Stencil CMP_RAX_RCX = STENCIL(HOLE, HOLE, 0x48, 0x39, 0xC8);
+static const Stencil SHL_RAX_I  = STENCIL(HOLE, 3, 0x48, 0xC1, 0xE0, 0x00);
+static const Stencil SAR_RAX_I  = STENCIL(HOLE, 3, 0x48, 0xC1, 0xF8, 0x00);
+static const Stencil MOVQ_X1_RAX = STENCIL(HOLE, HOLE, 0x66, 0x48, 0x0F, 0x6E, 0xC8);
+
+// sse, xmm0 against [rbx + disp32] (or xmm1). the opcode byte is the 8 bit hole
+static const Stencil SD_M       = STENCIL(4, 2, 0xF2, 0x0F, 0x00, 0x83, D32);
+static const Stencil SS_M       = STENCIL(4, 2, 0xF3, 0x0F, 0x00, 0x83, D32);
+static const Stencil SD_X1      = STENCIL(HOLE, 2, 0xF2, 0x0F, 0x00, 0xC1);
+static const Stencil UCOMISD_M  = STENCIL(4, HOLE, 0x66, 0x0F, 0x2E, 0x83, D32);
+static const Stencil UCOMISS_M  = STENCIL(3, HOLE, 0x0F, 0x2E, 0x83, D32);
+static const Stencil BTC63_M    = STENCIL(4, HOLE, 0x48, 0x0F, 0xBA, 0xBB, D32, 0x3F);
+static const Stencil BTC31_M    = STENCIL(3, HOLE, 0x0F, 0xBA, 0xBB, D32, 0x1F);
+enum { SSE_LOAD = 0x10, SSE_STORE = 0x11, SSE_ADD = 0x58, SSE_MUL = 0x59, SSE_SUB = 0x5C, SSE_DIV = 0x5E };
+
+// tags: byte ops against [r12 + disp32]
+static const Stencil TAG_CMP    = STENCIL(4, 8, 0x41, 0x80, 0xBC, 0x24, D32, 0x00);
+static const Stencil TAG_SET    = STENCIL(4, 8, 0x41, 0xC6, 0x84, 0x24, D32, 0x00);
+static const Stencil TAG_LOAD   = STENCIL(4, HOLE, 0x41, 0x8A, 0x8C, 0x24, D32);
+static const Stencil TAG_STORE  = STENCIL(4, HOLE, 0x41, 0x88, 0x8C, 0x24, D32);
+static const Stencil TAG_EAX    = STENCIL(5, HOLE, 0x41, 0x0F, 0xB6, 0x84, 0x24, D32);
+
+// globals: the tag's or the payload's address sits in rax (they're split like the register file)
+static const Stencil LOAD_GTAG  = STENCIL(HOLE, HOLE, 0x0F, 0xB6, 0x08);
+static const Stencil LOAD_GVAL  = STENCIL(HOLE, HOLE, 0x48, 0x8B, 0x08);
+static const Stencil STORE_GTAG = STENCIL(HOLE, HOLE, 0x88, 0x08);
+static const Stencil STORE_GVAL = STENCIL(HOLE, HOLE, 0x48, 0x89, 0x08);
+
+// flags into al/cl
+static const Stencil SET_AL     = STENCIL(HOLE, 1, 0x0F, 0x90, 0xC0);
+static const Stencil SET_CL     = STENCIL(HOLE, 1, 0x0F, 0x90, 0xC1);
+static const Stencil SET_DL     = STENCIL(HOLE, 1, 0x0F, 0x90, 0xC2);
+static const Stencil CMOVL_EAX_EDX = STENCIL(HOLE, HOLE, 0x0F, 0x4C, 0xC2);
+static const Stencil AND_AL_CL  = STENCIL(HOLE, HOLE, 0x20, 0xC8);
+static const Stencil OR_AL_CL   = STENCIL(HOLE, HOLE, 0x08, 0xC8);
+static const Stencil MOVZX_AL   = STENCIL(HOLE, HOLE, 0x0F, 0xB6, 0xC0);
+static const Stencil TEST_AL    = STENCIL(HOLE, HOLE, 0x84, 0xC0);
+static const Stencil SUB_EAX_1  = STENCIL(HOLE, HOLE, 0x83, 0xE8, 0x01);
+static const Stencil CMP_EAX_2  = STENCIL(HOLE, HOLE, 0x83, 0xF8, 0x02);
+
+// condition codes (low nibble of jcc/setcc)
+enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A = 0x7,
+       CC_P = 0xA, CC_NP = 0xB, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF };
+
+// what a handled opcode does. everything not listed here (or in emit's switch) exits to the interpreter
+enum { J_NONE, J_BIN, J_UN, J_CMP, J_CMPJMP, J_BINK, J_BINI, J_CMPI };
+enum { A_ADD, A_SUB, A_MUL, A_DIV, A_MOD, A_AND, A_OR, A_XOR, A_NEG, A_NOT, A_SHL, A_SHR };
+enum { R_EQ, R_NEQ, R_GT, R_GE, R_LT, R_LE };
+
+typedef struct {
+    u8   kind;   // J_*
+    u8   arith;  // A_* (J_BIN/J_UN/J_BINK/J_BINI)
+    u8   tag;    // operand type
+    u8   rel;    // R_* (J_CMP/J_CMPJMP/J_CMPI)
+    bool quick;  // quickened op, its guard stays in even for verified programs
+} JitOp;
+
+#define BIN(ARITH, TAG)   { J_BIN, (ARITH), (TAG), 0, false }
+#define UN(ARITH, TAG)    { J_UN, (ARITH), (TAG), 0, false }
+#define CMP(REL, TAG)     { J_CMP, 0, (TAG), (REL), false }
+#define QBIN(ARITH, TAG)  { J_BIN, (ARITH), (TAG), 0, true }
+#define QUN(ARITH, TAG)   { J_UN, (ARITH), (TAG), 0, true }
+#define QCMP(REL, TAG)    { J_CMP, 0, (TAG), (REL), true }
+#define CMPJMP(REL, TAG)  { J_CMPJMP, 0, (TAG), (REL), false }
+#define BINK(ARITH, TAG)  { J_BINK, (ARITH), (TAG), 0, false }
+#define BINI(ARITH)       { J_BINI, (ARITH), I64, 0, false }
+#define CMPI(REL)         { J_CMPI, 0, I64, (REL), false }
+
+static const JitOp OPS[256] = {
+    [ADD] = BIN(A_ADD, I64), [SUB] = BIN(A_SUB, I64), [MUL] = BIN(A_MUL, I64), [DIV] = BIN(A_DIV, I64),
+    [MOD] = BIN(A_MOD, I64), [AND] = BIN(A_AND, I64), [OR] = BIN(A_OR, I64), [XOR] = BIN(A_XOR, I64),
+    [NEG] = UN(A_NEG, I64), [BNOT] = UN(A_NOT, I64),
+    [EQ] = CMP(0, I64), [NEQ] = CMP(1, I64), [GT] = CMP(2, I64), [GE] = CMP(3, I64), [LT] = CMP(4, I64), [LE] = CMP(5, I64),
+
+    [ADD_U] = BIN(A_ADD, U64), [SUB_U] = BIN(A_SUB, U64), [MUL_U] = BIN(A_MUL, U64), [DIV_U] = BIN(A_DIV, U64),
+    [MOD_U] = BIN(A_MOD, U64), [AND_U] = BIN(A_AND, U64), [OR_U] = BIN(A_OR, U64), [XOR_U] = BIN(A_XOR, U64),
+    [NEG_U] = UN(A_NEG, U64), [BNOT_U] = UN(A_NOT, U64),
+    [EQ_U] = CMP(0, U64), [NEQ_U] = CMP(1, U64), [GT_U] = CMP(2, U64), [GE_U] = CMP(3, U64), [LT_U] = CMP(4, U64), [LE_U] = CMP(5, U64),
+
+    [ADD_F] = BIN(A_ADD, FLOAT), [SUB_F] = BIN(A_SUB, FLOAT), [MUL_F] = BIN(A_MUL, FLOAT), [DIV_F] = BIN(A_DIV, FLOAT),
+    [NEG_F] = UN(A_NEG, FLOAT),
+    [EQ_F] = CMP(0, FLOAT), [NEQ_F] = CMP(1, FLOAT), [GT_F] = CMP(2, FLOAT), [GE_F] = CMP(3, FLOAT), [LT_F] = CMP(4, FLOAT), [LE_F] = CMP(5, FLOAT),
+
+    [ADD_D] = BIN(A_ADD, DOUBLE), [SUB_D] = BIN(A_SUB, DOUBLE), [MUL_D] = BIN(A_MUL, DOUBLE), [DIV_D] = BIN(A_DIV, DOUBLE),
+    [NEG_D] = UN(A_NEG, DOUBLE),
+    [EQ_D] = CMP(0, DOUBLE), [NEQ_D] = CMP(1, DOUBLE), [GT_D] = CMP(2, DOUBLE), [GE_D] = CMP(3, DOUBLE), [LT_D] = CMP(4, DOUBLE), [LE_D] = CMP(5, DOUBLE),
+
+    // quickened generic ops always keep their guard
+    [ADD_QI] = QBIN(A_ADD, I64), [SUB_QI] = QBIN(A_SUB, I64), [MUL_QI] = QBIN(A_MUL, I64), [DIV_QI] = QBIN(A_DIV, I64), [MOD_QI] = QBIN(A_MOD, I64),
+    [NEG_QI] = QUN(A_NEG, I64),
+    [EQ_QI] = QCMP(0, I64), [NEQ_QI] = QCMP(1, I64), [GT_QI] = QCMP(2, I64), [GE_QI] = QCMP(3, I64), [LT_QI] = QCMP(4, I64), [LE_QI] = QCMP(5, I64),
+    [ADD_QU] = QBIN(A_ADD, U64), [SUB_QU] = QBIN(A_SUB, U64), [MUL_QU] = QBIN(A_MUL, U64), [DIV_QU] = QBIN(A_DIV, U64), [MOD_QU] = QBIN(A_MOD, U64),
+    [NEG_QU] = QUN(A_NEG, U64),
+    [EQ_QU] = QCMP(0, U64), [NEQ_QU] = QCMP(1, U64), [GT_QU] = QCMP(2, U64), [GE_QU] = QCMP(3, U64), [LT_QU] = QCMP(4, U64), [LE_QU] = QCMP(5, U64),
+    [ADD_QF] = QBIN(A_ADD, FLOAT), [SUB_QF] = QBIN(A_SUB, FLOAT), [MUL_QF] = QBIN(A_MUL, FLOAT), [DIV_QF] = QBIN(A_DIV, FLOAT),
+    [NEG_QF] = QUN(A_NEG, FLOAT),
+    [EQ_QF] = QCMP(0, FLOAT), [NEQ_QF] = QCMP(1, FLOAT), [GT_QF] = QCMP(2, FLOAT), [GE_QF] = QCMP(3, FLOAT), [LT_QF] = QCMP(4, FLOAT), [LE_QF] = QCMP(5, FLOAT),
+    [ADD_QD] = QBIN(A_ADD, DOUBLE), [SUB_QD] = QBIN(A_SUB, DOUBLE), [MUL_QD] = QBIN(A_MUL, DOUBLE), [DIV_QD] = QBIN(A_DIV, DOUBLE),
+    [NEG_QD] = QUN(A_NEG, DOUBLE),
+    [EQ_QD] = QCMP(0, DOUBLE), [NEQ_QD] = QCMP(1, DOUBLE), [GT_QD] = QCMP(2, DOUBLE), [GE_QD] = QCMP(3, DOUBLE), [LT_QD] = QCMP(4, DOUBLE), [LE_QD] = QCMP(5, DOUBLE),
+
+    // fused pairs
+    [JEQ] = CMPJMP(0, I64), [JNEQ] = CMPJMP(1, I64), [JGT] = CMPJMP(2, I64), [JGE] = CMPJMP(3, I64), [JLT] = CMPJMP(4, I64), [JLE] = CMPJMP(5, I64),
+    [JEQ_U] = CMPJMP(0, U64), [JNEQ_U] = CMPJMP(1, U64), [JGT_U] = CMPJMP(2, U64), [JGE_U] = CMPJMP(3, U64), [JLT_U] = CMPJMP(4, U64), [JLE_U] = CMPJMP(5, U64),
+    [JEQ_D] = CMPJMP(0, DOUBLE), [JNEQ_D] = CMPJMP(1, DOUBLE), [JGT_D] = CMPJMP(2, DOUBLE), [JGE_D] = CMPJMP(3, DOUBLE), [JLT_D] = CMPJMP(4, DOUBLE), [JLE_D] = CMPJMP(5, DOUBLE),
+    [ADD_KI] = BINK(A_ADD, I64), [SUB_KI] = BINK(A_SUB, I64), [ADD_KD] = BINK(A_ADD, DOUBLE), [SUB_KD] = BINK(A_SUB, DOUBLE),
+
+    // immediate forms
+    [ADDI] = BINI(A_ADD), [SUBI] = BINI(A_SUB), [MULI] = BINI(A_MUL), [SHLI] = BINI(A_SHL), [SHRI] = BINI(A_SHR),
+    [EQI] = CMPI(0), [NEQI] = CMPI(1), [GTI] = CMPI(2), [GEI] = CMPI(3), [LTI] = CMPI(4), [LEI] = CMPI(5),
+};
+
+static const u8 SIGNED_CC[6]   = { CC_E, CC_NE, CC_G, CC_GE, CC_L, CC_LE };
+static const u8 UNSIGNED_CC[6] = { CC_E, CC_NE, CC_A, CC_AE, CC_B, CC_BE };
+static const u8 SSE_OPS[4]     = { SSE_ADD, SSE_SUB, SSE_MUL, SSE_DIV };
+static const Stencil* const INT_OPS[8] = { &ADD_M, &SUB_M, &IMUL_M, NULL, NULL, &AND_M, &OR_M, &XOR_M };
+
+// a rel32 to resolve once everything is placed: a jump to ip's code, or to ip's exit
+typedef struct {
+    u32  at;
+    u32  base;  // what it's relative to (the end of the jump, or the start of a jump table)
+    u32  ip;
+    bool exit;
+} Fixup;
+
+// the code being stitched together (plain heap memory, it only gets mapped once it's done)
+typedef struct {
+    u8*    buf;
+    u32    len, cap;
+    Fixup* fix;
+    u32    nfix, fixcap;
+    bool   ok;  // cleared by any failed allocation, everything after that is a no-op
+} Asm;
+
+static bool reserve(Asm* a, u32 n) {
+    if (!a->ok) return false;
+    if (a->len + n <= a->cap) return true;
+    u32 cap = a->cap ? a->cap : 256;
+    while (cap < a->len + n) cap *= 2;
+    u8* buf = (u8*)realloc(a->buf, cap);
+    if (!buf) return a->ok = false;
+    a->buf = buf;
+    a->cap = cap;
+    return true;
+}
+
+// copy a stencil and patch its holes. returns where it landed
+static u32 put(Asm* a, const Stencil* s, u32 h32, u8 h8) {
+    u32 at = a->len;
+    if (!reserve(a, s->len)) return at;
+    memcpy(a->buf + at, s->bytes, s->len);
+    if (s->at32 != HOLE) memcpy(a->buf + at + s->at32, &h32, sizeof(u32));
+    if (s->at8 != HOLE) a->buf[at + s->at8] |= h8;
+    a->len += s->len;
+    return at;
+}
+
+static void put0(Asm* a, const Stencil* s) { put(a, s, 0, 0); }
+
+// same, with a 64 bit hole
+static void put64(Asm* a, const Stencil* s, u64 h64) {
+    u32 at = put(a, s, 0, 0);
+    if (a->ok) memcpy(a->buf + at + s->at32, &h64, sizeof(u64));
+}
+
+static void add_fixup(Asm* a, u32 at, u32 base, u32 ip, bool exit) {
+    if (!a->ok) return;
+    if (a->nfix == a->fixcap) {
+        u32 cap = a->fixcap ? a->fixcap * 2 : 64;
+        Fixup* fix = (Fixup*)realloc(a->fix, cap * sizeof(Fixup));
+        if (!fix) { a->ok = false; return; }
+        a->fix = fix;
+        a->fixcap = cap;
+    }
+    a->fix[a->nfix++] = (Fixup){ at, base, ip, exit };
+}
+
+// jumps to ip (exit: leave native code at ip instead)
+static void jmp_to(Asm* a, u32 ip, bool exit) {
+    u32 at = put(a, &JMP_REL, 0, 0);
+    add_fixup(a, at + JMP_REL.at32, at + JMP_REL.len, ip, exit);
+}
+
+static void jcc_to(Asm* a, u8 cc, u32 ip, bool exit) {
+    u32 at = put(a, &JCC_REL, 0, cc);
+    add_fixup(a, at + JCC_REL.at32, at + JCC_REL.len, ip, exit);
+}
+
+// payload/tag displacements for a frame register
+#define PAY(r) ((u32)(r) * (u32)sizeof(TypedValue))
+#define TAG(r) ((u32)(r))
+
+// leave at ip unless register r holds tag
+static void guard(Asm* a, u16 r, u8 tag, u32 ip) {
+    put(a, &TAG_CMP, TAG(r), tag);
+    jcc_to(a, CC_NE, ip, true);
+}
+
+// rel of b against c, result (0/1) in al
+static void compare(Asm* a, u8 tag, u8 rel, u16 b, u16 c) {
+    if (tag == I64 || tag == U64) {
+        put(a, &LOAD_RAX, PAY(b), 0);
+        put(a, &CMP_M, PAY(c), 0);
+        put(a, &SET_AL, 0, tag == I64 ? SIGNED_CC[rel] : UNSIGNED_CC[rel]);
+        return;
+    }
+
+    // floats only have unsigned style flags (and parity for unordered), so < and <= flip their operands
+    bool dbl = tag == DOUBLE;
+    bool flip = rel == R_LT || rel == R_LE;
+    put(a, dbl ? &SD_M : &SS_M, PAY(flip ? c : b), SSE_LOAD);
+    put(a, dbl ? &UCOMISD_M : &UCOMISS_M, PAY(flip ? b : c), 0);
+    switch (rel) {
+        case R_EQ:  put(a, &SET_AL, 0, CC_E);  put(a, &SET_CL, 0, CC_NP); put0(a, &AND_AL_CL); break;
+        case R_NEQ: put(a, &SET_AL, 0, CC_NE); put(a, &SET_CL, 0, CC_P);  put0(a, &OR_AL_CL);  break;
+        case R_GT: case R_LT: put(a, &SET_AL, 0, CC_A);  break;
+        default:              put(a, &SET_AL, 0, CC_AE); break;
+    }
+}
+
+/**
+ * does a for loop at register r run (again)? al = index < limit, dl = index > limit, then the step's sign
+ * (its bits, same as the interpreter) picks one. the caller still has to test al
+ * @param zero where to leave when the step is zero (a prep's panic is the interpreter's job), JIT_NONE for no check
+ */
+static void for_runs(Asm* a, bool dbl, u16 r, u32 zero) {
+    if (dbl) {
+        put(a, &SD_M, PAY(r + 1), SSE_LOAD);
+        put(a, &UCOMISD_M, PAY(r), 0);
+        put(a, &SET_AL, 0, CC_A);
+        put(a, &SD_M, PAY(r), SSE_LOAD);
+        put(a, &UCOMISD_M, PAY(r + 1), 0);
+        put(a, &SET_DL, 0, CC_A);
+    } else {
+        put(a, &LOAD_RAX, PAY(r), 0);
+        put(a, &CMP_M, PAY(r + 1), 0);
+        put(a, &SET_AL, 0, CC_L);
+        put(a, &SET_DL, 0, CC_G);
+    }
+
+    // +-0.0 is zero as a double too, so a double's bits get shifted past the sign
+    if (zero != JIT_NONE && dbl) {
+        put(a, &LOAD_RCX, PAY(r + 2), 0);
+        put0(a, &ADD_RCX_RCX);
+        jcc_to(a, CC_E, zero, true);
+    }
+    put(a, &CMP0_M, PAY(r + 2), 0);
+    if (zero != JIT_NONE && !dbl) jcc_to(a, CC_E, zero, true);
+    put0(a, &CMOVL_EAX_EDX);
+}
+
+// al -> BOOL in register r
+static void store_bool(Asm* a, u16 r) {
+    put0(a, &MOVZX_AL);
+    put(a, &STORE_RAX, PAY(r), 0);
+    put(a, &TAG_SET, TAG(r), BOOL);
+}
+
+// r = b op c for an integer type (division by zero leaves so the interpreter does whatever it does)
+static void int_binop(Asm* a, u8 arith, bool sign, const Inst* in, u32 ip) {
+    if (arith == A_DIV || arith == A_MOD) {
+        put(a, &CMP0_M, PAY(in->c), 0);
+        jcc_to(a, CC_E, ip, true);
+        put(a, &LOAD_RAX, PAY(in->b), 0);
+        if (sign) {
+            put0(a, &CQO);
+            put(a, &IDIV_M, PAY(in->c), 0);
+        } else {
+            put0(a, &ZERO_EDX);
+            put(a, &DIV_M, PAY(in->c), 0);
+        }
+        put(a, arith == A_DIV ? &STORE_RAX : &STORE_RDX, PAY(in->a), 0);
+        return;
+    }
+    put(a, &LOAD_RAX, PAY(in->b), 0);
+    put(a, INT_OPS[arith], PAY(in->c), 0);
+    put(a, &STORE_RAX, PAY(in->a), 0);
+}
+
+/**
+ * emit one instruction
+ * @param a the code so far
+ * @param vm the vm (for its decoded stream and whether it verified)
+ * @param ip the instruction to emit
+ */
+static void emit(Asm* a, const VM* vm, u32 ip) {
+    const Inst* in = &vm->code[ip];
+    const JitOp* op = &OPS[in->op];
+    bool checked = op->quick || !vm->verified;
+    u8 tag = op->tag;
+    bool dbl = tag == DOUBLE;
+
+    switch (op->kind) {
+        case J_BIN:
+            if (checked) {
+                guard(a, in->b, tag, ip);
+                guard(a, in->c, tag, ip);
+            }
+            if (tag == I64 || tag == U64) {
+                int_binop(a, op->arith, tag == I64, in, ip);
+            } else {
+                put(a, dbl ? &SD_M : &SS_M, PAY(in->b), SSE_LOAD);
+                put(a, dbl ? &SD_M : &SS_M, PAY(in->c), SSE_OPS[op->arith]);
+                put(a, dbl ? &SD_M : &SS_M, PAY(in->a), SSE_STORE);
+            }
+            put(a, &TAG_SET, TAG(in->a), tag);
+            return;
+
+        // floats flip their sign bit, f32 only owns the low half of the payload
+        case J_UN:
+            if (checked) guard(a, in->a, tag, ip);
+            if (tag == DOUBLE)     put(a, &BTC63_M, PAY(in->a), 0);
+            else if (tag == FLOAT) put(a, &BTC31_M, PAY(in->a), 0);
+            else                   put(a, op->arith == A_NEG ? &NEG_M : &NOT_M, PAY(in->a), 0);
+            return;
+
+        case J_CMP:
+            if (checked) {
+                guard(a, in->b, tag, ip);
+                guard(a, in->c, tag, ip);
+            }
+            compare(a, tag, op->rel, in->b, in->c);
+            store_bool(a, in->a);
+            return;
+
+        // jump when the compare matches the branch's sense, otherwise fall past the pair
+        case J_CMPJMP:
+            if (checked) {
+                guard(a, in->b, tag, ip);
+                guard(a, in->c, tag, ip);
+            }
+            compare(a, tag, op->rel, in->b, in->c);
+            if (in->aux & FUSE_KEEP) store_bool(a, in->a);
+            put0(a, &TEST_AL);
+            jcc_to(a, (in->aux & FUSE_SENSE) ? CC_NE : CC_E, in->x.target, false);
+            return;
+
+        // the kept load goes first, same as the handler (it may be the register that gets checked)
+        case J_BINK: {
+            u64 k;
+            memcpy(&k, &in->x, sizeof(u64));
+            if (in->aux & FUSE_KEEP) {
+                put64(a, &MOV_RAX_Q, k);
+                put(a, &STORE_RAX, PAY(in->c), 0);
+                put(a, &TAG_SET, TAG(in->c), tag);
+            }
+            if (checked) guard(a, in->b, tag, ip);
+            if (dbl) {
+                put64(a, &MOV_RAX_Q, k);
+                put0(a, &MOVQ_X1_RAX);
+                put(a, &SD_M, PAY(in->b), SSE_LOAD);
+                put(a, &SD_X1, 0, SSE_OPS[op->arith]);
+                put(a, &SD_M, PAY(in->a), SSE_STORE);
+            } else {
+                put(a, &LOAD_RAX, PAY(in->b), 0);
+                put64(a, &MOV_RCX_Q, k);
+                put0(a, op->arith == A_ADD ? &ADD_RAX_RCX : &SUB_RAX_RCX);
+                put(a, &STORE_RAX, PAY(in->a), 0);
+            }
+            put(a, &TAG_SET, TAG(in->a), tag);
+            return;
+        }
+
+        // the immediate rides in rcx (shifts take it as an imm8, decode already masked it)
+        case J_BINI:
+            if (checked) guard(a, in->b, I64, ip);
+            put(a, &LOAD_RAX, PAY(in->b), 0);
+            if (op->arith == A_SHL || op->arith == A_SHR) {
+                put(a, op->arith == A_SHL ? &SHL_RAX_I : &SAR_RAX_I, 0, (u8)in->x.imm);
+            } else {
+                put64(a, &MOV_RCX_Q, (u64)in->x.imm);
+                put0(a, op->arith == A_ADD ? &ADD_RAX_RCX : op->arith == A_SUB ? &SUB_RAX_RCX : &IMUL_RAX_RCX);
+            }
+            put(a, &STORE_RAX, PAY(in->a), 0);
+            put(a, &TAG_SET, TAG(in->a), I64);
+            return;
+
+        case J_CMPI:
+            if (checked) guard(a, in->b, I64, ip);
+            put(a, &LOAD_RAX, PAY(in->b), 0);
+            put64(a, &MOV_RCX_Q, (u64)in->x.imm);
+            put0(a, &CMP_RAX_RCX);
+            put(a, &SET_AL, 0, SIGNED_CC[op->rel]);
+            store_bool(a, in->a);
+            return;
+
+        default:
+            break;
+    }
+
+    switch (in->op) {
+        case JMP:
+            jmp_to(a, in->x.target, false);
+            return;
+
+        // BOOL/U64/I64 (tags 1..3) are falsy at 0, any other tag goes through the interpreter's value_falsy
+        case JMPIF: case JMPIFZ:
+            put(a, &TAG_EAX, TAG(in->a), 0);
+            put0(a, &SUB_EAX_1);
+            put0(a, &CMP_EAX_2);
+            jcc_to(a, CC_A, ip, true);
+            put(a, &CMP0_M, PAY(in->a), 0);
+            jcc_to(a, in->op == JMPIF ? CC_NE : CC_E, in->x.target, false);
+            return;
+
+        // already folded into the next instruction, nothing to run
+        case WIDE:
+            return;
+
+        // out of range falls through (unsigned compare catches negatives too), the rest index a rel32 table
+        // laid down right after the indirect jump
+        case JMPTABLE: {
+            const JumpTable* jt = in->x.jt;
+            if (jt->count > INT32_MAX) {
+                jmp_to(a, ip, true);
+                return;
+            }
+            if (!vm->verified) guard(a, in->a, I64, ip);
+            put(a, &LOAD_RAX, PAY(in->a), 0);
+            put(a, &CMP_RAX_I, jt->count, 0);
+            jcc_to(a, CC_AE, ip + 1, false);
+            put0(a, &LEA_TABLE);
+            put0(a, &LOAD_CASE);
+            put0(a, &ADD_RAX_RCX);
+            put0(a, &JMP_RAX);
+            u32 base = a->len;
+            for (u32 i = 0; i < jt->count; i++) {
+                if (!reserve(a, 4)) return;
+                add_fixup(a, a->len, base, jt->targets[i], false);
+                a->len += 4;
+            }
+            return;
+        }
+
+        // leave the loop unless it runs at all
+        case FORPREP: case FORPREP_D: {
+            u8 type = in->op == FORPREP ? I64 : DOUBLE;
+            if (!vm->verified) {
+                for (u16 r = 0; r < 3; r++) guard(a, in->a + r, type, ip);
+            }
+            for_runs(a, type == DOUBLE, in->a, ip);
+            put0(a, &TEST_AL);
+            jcc_to(a, CC_E, in->x.target, false);
+            return;
+        }
+
+        // i64 is the interpreter's overflow proof distance/stride compare (into cl), and'd with the index still
+        // being short of the limit (al, for_runs leaves rcx alone). the step goes in last, branch free until the jcc
+        case FORLOOP:
+            if (!vm->verified) {
+                for (u16 r = 0; r < 3; r++) guard(a, in->a + r, I64, ip);
+            }
+            put(a, &LOAD_RAX, PAY(in->a), 0);
+            put(a, &LOAD_RCX, PAY(in->a + 2), 0);
+            put(a, &LOAD_RDX, PAY(in->a + 1), 0);
+            put0(a, &SUB_RDX_RAX);
+            put0(a, &MOV_RSI_RCX);
+            put0(a, &SAR_RSI_63);
+            put0(a, &XOR_RDX_RSI);
+            put0(a, &SUB_RDX_RSI);
+            put0(a, &XOR_RCX_RSI);
+            put0(a, &SUB_RCX_RSI);
+            put0(a, &CMP_RDX_RCX);
+            put(a, &SET_CL, 0, CC_A);
+            for_runs(a, false, in->a, JIT_NONE);
+            put0(a, &AND_AL_CL);
+            put(a, &LOAD_RCX, PAY(in->a + 2), 0);
+            put(a, &ADD_M_RCX, PAY(in->a), 0);
+            put0(a, &TEST_AL);
+            jcc_to(a, CC_NE, in->x.target, false);
+            return;
+
+        case FORLOOP_D:
+            if (!vm->verified) {
+                for (u16 r = 0; r < 3; r++) guard(a, in->a + r, DOUBLE, ip);
+            }
+            put(a, &SD_M, PAY(in->a), SSE_LOAD);
+            put(a, &SD_M, PAY(in->a + 2), SSE_ADD);
+            put(a, &SD_M, PAY(in->a), SSE_STORE);
+            for_runs(a, true, in->a, JIT_NONE);
+            put0(a, &TEST_AL);
+            jcc_to(a, CC_NE, in->x.target, false);
+            return;
+
+        case LOADI:
+            put64(a, &MOV_RAX_Q, (u64)in->x.imm);
+            put(a, &STORE_RAX, PAY(in->a), 0);
+            put(a, &TAG_SET, TAG(in->a), I64);
+            return;
+
+        // constants never change after load, bake them in
+        case LOADC:
+            put64(a, &MOV_RAX_Q, in->x.k->u);
+            put(a, &STORE_RAX, PAY(in->a), 0);
+            put(a, &TAG_SET, TAG(in->a), in->aux);
+            return;
+
+        case LOADG:
+            put64(a, &MOV_RAX_Q, (u64)(uintptr_t)&vm->globaltypes[in->x.slot]);
+            put0(a, &LOAD_GTAG);
+            put(a, &TAG_STORE, TAG(in->a), 0);
+            put64(a, &MOV_RAX_Q, (u64)(uintptr_t)&vm->globals[in->x.slot]);
+            put0(a, &LOAD_GVAL);
+            put(a, &STORE_RCX, PAY(in->a), 0);
+            return;
+
+        // storing an object needs the gc's barrier, the interpreter does that one
+        case STOREG:
+            put(a, &TAG_CMP, TAG(in->a), OBJ);
+            jcc_to(a, CC_E, ip, true);
+            put64(a, &MOV_RAX_Q, (u64)(uintptr_t)&vm->globaltypes[in->x.slot]);
+            put(a, &TAG_LOAD, TAG(in->a), 0);
+            put0(a, &STORE_GTAG);
+            put64(a, &MOV_RAX_Q, (u64)(uintptr_t)&vm->globals[in->x.slot]);
+            put(a, &LOAD_RCX, PAY(in->a), 0);
+            put0(a, &STORE_GVAL);
+            return;
+
+        case COPY: case MOVE:
+            put(a, &TAG_LOAD, TAG(in->b), 0);
+            put(a, &TAG_STORE, TAG(in->a), 0);
+            put(a, &LOAD_RCX, PAY(in->b), 0);
+            put(a, &STORE_RCX, PAY(in->a), 0);
+            if (in->op == MOVE) {
+                put(a, &TAG_SET, TAG(in->b), NUL);
+                put(a, &ZERO_M, PAY(in->b), 0);
+            }
+            return;
+
+        // calls, returns, halts, traps, generic ops that haven't quickened, anything else: the interpreter's job
+        default:
+            jmp_to(a, ip, true);
+            return;
+    }
+}
+
+bool jit_compile(VM* vm, Func* fn) {
+    if (!vm || !vm->code || !fn || fn->kind != BYTECODE || fn->as.bc.jit) return false;
+    u32 total = vm->icount + DECODE_PAD;
+    u32 entry = fn->as.bc.entry_ip;
+    if (entry >= total) return false;
+
+    bool ok = false;
+    u8* mem = MAP_FAILED;
+    u32* offsets = NULL;
+    u32* exits = NULL;
+    JitCode* jc = NULL;
+    Asm a = { .ok = true };
+
+    // everything reachable from the entry without going through a call
+    bool* seen = (bool*)calloc(total, sizeof(bool));
+    u32* work = (u32*)malloc(total * sizeof(u32));
+    if (!seen || !work) goto done;
+
+    u32 lo = entry, hi = entry, n = 0;
+    seen[entry] = true;
+    work[n++] = entry;
+    while (n) {
+        u32 ip = work[--n];
+        u32 next[2] = { decoded_next(&vm->code[ip], ip), decoded_target(&vm->code[ip]) };
+        u32 ncases;
+        const u32* cases = decoded_cases(&vm->code[ip], &ncases);
+        for (u32 i = 0; i < 2 + ncases; i++) {
+            u32 s = i < 2 ? next[i] : cases[i - 2];
+            if (s >= total || seen[s]) continue;
+            seen[s] = true;
+            work[n++] = s;
+            if (s < lo) lo = s;
+            if (s > hi) hi = s;
+        }
+    }
+
+    u32 span = hi - lo + 1;
+    offsets = (u32*)malloc(span * sizeof(u32));
+    exits = (u32*)malloc(span * sizeof(u32));
+    if (!offsets || !exits) goto done;
+    for (u32 i = 0; i < span; i++) offsets[i] = exits[i] = JIT_NONE;
+
+    // shared entry stub, then the body in ip order
+    put0(&a, &PROLOGUE);
+    for (u32 ip = lo; ip <= hi; ip++) {
+        if (!seen[ip]) continue;
+        offsets[ip - lo] = a.len;
+        emit(&a, vm, ip);
+
+        // only needs a jump if the next thing emitted isn't where it falls through to
+        u32 ft = decoded_next(&vm->code[ip], ip);
+        if (ft == DECODE_NONE) continue;
+        u32 after = ip + 1;
+        while (after <= hi && !seen[after]) after++;
+        if (ft != after) jmp_to(&a, ft, false);
+    }
+
+    // one exit per ip something leaves at, placed after the body
+    for (u32 i = 0; i < a.nfix; i++) {
+        u32 ip = a.fix[i].ip;
+        if (!a.fix[i].exit || exits[ip - lo] != JIT_NONE) continue;
+        exits[ip - lo] = a.len;
+        put(&a, &EXIT, ip, 0);
+    }
+    if (!a.ok) goto done;
+
+    // resolve every jump now that everything has a place
+    for (u32 i = 0; i < a.nfix; i++) {
+        const Fixup* f = &a.fix[i];
+        u32 dest = f->exit ? exits[f->ip - lo] : offsets[f->ip - lo];
+        i32 rel = (i32)dest - (i32)f->base;
+        memcpy(a.buf + f->at, &rel, sizeof(i32));
+    }
+
+    // W^X: written while only writable, executable only once it's done
+    mem = (u8*)mmap(NULL, a.len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) goto done;
+    memcpy(mem, a.buf, a.len);
+    if (mprotect(mem, a.len, PROT_READ | PROT_EXEC) != 0) goto done;
+
+    jc = (JitCode*)malloc(sizeof(JitCode));
+    if (!jc) goto done;
+    *jc = (JitCode){ .mem = mem, .size = a.len, .lo = lo, .hi = hi, .offsets = offsets };
+    fn->as.bc.jit = jc;
+    STAT(vm->stats.jitted++);
+    ok = true;
+
+done:
+    if (!ok) {
+        if (mem != MAP_FAILED) munmap(mem, a.len);
+        free(offsets);
+    }
+    free(exits);
+    free(a.buf);
+    free(a.fix);
+    free(seen);
+    free(work);
+    return ok;
+}
+
+u32 jit_run(VM* vm, Func* fn, u32 ip) {
+    const JitCode* jc = fn->as.bc.jit;
+    if (ip < jc->lo || ip > jc->hi || jc->offsets[ip - jc->lo] == JIT_NONE) return ip;
+
+    STAT(vm->stats.native_entries++);
+    JitEntry enter = (JitEntry)(void*)jc->mem;
+    u32 base = vm->current->base;
+    return enter(vm->regs->payloads + base, vm->regs->types + base, jc->mem + jc->offsets[ip - jc->lo]);
+}
+
+void jit_free(Func* fn) {
+    if (!fn || fn->kind != BYTECODE || !fn->as.bc.jit) return;
+    JitCode* jc = fn->as.bc.jit;
+    munmap(jc->mem, jc->size);
+    free(jc->offsets);
+    free(jc);
+    fn->as.bc.jit = NULL;
+}
+
+#else
+
+// no jit on this target (or built with JIT=0), everything stays interpreted
+bool jit_compile(VM* vm, Func* fn) { (void)vm; (void)fn; return false; }
+u32 jit_run(VM* vm, Func* fn, u32 ip) { (void)vm; (void)fn; return ip; }
+void jit_free(Func* fn) { (void)fn; }
+
+#endif
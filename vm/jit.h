@@ -0,0 +1,76 @@
+/**
+ * @file jit.h
+ * @author Noah Mingolelli
+ * @brief baseline copy-and-patch JIT for hot bytecode functions (x86-64 linux only)
+ * License: GPLv3
+ *
+ * every bytecode function counts its calls, when one hits JIT_THRESHOLD jit_compile builds native code for it.
+ * there's no codegen to speak of: each operation has a stencil (a fixed chunk of machine code in jit.c) with holes
+ * for register offsets, immediates and jump targets. compiling is copying stencils back to back and patching the
+ * holes. the result gets its own mapping that is written while RW and only then flipped to RX (never both).
+ *
+ * native code works on the same register window as the interpreter (rbx = payloads, r12 = tags), so nothing gets
+ * converted on the way in or out. it runs until it hits something it doesn't cover, then hands back the ip to carry
+ * on from and the interpreter picks up mid function like it was there the whole time. that's:
+ * - opcodes without a stencil, and generic ops that haven't quickened yet
+ * - a type guard missing (the interpreter then panics, or de-specializes a quickened op)
+ * - CALL, TAILCALL and RET. the interpreter switches frames and jumps back into native code for a jitted callee,
+ *   or a jitted caller once it's returned to, so deep recursion never nests C calls
+ *
+ * covered: LOADI/LOADC/LOADG/STOREG, COPY/MOVE, JMP/JMPIF/JMPIFZ, typed i64/u64/f32/f64 arithmetic and
+ * comparisons (plus their quickened forms), the i64 immediate forms, for loops, jump tables, and the fused
+ * compare+branch and load+add/sub pairs.
+ * verified programs skip the guards on typed ops, same as the unchecked loop. quickened ops always keep theirs
+ */
+#ifndef JIT_H
+#define JIT_H
+
+#include "vm.h"
+
+// on wherever it's implemented. build with -DVM_JIT=0 (make JIT=0) to turn it off.
+// stencils address the split register layout, so NaN-boxed builds go without
+#ifndef VM_JIT
+  #if defined(__x86_64__) && defined(__linux__) && !VM_NANBOX
+    #define VM_JIT 1
+  #else
+    #define VM_JIT 0
+  #endif
+#endif
+
+// calls before a function gets compiled
+#ifndef JIT_THRESHOLD
+#define JIT_THRESHOLD 64
+#endif
+
+#if VM_JIT && VM_NANBOX
+  #error "the jit only works on split registers, build VM_NANBOX=1 with VM_JIT=0"
+#endif
+
+// native code for one function
+typedef struct JitCode {
+    u8*    mem;      // the mapping (RX once built), starts with the shared prologue
+    size_t size;     // its length
+    u32    lo, hi;   // range of ips compiled
+    u32*   offsets;  // ip - lo -> offset into mem (JIT_NONE if that ip wasn't compiled)
+} JitCode;
+
+#define JIT_NONE 0xFFFFFFFFu
+
+/**
+ * compile a bytecode function. on failure (out of memory, no mapping) it just stays interpreted
+ * @param vm the vm fn belongs to (already through vm_load)
+ * @param fn a BYTECODE function
+ * @return true if fn->as.bc.jit was filled in
+ */
+bool jit_compile(VM* vm, Func* fn);
+
+/**
+ * run fn's native code from ip on the current frame's window
+ * @return the ip for the interpreter to continue at (ip itself if it isn't compiled)
+ */
+u32 jit_run(VM* vm, Func* fn, u32 ip);
+
+// release fn's native code (if it has any)
+void jit_free(Func* fn);
+
+#endif
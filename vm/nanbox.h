@@ -0,0 +1,147 @@
+/**
+ * @file nanbox.h
+ * @author Noah Mingolelli
+ * @brief the NaN-boxed register layout, an alternative build (VM_NANBOX=1) to measure against the split one
+ * License: GPLv3
+ *
+ * the default register file keeps payloads and tags in two arrays (9 bytes a register, two cache lines touched
+ * per access). this one packs both into a single 8 byte word per register:
+ * - doubles are stored as their bits + NB_BIAS, which moves the negative signaling NaNs with bit 50 set down to
+ *   [0, NB_LIMIT). hardware never makes those, and every double that comes in from outside (constants, globals,
+ *   returns) has its NaNs canonicalized, so typed double ops store without checking anything
+ * - everything below NB_LIMIT is boxed: tag in bits 46..48, payload in bits 0..45 (sign extended for i64)
+ * - a payload that doesn't fit 46 bits (big i64/u64, pointers past 2^46) sets NB_WIDE and goes to the register's
+ *   slot in a side array. nothing touches its pages unless something wide shows up, so it costs no memory
+ *
+ * an all zero word is NUL, same as a fresh split register. the handlers don't know which layout they're on, they
+ * go through the register accessors in typing.h (RTAG/RGET/RSET/...), which land here when VM_NANBOX is on.
+ * the jit and the transpiler only speak the split layout, so this build has neither.
+ */
+#ifndef NANBOX_H
+#define NANBOX_H
+
+#include "typing.h"
+
+#define NB_SHIFT   46
+#define NB_LIMIT   ((u64)1 << 50)                 // words below this are boxed, doubles are at or above it
+#define NB_PAYLOAD (((u64)1 << NB_SHIFT) - 1)
+#define NB_WIDE    ((u64)8 << NB_SHIFT)           // payload is in the side array
+#define NB_BIAS    0x000C000000000000ull          // added to a double's bits
+#define NB_QNAN    0x7FF8000000000000ull          // the one NaN a register ever holds
+
+// tag of a stored word
+static inline u8 nb_tag(u64 s) {
+    return s < NB_LIMIT ? (u8)((s >> NB_SHIFT) & 7) : DOUBLE;
+}
+
+// payload bits of a boxed (non double) register, from the side array if it went wide
+static inline u64 nb_bits(const TypedValue* B, const TypedValue* W, u32 r) {
+    u64 s = B[r].u;
+    return LIKELYTRUE(!(s & NB_WIDE)) ? s & NB_PAYLOAD : W[r].u;
+}
+
+// box a non double, spilling to the side array if it doesn't fit
+static inline void nb_set_bits(TypedValue* B, TypedValue* W, u32 r, u8 tag, u64 bits) {
+    bool fits = tag == I64 ? (u64)((i64)(bits << (64 - NB_SHIFT)) >> (64 - NB_SHIFT)) == bits : bits <= NB_PAYLOAD;
+    if (LIKELYTRUE(fits)) {
+        B[r].u = (u64)tag << NB_SHIFT | (bits & NB_PAYLOAD);
+        return;
+    }
+    W[r].u = bits;
+    B[r].u = (u64)tag << NB_SHIFT | NB_WIDE;
+}
+
+// typed reads (the type was already checked, or proven)
+static inline i64 nb_get_i(const TypedValue* B, const TypedValue* W, u32 r) {
+    u64 s = B[r].u;
+    return LIKELYTRUE(!(s & NB_WIDE)) ? (i64)(s << (64 - NB_SHIFT)) >> (64 - NB_SHIFT) : W[r].i;
+}
+
+static inline u64 nb_get_u(const TypedValue* B, const TypedValue* W, u32 r) {
+    return nb_bits(B, W, r);
+}
+
+static inline float nb_get_f(const TypedValue* B, const TypedValue* W, u32 r) {
+    TypedValue v;
+    v.u = nb_bits(B, W, r);
+    return v.f;
+}
+
+static inline double nb_get_d(const TypedValue* B, const TypedValue* W, u32 r) {
+    (void)W;
+    TypedValue v;
+    v.u = B[r].u - NB_BIAS;
+    return v.d;
+}
+
+static inline Func* nb_get_fn(const TypedValue* B, const TypedValue* W, u32 r) {
+    TypedValue v;
+    v.u = nb_bits(B, W, r);
+    return v.fn;
+}
+
+static inline void* nb_get_obj(const TypedValue* B, const TypedValue* W, u32 r) {
+    TypedValue v;
+    v.u = nb_bits(B, W, r);
+    return v.obj;
+}
+
+// typed writes
+static inline void nb_set_i(TypedValue* B, TypedValue* W, u32 r, u8 tag, i64 v) {
+    nb_set_bits(B, W, r, tag, (u64)v);
+}
+
+static inline void nb_set_u(TypedValue* B, TypedValue* W, u32 r, u8 tag, u64 v) {
+    nb_set_bits(B, W, r, tag, v);
+}
+
+static inline void nb_set_f(TypedValue* B, TypedValue* W, u32 r, u8 tag, float v) {
+    TypedValue t;
+    t.u = 0;
+    t.f = v;
+    nb_set_bits(B, W, r, tag, t.u);
+}
+
+static inline void nb_set_obj(TypedValue* B, TypedValue* W, u32 r, u8 tag, void* v) {
+    TypedValue t;
+    t.u = 0;
+    t.obj = v;
+    nb_set_bits(B, W, r, tag, t.u);
+}
+
+// arithmetic only ever makes quiet NaNs, so no canonicalizing here
+static inline void nb_set_d(TypedValue* B, TypedValue* W, u32 r, u8 tag, double v) {
+    (void)W; (void)tag;
+    TypedValue t;
+    t.d = v;
+    B[r].u = t.u + NB_BIAS;
+}
+
+// any value from outside the register file (a constant, a global, a return value) in its split form
+static inline void nb_store(TypedValue* B, TypedValue* W, u32 r, u8 tag, TypedValue v) {
+    if (tag != DOUBLE) {
+        nb_set_bits(B, W, r, tag, v.u);
+        return;
+    }
+    if (v.d != v.d) v.u = NB_QNAN;
+    B[r].u = v.u + NB_BIAS;
+}
+
+// and back out to the split form
+static inline TypedValue nb_load(const TypedValue* B, const TypedValue* W, u32 r) {
+    u64 s = B[r].u;
+    TypedValue v;
+    if (s >= NB_LIMIT) v.u = s - NB_BIAS;
+    else if (s & NB_WIDE) v = W[r];
+    else if (((s >> NB_SHIFT) & 7) == I64) v.i = (i64)(s << (64 - NB_SHIFT)) >> (64 - NB_SHIFT);
+    else v.u = s & NB_PAYLOAD;
+    return v;
+}
+
+static inline void nb_copy(TypedValue* B, TypedValue* W, u32 dst, u32 src) {
+    u64 s = B[src].u;
+    B[dst].u = s;
+    if (s < NB_LIMIT && (s & NB_WIDE)) W[dst] = W[src];
+}
+
+#endif
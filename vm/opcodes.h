@@ -38,7 +38,7 @@ typedef enum {
     // CURRENTLY DONE UP TO HERE (WITH THE EXCEPTION OF JMPIF)
 
     // call stack
-    CALL,      // create a stack frame and jump
+    CALL,      // create a stack frame and jump. CALL func argc dest, args in func+1.. become the callee's r0..
     TAILCALL,  // reuse current stack frame for another call
     RET,       // return to caller
 
@@ -55,7 +55,7 @@ typedef enum {
     SAR,       // arithmetic shift right src1 by src2 and store in src0 (signed ints only)
 
     // heap
-    NEWARR,    // dst = new array(length)
+    NEWARR,    // dst = new array(length). src2 is the element type (I64/U64/FLOAT/DOUBLE/BOOL packed, NUL tagged)
     NEWTABLE,  // dst = new hashmap
     NEWOBJ,    // dst = instance/struct with fields
 
@@ -69,8 +69,8 @@ typedef enum {
     ARRLEN,    // dst = length(arr)
 
     // strings
-    CONCAT,    // dst = str(src1) + str(src2)
-    STRLEN,    // dst = length(str) MAY REMOVE TO TREAT STRINGS AS ARRAYS OF CHARS
+    CONCAT,    // dst = src1 + src2 (both strings)
+    STRLEN,    // dst = length(str) in bytes
 
     // conversions
     I2D,       // int to double. dst = (double)src1
@@ -119,7 +119,78 @@ typedef enum {
     // typed bitwise ops (integer only)
     AND_U, OR_U, XOR_U, SHL_U, SHR_U, BNOT_U,
 
+    // generic numeric ops. same layout as the i64 set but they take whatever numeric type both sources share
+    // (i64, u64, f32, f64, MOD is ints only). a mismatch is still a type mismatch panic. they don't switch
+    // on type every time, the first run rewrites the instruction into a typed handler (see quicken.h)
+    ADD_N, SUB_N, MUL_N, DIV_N, MOD_N,
+    NEG_N,
+    EQ_N, NEQ_N, GT_N, GE_N, LT_N, LE_N,
+
+    // immediate forms (i64). src2 is a signed 8 bit immediate instead of a register: dst = src1 op imm.
+    // saves the LOADI (and the scratch register, and its tag write) on counters and small constants
+    ADDI, SUBI, MULI,
+    SHLI, SHRI,    // shift by imm & 63
+    EQI, NEQI, GTI, GEI, LTI, LEI,
+
+    // operand prefix for the next instruction. its a/b/c are the high bytes of the next op's a/b/c, so registers
+    // go up to 16 bits, and LOADC/LOADG/STOREG (and JMPTABLE) take next.b | prefix.b << 8 | prefix.c << 16 as a
+    // 24 bit pool index (the next op's b is the low byte, the prefix's b and c the two above it).
+    // folded in at load, the next op runs exactly like a narrow one and the prefix itself is a no-op
+    WIDE,
+
+    // numeric for loops. src0 = index, src0+1 = limit, src0+2 = step, src1/src2 = signed 16 bit offset.
+    // the body runs while index < limit (index > limit for a negative step), the index is the loop variable
+    FORPREP,   // skip past the loop if it runs zero times, panic on a zero step (i64)
+    FORLOOP,   // index += step, jump back to the body if it runs again (i64). one dispatch per iteration
+    FORPREP_D, FORLOOP_D,  // same for f64
+
+    // multi way branch. src0 = selector (i64), src1 = const index of the table: consts[src1] is the case count,
+    // the next count consts are offsets (relative to the next instruction, like every jump). a selector
+    // outside 0..count-1 falls through. the whole table is checked and resolved at load
+    JMPTABLE,
+
+    // bulk array ops (see array.h), the whole array in one dispatch
+    ARRFILL,   // arr[0..len) = val. ARRFILL arr val
+    ARRCOPY,   // dst[0..n) = src[0..n), same element type. ARRCOPY dst src n
+    ARRSUM,    // dst = sum of arr (numeric, or bool for a count of trues). ARRSUM dst arr
+    ARRADD,    // arr[i] += val for every element (numeric, val the same type). ARRADD arr val
+
     // more here
+
+    OPCODE_COUNT,  // how many opcodes can show up in a .stk file. anything at or above this on disk is invalid
+
+    /**
+     * internal opcodes. these never come from a file, the loader rewrites instructions into them
+     * when it decodes the stream (see decode.c). still have to fit in a byte.
+     */
+    TRAP = OPCODE_COUNT,  // panic with the code in src0. load time errors that only fire if they're actually reached
+
+    // superinstructions (see fuse.h), each one covers a pair and skips the second half when it's done.
+    // compare src1 and src2, jump to the branch's target if the result matches its sense (JMPIF or JMPIFZ).
+    // src0 still gets the BOOL unless nothing could read it. same order as EQ..LE so they map by offset
+    JEQ, JNEQ, JGT, JGE, JLT, JLE,
+    JEQ_U, JNEQ_U, JGT_U, JGE_U, JLT_U, JLE_U,
+    JEQ_D, JNEQ_D, JGT_D, JGE_D, JLT_D, JLE_D,
+
+    // a load feeding an add/sub. src0 = src1 OP constant, src2 is the register the load wrote (kept if live)
+    ADD_KI, SUB_KI,  // i64 constant (LOADI, or LOADC of an I64)
+    ADD_KD, SUB_KD,  // f64 constant (LOADC of a DOUBLE)
+
+    // quickened generic ops (see quicken.h), one per generic op and type (I = i64, U = u64, F = f32, D = f64).
+    // same work as the typed op but the type guard always runs, even in the unchecked loop. a miss turns the
+    // instruction back into the generic op stored in aux instead of panicking
+    ADD_QI, ADD_QU, ADD_QF, ADD_QD,
+    SUB_QI, SUB_QU, SUB_QF, SUB_QD,
+    MUL_QI, MUL_QU, MUL_QF, MUL_QD,
+    DIV_QI, DIV_QU, DIV_QF, DIV_QD,
+    MOD_QI, MOD_QU,
+    NEG_QI, NEG_QU, NEG_QF, NEG_QD,
+    EQ_QI,  EQ_QU,  EQ_QF,  EQ_QD,
+    NEQ_QI, NEQ_QU, NEQ_QF, NEQ_QD,
+    GT_QI,  GT_QU,  GT_QF,  GT_QD,
+    GE_QI,  GE_QU,  GE_QF,  GE_QD,
+    LT_QI,  LT_QU,  LT_QF,  LT_QD,
+    LE_QI,  LE_QU,  LE_QF,  LE_QD,
 } Opcode;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,79 @@
+/**
+ * @file quicken.h
+ * @author Noah Mingolelli
+ * @brief type quickening for the generic numeric ops (ADD_N..LE_N)
+ * License: GPLv3
+ *
+ * a generic op doesn't know its type until it runs. the first time it does it looks at its sources,
+ * rewrites itself in place into the quickened handler for that type (ADD_N on two i64s -> ADD_QI), and
+ * reruns. from then on it costs the same as the typed op plus one tag compare, no switch on type.
+ *
+ * the generic op is kept in aux. when a quickened guard misses (the site saw another type) it puts the
+ * generic op back and reruns, which quickens it again for the new type. a site that keeps flipping just
+ * pays a couple of extra dispatches per flip, it never panics unless the types really don't work.
+ *
+ * the verifier does the same ahead of time: a generic op whose source types it proved becomes the plain
+ * typed op (ADD_N on proven i64s -> ADD) with no guard at all, which the fusion pass can then pick up.
+ */
+#ifndef QUICKEN_H
+#define QUICKEN_H
+
+#include "vm.h"
+
+#define GENERIC_COUNT (LE_N - ADD_N + 1)
+
+// one entry per numeric type tag, 0 (HALT) where there's no variant for that type
+#define QROW(I, U, F, D) { [I64] = (I), [U64] = (U), [FLOAT] = (F), [DOUBLE] = (D) }
+
+// generic op -> quickened (guarded) handler, what the run loop rewrites to
+static const u8 QUICK_GUARDED[GENERIC_COUNT][CALLABLE + 1] = {
+    [ADD_N - ADD_N] = QROW(ADD_QI, ADD_QU, ADD_QF, ADD_QD),
+    [SUB_N - ADD_N] = QROW(SUB_QI, SUB_QU, SUB_QF, SUB_QD),
+    [MUL_N - ADD_N] = QROW(MUL_QI, MUL_QU, MUL_QF, MUL_QD),
+    [DIV_N - ADD_N] = QROW(DIV_QI, DIV_QU, DIV_QF, DIV_QD),
+    [MOD_N - ADD_N] = QROW(MOD_QI, MOD_QU, 0, 0),
+    [NEG_N - ADD_N] = QROW(NEG_QI, NEG_QU, NEG_QF, NEG_QD),
+    [EQ_N  - ADD_N] = QROW(EQ_QI,  EQ_QU,  EQ_QF,  EQ_QD),
+    [NEQ_N - ADD_N] = QROW(NEQ_QI, NEQ_QU, NEQ_QF, NEQ_QD),
+    [GT_N  - ADD_N] = QROW(GT_QI,  GT_QU,  GT_QF,  GT_QD),
+    [GE_N  - ADD_N] = QROW(GE_QI,  GE_QU,  GE_QF,  GE_QD),
+    [LT_N  - ADD_N] = QROW(LT_QI,  LT_QU,  LT_QF,  LT_QD),
+    [LE_N  - ADD_N] = QROW(LE_QI,  LE_QU,  LE_QF,  LE_QD),
+};
+
+// generic op -> plain typed op, what the verifier rewrites proven sites to
+static const u8 QUICK_TYPED[GENERIC_COUNT][CALLABLE + 1] = {
+    [ADD_N - ADD_N] = QROW(ADD, ADD_U, ADD_F, ADD_D),
+    [SUB_N - ADD_N] = QROW(SUB, SUB_U, SUB_F, SUB_D),
+    [MUL_N - ADD_N] = QROW(MUL, MUL_U, MUL_F, MUL_D),
+    [DIV_N - ADD_N] = QROW(DIV, DIV_U, DIV_F, DIV_D),
+    [MOD_N - ADD_N] = QROW(MOD, MOD_U, 0, 0),
+    [NEG_N - ADD_N] = QROW(NEG, NEG_U, NEG_F, NEG_D),
+    [EQ_N  - ADD_N] = QROW(EQ,  EQ_U,  EQ_F,  EQ_D),
+    [NEQ_N - ADD_N] = QROW(NEQ, NEQ_U, NEQ_F, NEQ_D),
+    [GT_N  - ADD_N] = QROW(GT,  GT_U,  GT_F,  GT_D),
+    [GE_N  - ADD_N] = QROW(GE,  GE_U,  GE_F,  GE_D),
+    [LT_N  - ADD_N] = QROW(LT,  LT_U,  LT_F,  LT_D),
+    [LE_N  - ADD_N] = QROW(LE,  LE_U,  LE_F,  LE_D),
+};
+
+#undef QROW
+
+// is this one of the generic ops
+static inline bool is_generic(u8 op) {
+    return op >= ADD_N && op <= LE_N;
+}
+
+/**
+ * what a generic op becomes for a type
+ * @param op the generic op
+ * @param type the type tag its sources share
+ * @param guarded true for the quickened handler (runtime), false for the plain typed op (proven sites)
+ * @return the op to rewrite to, or 0 if that type has no variant (a type mismatch)
+ */
+static inline u8 quicken_op(u8 op, u8 type, bool guarded) {
+    if (!is_generic(op) || type > CALLABLE) return 0;
+    return guarded ? QUICK_GUARDED[op - ADD_N][type] : QUICK_TYPED[op - ADD_N][type];
+}
+
+#endif
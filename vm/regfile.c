@@ -0,0 +1,130 @@
+/**
+ * @file regfile.c
+ * @author Noah Mingolelli
+ * @brief reserving and committing the register file. see regfile.h
+ * License: GPLv3
+ */
+// mmap/mprotect/madvise aren't c99, ask for them before anything pulls in a libc header
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "regfile.h"
+
+#if REGS_RESERVE && defined(_WIN32)
+#include <windows.h>
+#elif REGS_RESERVE
+#include <sys/mman.h>
+#endif
+
+// payloads first, tags (or the NaN-boxed side array) right after. MAX_REGISTERS is a multiple of REG_CHUNK so
+// the second half starts page aligned
+#define PAYLOAD_BYTES ((size_t)MAX_REGISTERS * sizeof(TypedValue))
+#define RESERVE_BYTES (PAYLOAD_BYTES + (size_t)MAX_REGISTERS * REG_SIDE_SIZE)
+
+#if VM_NANBOX
+#define SIDE(regs) ((regs)->wide)
+#define SIDE_TYPE  TypedValue
+#else
+#define SIDE(regs) ((regs)->types)
+#define SIDE_TYPE  u8
+#endif
+
+// past this many committed payload bytes the file gets the huge page hint
+#define HUGE_BYTES ((size_t)2 << 20)
+
+#if REGS_RESERVE
+// address space with no access (NULL if there isn't any), made read/write a stretch at a time. fresh pages are
+// zeroed either way
+static void* reserve(size_t bytes) {
+  #ifdef _WIN32
+    return VirtualAlloc(NULL, bytes, MEM_RESERVE, PAGE_NOACCESS);
+  #else
+    void* mem = mmap(NULL, bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return mem == MAP_FAILED ? NULL : mem;
+  #endif
+}
+
+static bool commit(void* at, size_t bytes) {
+  #ifdef _WIN32
+    return VirtualAlloc(at, bytes, MEM_COMMIT, PAGE_READWRITE) != NULL;
+  #else
+    return mprotect(at, bytes, PROT_READ | PROT_WRITE) == 0;
+  #endif
+}
+
+static void release(void* mem, size_t bytes) {
+  #ifdef _WIN32
+    (void)bytes;
+    VirtualFree(mem, 0, MEM_RELEASE);
+  #else
+    munmap(mem, bytes);
+  #endif
+}
+#endif
+
+Registers* regs_new(void) {
+    Registers* regs = (Registers*)calloc(1, sizeof(Registers));
+    if (!regs) return NULL;
+
+#if REGS_RESERVE
+    void* mem = reserve(RESERVE_BYTES);
+    if (!mem) {
+        free(regs);
+        return NULL;
+    }
+    regs->payloads = (TypedValue*)mem;
+    SIDE(regs) = (SIDE_TYPE*)((u8*)mem + PAYLOAD_BYTES);
+#else
+    regs->payloads = (TypedValue*)calloc(MAX_REGISTERS, sizeof(TypedValue));
+    SIDE(regs) = (SIDE_TYPE*)calloc(MAX_REGISTERS, REG_SIDE_SIZE);
+    if (!regs->payloads || !SIDE(regs)) {
+        regs_free(regs);
+        return NULL;
+    }
+    regs->committed = MAX_REGISTERS;
+#endif
+    return regs;
+}
+
+bool regs_commit(Registers* regs, u32 need) {
+    if (need <= regs->committed) return true;
+    if (need > MAX_REGISTERS) return false;
+
+#if REGS_RESERVE
+    // round up to a chunk and at least double, so a deep recursion grows in a handful of syscalls
+    u32 to = (need + REG_CHUNK - 1) & ~(REG_CHUNK - 1);
+    if (to < regs->committed * 2) to = regs->committed * 2;
+    if (to > MAX_REGISTERS) to = MAX_REGISTERS;
+
+    // only the new stretch of each half, the committed part keeps its pages
+    u32 from = regs->committed;
+    if (!commit(regs->payloads + from, (size_t)(to - from) * sizeof(TypedValue))) return false;
+    if (!commit(SIDE(regs) + from, (size_t)(to - from) * REG_SIDE_SIZE)) return false;
+
+  #if VM_HUGEPAGES && defined(MADV_HUGEPAGE)
+    // just a hint, the kernel can ignore it (or not have thp at all) and nothing changes
+    if ((size_t)to * sizeof(TypedValue) >= HUGE_BYTES && (size_t)from * sizeof(TypedValue) < HUGE_BYTES) {
+        madvise(regs->payloads, PAYLOAD_BYTES, MADV_HUGEPAGE);
+    }
+  #endif
+
+    regs->committed = to;
+#endif
+    return true;
+}
+
+void regs_free(Registers* regs) {
+    if (!regs) return;
+#if REGS_RESERVE
+    if (regs->payloads) release(regs->payloads, RESERVE_BYTES);
+#else
+    free(regs->payloads);
+    free(SIDE(regs));
+#endif
+    free(regs);
+}
+
+void regs_move(Registers* regs, u32 dst, u32 src, u32 n) {
+    memmove(&regs->payloads[dst], &regs->payloads[src], n * sizeof(TypedValue));
+    memmove(&SIDE(regs)[dst], &SIDE(regs)[src], n * REG_SIDE_SIZE);
+}
@@ -0,0 +1,49 @@
+/**
+ * @file regfile.h
+ * @author Noah Mingolelli
+ * @brief the register file: reserved up front, committed as frames grow into it
+ * License: GPLv3
+ *
+ * every vm gets MAX_REGISTERS payloads and tags worth of address space, but only as a reservation (one mmap with
+ * no access). nothing is touched until a frame needs it, then regs_commit makes the next stretch read/write in
+ * REG_CHUNK steps. fresh pages come back zeroed from the kernel (every tag NUL) so there's no memset either, a short
+ * script costs one mmap and one mprotect no matter how big MAX_REGISTERS is.
+ *
+ * the reservation never moves, so R/T pointers into it (the run loop's, native code's) stay good across a grow.
+ * once the committed payloads pass a huge page, the whole reservation gets a transparent huge page hint so deep
+ * workloads take fewer tlb misses (build with -DVM_HUGEPAGES=0 to skip that).
+ *
+ * windows does the same with VirtualAlloc (MEM_RESERVE, then MEM_COMMIT a stretch at a time). anything with
+ * neither (REGS_RESERVE 0, typing.h) callocs the whole file and calls it committed, MAX_REGISTERS is 64K there.
+ */
+#ifndef REGFILE_H
+#define REGFILE_H
+
+#include "typing.h"
+
+// registers committed per step (128K of payloads + 16K of tags, whole pages for anything up to 16K pages)
+#define REG_CHUNK (1u << 14)
+
+#ifndef VM_HUGEPAGES
+#define VM_HUGEPAGES 1
+#endif
+
+/**
+ * reserve a register file with nothing committed yet
+ * @return the file, or NULL if there's no address space (or memory) for it
+ */
+Registers* regs_new(void);
+
+/**
+ * commit registers up to need (a no-op if they already are)
+ * @return false if need is past MAX_REGISTERS or the memory couldn't be committed
+ */
+bool regs_commit(Registers* regs, u32 need);
+
+// release the reservation (NULL is fine)
+void regs_free(Registers* regs);
+
+// move n registers from src to dst, tags (or wide payloads) and all. the ranges can overlap
+void regs_move(Registers* regs, u32 dst, u32 src, u32 n);
+
+#endif
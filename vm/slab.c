@@ -0,0 +1,107 @@
+/**
+ * @file slab.c
+ * @author Noah Mingolelli
+ * @brief the size class slab allocator. see slab.h
+ * License: GPLv3
+ */
+#include <stdlib.h>
+#include "slab.h"
+
+const u32 slab_sizes[SLAB_CLASSES] = {
+    16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512, 640, 768, 1024, 1280, 1536, 2048,
+};
+
+// size / SLAB_GRAIN (rounded up) -> the smallest class that fits
+const u8 slab_classes[SLAB_MAX / SLAB_GRAIN + 1] = {
+     0,  0,  1,  2,  3,  4,  5,  6,  7,  8,  8,  9,  9, 10, 10, 11,
+    11, 12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15,
+    15, 16, 16, 16, 16, 16, 16, 16, 16, 17, 17, 17, 17, 17, 17, 17,
+    17, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18, 18,
+    18, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19, 19,
+    19, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20,
+    20, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21,
+    21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21,
+    21,
+};
+
+// incoming is shared with whoever calls slab_give, gcc/clang atomics where there are any (there's no thread to
+// share it with otherwise)
+#if defined(__GNUC__)
+#define take_incoming(slot)   __atomic_exchange_n(slot, NULL, __ATOMIC_ACQUIRE)
+#define peek_incoming(slot)   __atomic_load_n(slot, __ATOMIC_RELAXED)
+#else
+static void* take_incoming(void** slot) {
+    void* head = *slot;
+    *slot = NULL;
+    return head;
+}
+#define peek_incoming(slot) (*(slot))
+#endif
+
+void* slab_alloc_slow(Slab* slab, u32 cls) {
+    // whatever's been given back since the free list ran out, all of it at once (nothing to ABA)
+    if (peek_incoming(&slab->incoming[cls])) {
+        void* block = take_incoming(&slab->incoming[cls]);
+        if (block) {
+            slab->free[cls] = slab_next(block);
+            slab->stats[cls].allocs++;
+            return block;
+        }
+    }
+
+    // carve off the newest page, or start another
+    SlabPage* page = slab->pages[cls];
+    if (!page || page->used == page->cap) {
+        page = (SlabPage*)malloc(SLAB_PAGE);
+        if (!page) return NULL;
+        *page = (SlabPage){
+            .next = slab->pages[cls], .block = slab_sizes[cls],
+            .cap = (u32)((SLAB_PAGE - SLAB_HEADER) / slab_sizes[cls]), .cls = (u8)cls,
+        };
+        slab->pages[cls] = page;
+        slab->stats[cls].pages++;
+    }
+    slab->stats[cls].allocs++;
+    return slab_block(page, page->used++);
+}
+
+void slab_give(Slab* slab, u32 cls, void* head, void* tail) {
+#if defined(__GNUC__)
+    void* old = __atomic_load_n(&slab->incoming[cls], __ATOMIC_RELAXED);
+    do {
+        slab_next(tail) = old;
+    } while (!__atomic_compare_exchange_n(&slab->incoming[cls], &old, head, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+#else
+    slab_next(tail) = slab->incoming[cls];
+    slab->incoming[cls] = head;
+#endif
+}
+
+void slab_detach(Slab* slab, SlabPage** pages) {
+    for (u32 c = 0; c < SLAB_CLASSES; c++) {
+        pages[c] = slab->pages[c];
+        slab->pages[c] = NULL;
+        slab->free[c] = NULL;
+        (void)take_incoming(&slab->incoming[c]);
+    }
+}
+
+void slab_attach(Slab* slab, SlabPage** pages) {
+    for (u32 c = 0; c < SLAB_CLASSES; c++) {
+        if (!pages[c]) continue;
+        SlabPage** tail = &slab->pages[c];
+        while (*tail) tail = &(*tail)->next;
+        *tail = pages[c];
+        pages[c] = NULL;
+    }
+}
+
+void slab_release(Slab* slab) {
+    for (u32 c = 0; c < SLAB_CLASSES; c++) {
+        for (SlabPage* page = slab->pages[c], *next; page; page = next) {
+            next = page->next;
+            free(page);
+        }
+    }
+    *slab = (Slab){0};
+}
@@ -0,0 +1,106 @@
+/**
+ * @file slab.h
+ * @author Noah Mingolelli
+ * @brief size class slab allocator, where old generation objects (and the vm's Funcs) come from
+ * License: GPLv3
+ *
+ * anything up to SLAB_MAX bytes is rounded up to one of SLAB_CLASSES block sizes, picked for ObjHeader prefixed
+ * objects (16 byte steps while they're small, spacing out as they grow so the rounding never wastes much more than
+ * a quarter). every class has its own pages (SLAB_PAGE bytes of one block size each) and its own free list
+ * threaded through the first word of its free blocks. allocating is a pop off that list, or carving the next
+ * block off the newest page, malloc only ever sees whole pages.
+ *
+ * pages are kept per class in a list, so whoever owns what's in them (the gc's sweep) walks them linearly block
+ * by block, no side table of objects needed. blocks that come free go back in whole chains through slab_give,
+ * which is lock free: another thread can hand blocks back while the owner keeps allocating, and the owner only
+ * takes the whole incoming list at once when its own runs dry. fragmentation stays bounded by the page, a page
+ * with nothing left alive in it can be handed back to the system whole.
+ *
+ * anything bigger than SLAB_MAX isn't the slab's problem, the gc keeps those in its large object space.
+ */
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "typing.h"
+
+// bytes per page (header included)
+#define SLAB_PAGE (64u * 1024u)
+
+// biggest block, and the step the class table is indexed in
+#define SLAB_MAX     2048
+#define SLAB_GRAIN   16
+#define SLAB_CLASSES 22
+
+// one page of blocks, all the same size. the blocks start at SLAB_HEADER
+typedef struct SlabPage {
+    struct SlabPage* next;
+    u32 block;  // block size
+    u32 cap;    // blocks that fit
+    u32 used;   // blocks carved so far, past that it's never been touched
+    u32 live;   // blocks still in use as of the last walk
+    u8  cls;
+} SlabPage;
+
+#define SLAB_HEADER ((sizeof(SlabPage) + SLAB_GRAIN - 1) & ~(size_t)(SLAB_GRAIN - 1))
+
+// a free block keeps the next one in its first word
+#define slab_next(block) (*(void**)(block))
+
+// per class counters. allocs and pages are the owner's, frees are whatever the caller adds back in
+typedef struct {
+    u64 allocs;     // blocks handed out
+    u64 frees;      // blocks given back
+    u32 pages;      // pages held right now
+} SlabStats;
+
+typedef struct {
+    SlabPage* pages[SLAB_CLASSES];  // every page in a class, newest (the one being carved) first
+    void* free[SLAB_CLASSES];       // the owner's
+    void* incoming[SLAB_CLASSES];   // slab_give's, taken over by the owner when free runs dry
+    SlabStats stats[SLAB_CLASSES];
+} Slab;
+
+extern const u32 slab_sizes[SLAB_CLASSES];
+extern const u8 slab_classes[SLAB_MAX / SLAB_GRAIN + 1];
+
+// the class a size (1 to SLAB_MAX) rounds up to
+static inline u32 slab_class(u32 size) {
+    return slab_classes[(size + SLAB_GRAIN - 1) / SLAB_GRAIN];
+}
+
+// the ith block of a page
+static inline void* slab_block(SlabPage* page, u32 i) {
+    return (u8*)page + SLAB_HEADER + (size_t)i * page->block;
+}
+
+// slow path of slab_alloc: take what's been given back, or carve (a new page if need be). NULL if out of memory
+void* slab_alloc_slow(Slab* slab, u32 cls);
+
+/**
+ * allocate a block (uninitialized) of at least size bytes. a zeroed Slab is an empty one, there's no init
+ * @param slab the slab to take it from
+ * @param size 1 to SLAB_MAX
+ * @return the block, or NULL if there's no memory for a new page
+ */
+static inline void* slab_alloc(Slab* slab, u32 size) {
+    u32 cls = slab_class(size);
+    void* block = slab->free[cls];
+    if (!block) return slab_alloc_slow(slab, cls);
+    slab->free[cls] = slab_next(block);
+    slab->stats[cls].allocs++;
+    return block;
+}
+
+// give a chain of free blocks (head to tail, all of class cls) back. safe from another thread
+void slab_give(Slab* slab, u32 cls, void* head, void* tail);
+
+// take every page out of the slab (into pages) and forget every free block, the slab carries on with new pages
+void slab_detach(Slab* slab, SlabPage** pages);
+
+// put detached pages back in (behind the slab's own, so the one being carved stays first)
+void slab_attach(Slab* slab, SlabPage** pages);
+
+// give every page back to the system, the slab's empty (and reusable) afterwards
+void slab_release(Slab* slab);
+
+#endif
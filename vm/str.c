@@ -0,0 +1,345 @@
+/**
+ * @file str.c
+ * @author Noah Mingolelli
+ * @brief strings and the intern set. see str.h
+ * License: GPLv3
+ */
+#include "str.h"
+
+// fnv-1a over the bytes, mixed (0 is kept for not worked out yet)
+static u64 hash_bytes(const char* bytes, size_t len) {
+    u64 h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (u8)bytes[i];
+        h *= 0x100000001b3ull;
+    }
+    h = hash_mix(h ^ len);
+    return h ? h : 1;
+}
+
+static bool oom(VM* vm) {
+    vm->panic_code = PANIC_OOM;
+    return false;
+}
+
+// an inline string's bytes, and one made from them (len <= STR_INLINE)
+static inline u64 inline_bytes(TypedValue val) {
+    return val.u >> 8;
+}
+
+static inline TypedValue inline_make(u64 bytes, size_t len) {
+    return (TypedValue){ .u = OBJ_INLINE | (u64)len << 1 | bytes << 8 };
+}
+
+static TypedValue inline_from(const char* p, size_t len) {
+    u64 bytes = 0;
+    for (size_t i = 0; i < len; i++) bytes |= (u64)(u8)p[i] << (8 * i);
+    return inline_make(bytes, len);
+}
+
+// copy an inline or flat string's bytes out
+static void copy_out(TypedValue val, char* dst) {
+    if (obj_inline(val)) {
+        u64 bytes = inline_bytes(val);
+        for (size_t i = 0, n = str_length(val); i < n; i++) dst[i] = (char)(bytes >> (8 * i));
+        return;
+    }
+    ObjString* s = (ObjString*)val.obj;
+    memcpy(dst, s->data, s->length);
+}
+
+u64 str_hash(TypedValue val) {
+    if (obj_inline(val)) return hash_mix(val.u);
+    ObjString* s = (ObjString*)val.obj;
+    if (!s->hash) s->hash = hash_bytes(s->data, s->length);
+    return s->hash;
+}
+
+bool str_equal(TypedValue a, TypedValue b) {
+    if (a.u == b.u) return true;
+    // short strings are only ever inline, so an inline one can't equal a flat one
+    if (obj_inline(a) || obj_inline(b)) return false;
+    ObjString* x = (ObjString*)a.obj;
+    ObjString* y = (ObjString*)b.obj;
+    return x->length == y->length && str_hash(a) == str_hash(b) && memcmp(x->data, y->data, x->length) == 0;
+}
+
+// slot of the interned string with these bytes (found), or the one it'd go in. there's always an empty slot
+static u32 intern_slot(Interns* in, const char* bytes, size_t len, u64 hash, bool* found) {
+    u32 mask = in->cap - 1;
+    u32 tomb = UINT32_MAX;
+    for (u32 i = (u32)hash & mask;; i = (i + 1) & mask) {
+        ObjString* s = in->items[i];
+        if (!s) {
+            *found = false;
+            return tomb != UINT32_MAX ? tomb : i;
+        }
+        if (s == INTERN_TOMB) {
+            if (tomb == UINT32_MAX) tomb = i;
+        } else if (s->hash == hash && s->length == len && memcmp(s->data, bytes, len) == 0) {
+            *found = true;
+            return i;
+        }
+    }
+}
+
+// rebuild the set with room for twice what's in it, tombstones gone
+static bool intern_resize(Interns* in) {
+    u32 cap = 64;
+    while (cap < 4 * ((u64)in->count + 1)) cap *= 2;
+    ObjString** items = calloc(cap, sizeof(ObjString*));
+    if (!items) return false;
+
+    for (u32 i = 0; i < in->cap; i++) {
+        ObjString* s = in->items[i];
+        if (!s || s == INTERN_TOMB) continue;
+        u32 j = (u32)s->hash & (cap - 1);
+        while (items[j]) j = (j + 1) & (cap - 1);
+        items[j] = s;
+    }
+    free(in->items);
+    in->items = items;
+    in->cap = cap;
+    in->used = in->count;
+    return true;
+}
+
+ObjString* str_intern(VM* vm, const char* bytes, size_t len) {
+    Interns* in = &vm->interns;
+    u64 hash = hash_bytes(bytes, len);
+    bool found;
+    if (in->cap) {
+        u32 i = intern_slot(in, bytes, len, hash, &found);
+        if (found) return in->items[i];
+    }
+
+    if (len > STR_MAX) {
+        oom(vm);
+        return NULL;
+    }
+    ObjString* s = (ObjString*)gc_alloc_old(vm, &vm->gc, OBJ_STRING, (u32)(sizeof(ObjString) + len + 1));
+    if (!s) return NULL;
+    s->length = len;
+    s->hash = hash;
+    memcpy(s->data, bytes, len);
+    s->data[len] = '\0';
+
+    // that allocation could have run a collection that pruned the set, so the slot's looked up again
+    if ((u64)(in->used + 1) * 4 > (u64)in->cap * 3 && !intern_resize(in)) {
+        oom(vm);
+        return NULL;
+    }
+    u32 i = intern_slot(in, bytes, len, hash, &found);
+    if (!in->items[i]) in->used++;
+    in->items[i] = s;
+    in->count++;
+    return s;
+}
+
+// a young flat string of len bytes, filled in by the caller
+static ObjString* flat_new(VM* vm, size_t len) {
+    if (len > STR_MAX) {
+        oom(vm);
+        return NULL;
+    }
+    ObjString* s = (ObjString*)gc_alloc(vm, &vm->gc, OBJ_STRING, (u32)(sizeof(ObjString) + len + 1));
+    if (!s) return NULL;
+    s->length = len;
+    s->hash = 0;
+    s->data[len] = '\0';
+    return s;
+}
+
+// a + b for a result no longer than STR_FLAT_MAX, both inline or flat. inline if it fits, otherwise interned, or
+// a plain young string for a piece of a rope (those are mostly garbage by the next append)
+static bool concat_short(VM* vm, TypedValue a, TypedValue b, bool intern, TypedValue* dst) {
+    size_t la = str_length(a), lb = str_length(b);
+    if (la + lb <= STR_INLINE) {
+        *dst = inline_make(inline_bytes(a) | inline_bytes(b) << (8 * la), la + lb);
+        return true;
+    }
+    char buf[STR_FLAT_MAX];
+    copy_out(a, buf);
+    copy_out(b, buf + la);
+    ObjString* s = intern ? str_intern(vm, buf, la + lb) : flat_new(vm, la + lb);
+    if (!s) return false;
+    if (!intern) memcpy(s->data, buf, la + lb);
+    dst->obj = s;
+    return true;
+}
+
+bool str_concat(VM* vm, u8 atag, TypedValue a, u8 btag, TypedValue b, TypedValue* dst) {
+    if (LIKELYFALSE(!str_is(atag, a) || !str_is(btag, b))) {
+        vm->panic_code = PANIC_TYPE_MISMATCH;
+        return false;
+    }
+    a = str_flat(a);
+    b = str_flat(b);
+    size_t la = str_length(a), lb = str_length(b);
+    if (la == 0 || lb == 0) {
+        *dst = la ? a : b;
+        return true;
+    }
+    if (la + lb > STR_MAX) return oom(vm);
+    if (la + lb <= STR_FLAT_MAX) return concat_short(vm, a, b, true, dst);
+
+    // a short piece onto a rope whose right end is short too: the two get merged, so a string appended to a
+    // character at a time doesn't turn into a node per character
+    TypedValue left = a, right = b;
+    bool merge = false;
+    if (lb <= STR_FLAT_MAX && str_unflat(OBJ, a)) {
+        ObjRope* ra = (ObjRope*)a.obj;
+        if (str_length(ra->right) + lb <= STR_FLAT_MAX) {
+            left = ra->left;
+            right = str_flat(ra->right);
+            merge = true;
+        }
+    }
+
+    // the halves are rooted across the allocations (inline ones are skipped by the collector). b's bytes are
+    // copied out before anything's allocated for a merge, so it doesn't need to be
+    if (!gc_add_root(&vm->gc, (ObjHeader**)&left.obj)) return oom(vm);
+    if (!gc_add_root(&vm->gc, (ObjHeader**)&right.obj)) {
+        gc_remove_root(&vm->gc, (ObjHeader**)&left.obj);
+        return oom(vm);
+    }
+    ObjRope* rope = NULL;
+    if (!merge || concat_short(vm, right, b, false, &right)) {
+        rope = (ObjRope*)gc_alloc(vm, &vm->gc, OBJ_ROPE, sizeof(ObjRope));
+    }
+    gc_remove_root(&vm->gc, (ObjHeader**)&right.obj);
+    gc_remove_root(&vm->gc, (ObjHeader**)&left.obj);
+    if (!rope) return false;
+
+    rope->length = la + lb;
+    rope->hash = 0;
+    rope->left = left;
+    rope->right = right;
+    rope->flat = NULL;
+    dst->obj = rope;
+    return true;
+}
+
+bool str_flatten(VM* vm, ObjRope* rope) {
+    if (rope->flat) return true;
+
+    ObjHeader* root = &rope->header;
+    if (!gc_add_root(&vm->gc, &root)) return oom(vm);
+    ObjString* flat = flat_new(vm, rope->length);
+    gc_remove_root(&vm->gc, &root);
+    if (!flat) return false;
+    rope = (ObjRope*)root;
+
+    // filled from the end: pop a piece, a rope pushes its left then right half (so right comes off first). ropes
+    // can be as deep as they are long, so it's a heap stack rather than recursion. nothing here allocates on the
+    // gc heap, nothing moves
+    size_t cap = 64, top = 0;
+    TypedValue* stack = malloc(cap * sizeof(TypedValue));
+    if (!stack) return oom(vm);
+    stack[top++] = rope->left;
+    stack[top++] = rope->right;
+
+    size_t end = rope->length;
+    while (top > 0) {
+        TypedValue piece = stack[--top];
+        if (str_unflat(OBJ, piece)) {
+            if (top + 2 > cap) {
+                TypedValue* grown = realloc(stack, 2 * cap * sizeof(TypedValue));
+                if (!grown) {
+                    free(stack);
+                    return oom(vm);
+                }
+                stack = grown;
+                cap *= 2;
+            }
+            ObjRope* r = (ObjRope*)piece.obj;
+            stack[top++] = r->left;
+            stack[top++] = r->right;
+            continue;
+        }
+        piece = str_flat(piece);
+        end -= str_length(piece);
+        copy_out(piece, flat->data + end);
+    }
+    free(stack);
+
+    gc_barrier(&vm->gc, &rope->header, OBJ, (TypedValue){ .obj = flat });
+    rope->flat = flat;
+    rope->left = rope->right = STR_EMPTY;
+    return true;
+}
+
+static bool bad_const(VM* vm) {
+    vm->panic_code = PANIC_CONST_READ;
+    return false;
+}
+
+bool str_load(VM* vm) {
+    // the pool's only read only once it's loaded
+    u8* types = (u8*)vm->consttypes;
+    TypedValue* vals = (TypedValue*)vm->consts;
+    u32 count = vm->constcount;
+
+    // every descriptor goes nul first, a collection partway through only ever sees finished strings. the
+    // lengths are kept in place and the bytes are U64s, so the second pass can find them again
+    u32* at = malloc(((size_t)count + 1) * sizeof(u32));
+    if (!at) return oom(vm);
+    u32 n = 0;
+    for (u32 i = 0; i < count; i++) {
+        if (types[i] != OBJ) continue;
+        TypedValue v = vals[i];
+        if (obj_inline(v)) {
+            // canonical or it won't compare equal: nothing past the length, no stray bits in the low byte
+            size_t len = (v.u >> 1) & 7;
+            if ((v.u & 0xF0) || inline_bytes(v) >> (8 * len)) {
+                free(at);
+                return bad_const(vm);
+            }
+            continue;
+        }
+        u64 len = v.u >> 1;
+        u64 words = (len + 7) / 8;
+        if (len > STR_MAX || words > (u64)count - i - 1) {
+            free(at);
+            return bad_const(vm);
+        }
+        for (u64 w = 1; w <= words; w++) {
+            if (types[i + w] != U64) {
+                free(at);
+                return bad_const(vm);
+            }
+        }
+        types[i] = NUL;
+        at[n++] = i;
+        i += (u32)words;
+    }
+
+    for (u32 k = 0; k < n; k++) {
+        u32 i = at[k];
+        size_t len = (size_t)(vals[i].u >> 1);
+        char* buf = malloc(len + 8);
+        if (!buf) {
+            free(at);
+            return oom(vm);
+        }
+        for (size_t j = 0; j < len; j++) buf[j] = (char)(vals[i + 1 + j / 8].u >> (8 * (j % 8)));
+
+        TypedValue v;
+        if (len <= STR_INLINE) {
+            v = inline_from(buf, len);
+        } else {
+            ObjString* s = str_intern(vm, buf, len);
+            if (!s) {
+                free(buf);
+                free(at);
+                return false;
+            }
+            v.obj = s;
+        }
+        free(buf);
+        vals[i] = v;
+        types[i] = OBJ;
+    }
+    free(at);
+    return true;
+}
@@ -0,0 +1,113 @@
+/**
+ * @file str.h
+ * @author Noah Mingolelli
+ * @brief strings (CONCAT, STRLEN, string constants, the intern set)
+ * License: GPLv3
+ *
+ * a string is an OBJ value in one of three forms, and which one is decided by length alone:
+ * - up to STR_INLINE bytes: inline, the bytes live in the payload itself (low bit set, length in bits 1..3, bytes
+ *   from bit 8 up, everything else zero). nothing allocated, nothing for the collector, and two short strings
+ *   are equal exactly when their payloads are
+ * - flat (ObjString): length, hash and the bytes. anything up to STR_FLAT_MAX goes through the vm's intern set,
+ *   so every short string a program builds over and over is one object (interned strings are allocated old and
+ *   the set is weak, see prune_interns)
+ * - a rope (ObjRope): CONCAT of anything longer just points at its two halves. the bytes get copied into one
+ *   flat string the first time something needs them in one piece (a table key), and the halves are let go then.
+ *   a short piece going onto the end of a rope whose own right end is short gets merged with it instead, so
+ *   appending in a loop doesn't make a node per character. CONCAT is O(1) (at most STR_FLAT_MAX bytes copied),
+ *   so a string built up in a loop costs O(n) overall, paid once when it's flattened
+ *
+ * length is O(1) for all three (ropes and flat strings keep it in the same spot). a flat string's hash is worked
+ * out once and cached in it, string constants and interned strings get theirs when they're made.
+ *
+ * constants: an OBJ constant in a file is a string. with its low bit set it's an inline one, exactly as it sits in
+ * a register. otherwise the payload is the byte length << 1, and the bytes follow in the next (length + 7) / 8
+ * constants (U64, little endian). str_load turns those into interned strings at load, they stay alive with the
+ * pool.
+ */
+#ifndef STR_H
+#define STR_H
+
+#include "vm.h"
+
+// longest string that fits in a payload
+#define STR_INLINE 7
+
+// longest CONCAT result copied into a flat (interned) string, anything past it is a rope
+#define STR_FLAT_MAX 32
+
+// longest string there can be (its ObjString has to fit an ObjHeader's u32 size)
+#define STR_MAX ((size_t)UINT32_MAX - sizeof(ObjString) - GC_ALIGN)
+
+// ""
+#define STR_EMPTY ((TypedValue){ .u = OBJ_INLINE })
+
+// murmur3's finalizer, every input bit reaches every output bit
+static inline u64 hash_mix(u64 x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+// is (tag, val) a string, in any form
+static inline bool str_is(u8 tag, TypedValue val) {
+    if (tag != OBJ || !val.obj) return false;
+    if (obj_inline(val)) return true;
+    ObjKind kind = obj_kind((ObjHeader*)val.obj);
+    return kind == OBJ_STRING || kind == OBJ_ROPE;
+}
+
+// a string (any form) whose bytes aren't in one piece yet: a rope nothing has flattened
+static inline bool str_unflat(u8 tag, TypedValue val) {
+    return tag == OBJ && val.obj && !obj_inline(val) && obj_kind((ObjHeader*)val.obj) == OBJ_ROPE
+        && !((ObjRope*)val.obj)->flat;
+}
+
+// length of a string, any form
+static inline size_t str_length(TypedValue val) {
+    return obj_inline(val) ? (size_t)((val.u >> 1) & 7) : ((ObjString*)val.obj)->length;
+}
+
+// a flattened rope's flat string, anything else (a rope that isn't flat yet too) as is
+static inline TypedValue str_flat(TypedValue val) {
+    if (!obj_inline(val) && obj_kind((ObjHeader*)val.obj) == OBJ_ROPE && ((ObjRope*)val.obj)->flat) {
+        val.obj = ((ObjRope*)val.obj)->flat;
+    }
+    return val;
+}
+
+// hash of an inline or flat string (cached in a flat one)
+u64 str_hash(TypedValue val);
+
+// are two inline or flat strings the same bytes
+bool str_equal(TypedValue a, TypedValue b);
+
+/**
+ * dst = a + b
+ * @return false with vm->panic_code set if either isn't a string, or out of memory
+ */
+bool str_concat(VM* vm, u8 atag, TypedValue a, u8 btag, TypedValue b, TypedValue* dst);
+
+/**
+ * copy a rope's bytes into one flat string (rope->flat) and let go of its halves. can collect
+ * @return false with vm->panic_code set if out of memory
+ */
+bool str_flatten(VM* vm, ObjRope* rope);
+
+/**
+ * the interned string with these bytes, made (old) if there isn't one yet. can collect, so bytes can't point
+ * into the heap
+ * @return the string, or NULL with vm->panic_code set
+ */
+ObjString* str_intern(VM* vm, const char* bytes, size_t len);
+
+/**
+ * build the string constants (see the top of this file) once the pool's been split
+ * @return false with vm->panic_code set on a bad one (PANIC_CONST_READ) or out of memory
+ */
+bool str_load(VM* vm);
+
+#endif
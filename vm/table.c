@@ -0,0 +1,276 @@
+/**
+ * @file table.c
+ * @author Noah Mingolelli
+ * @brief the hash table. see table.h
+ * License: GPLv3
+ */
+#include "table.h"
+#include "str.h"
+
+#if VM_SIMD
+#include <emmintrin.h>
+#endif
+
+// group masks, bit i for slot i of the group. groups are 16 bytes in but the object's only GC_ALIGN aligned
+
+// slots whose control byte is b
+static inline u32 group_match(const u8* ctrl, u8 b) {
+#if VM_SIMD
+    __m128i g = _mm_loadu_si128((const __m128i*)ctrl);
+    return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)b)));
+#else
+    u32 m = 0;
+    for (u32 i = 0; i < TABLE_GROUP; i++) m |= (u32)(ctrl[i] == b) << i;
+    return m;
+#endif
+}
+
+// empty or deleted slots (the top bit's only set on those, so it's just the sign bits)
+static inline u32 group_free(const u8* ctrl) {
+#if VM_SIMD
+    return (u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+#else
+    u32 m = 0;
+    for (u32 i = 0; i < TABLE_GROUP; i++) m |= (u32)(ctrl[i] >> 7) << i;
+    return m;
+#endif
+}
+
+// first set bit of a non zero mask
+static inline u32 lowest(u32 m) {
+#if defined(__GNUC__)
+    return (u32)__builtin_ctz(m);
+#else
+    u32 i = 0;
+    while (!(m & 1)) {
+        m >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+static inline u64 key_hash(u8 tag, TypedValue key) {
+    if (tag == OBJ) return str_hash(key);
+    return hash_mix(key.u + tag * 0x9e3779b97f4a7c15ull);
+}
+
+// put a key in the form it's stored and compared in (only the float's 4 bytes, -0 as 0, bools as 0 or 1).
+// false if it can't be a key
+static bool key_canon(u8 tag, TypedValue* key) {
+    switch (tag) {
+        case BOOL:
+            key->u = (u8)key->u != 0;
+            return true;
+        case FLOAT: {
+            TypedValue k = { .u = 0 };
+            k.f = key->f == 0.0f ? 0.0f : key->f;
+            *key = k;
+            return true;
+        }
+        case DOUBLE:
+            if (key->d == 0.0) key->d = 0.0;
+            return true;
+        case I64: case U64: case CALLABLE:
+            return true;
+        case OBJ:
+            // a rope is keyed by its flat string, the interpreter flattens it before it gets here
+            if (!str_is(tag, *key) || str_unflat(tag, *key)) return false;
+            *key = str_flat(*key);
+            return true;
+        default:
+            return false;
+    }
+}
+
+static inline bool key_equal(u8 tag, TypedValue a, TypedValue b) {
+    return tag == OBJ ? str_equal(a, b) : a.u == b.u;
+}
+
+// where key is in s, if it's there
+static bool find(ObjSlots* s, u8 tag, TypedValue key, u64 hash, u32* at) {
+    const u8* ctrl = slots_ctrl(s);
+    const u8* keytypes = slots_keytypes(s);
+    const TypedValue* keys = slots_keys(s);
+    u32 mask = s->cap / TABLE_GROUP - 1;
+    u32 g = (u32)(hash >> 7) & mask;
+    u8 h2 = (u8)(hash & 0x7F);
+
+    for (u32 step = 1;; step++) {
+        const u8* group = ctrl + (size_t)g * TABLE_GROUP;
+        for (u32 m = group_match(group, h2); m; m &= m - 1) {
+            u32 i = g * TABLE_GROUP + lowest(m);
+            if (keytypes[i] == tag && key_equal(tag, keys[i], key)) {
+                *at = i;
+                return true;
+            }
+        }
+        if (group_match(group, CTRL_EMPTY)) return false;
+        g = (g + step) & mask;
+    }
+}
+
+// put a key that isn't in s yet into the first free slot on its probe (s has room, see table_full)
+static void place(VM* vm, ObjSlots* s, u64 hash, u8 ktag, TypedValue key, u8 vtag, TypedValue val) {
+    u8* ctrl = slots_ctrl(s);
+    u32 mask = s->cap / TABLE_GROUP - 1;
+    u32 g = (u32)(hash >> 7) & mask;
+    u32 free;
+    for (u32 step = 1; !(free = group_free(ctrl + (size_t)g * TABLE_GROUP)); step++) g = (g + step) & mask;
+
+    u32 i = g * TABLE_GROUP + lowest(free);
+    if (ctrl[i] == CTRL_EMPTY) s->used++;
+    s->live++;
+    ctrl[i] = (u8)(hash & 0x7F);
+    gc_barrier(&vm->gc, &s->header, ktag, key);
+    gc_barrier(&vm->gc, &s->header, vtag, val);
+    slots_keys(s)[i] = key;
+    slots_vals(s)[i] = val;
+    slots_keytypes(s)[i] = ktag;
+    slots_valtypes(s)[i] = vtag;
+}
+
+// empty slot i. it can go back to empty (and stop being used) if its group has an empty slot anyway, no probe
+// goes past that group, otherwise it's left deleted so the probes through it keep going
+static void erase(ObjSlots* s, u32 i) {
+    u8* ctrl = slots_ctrl(s);
+    if (group_match(ctrl + (i & ~(u32)(TABLE_GROUP - 1)), CTRL_EMPTY)) {
+        ctrl[i] = CTRL_EMPTY;
+        s->used--;
+    } else {
+        ctrl[i] = CTRL_DELETED;
+    }
+    s->live--;
+    slots_keytypes(s)[i] = NUL;
+    slots_valtypes(s)[i] = NUL;
+}
+
+// move up to groups of the old slots' groups into the new ones, and drop the old ones once they're empty
+static void migrate(VM* vm, ObjTable* t, u32 groups) {
+    ObjSlots* from = t->old;
+    ObjSlots* to = t->slots;
+    u8* ctrl = slots_ctrl(from);
+    u8* keytypes = slots_keytypes(from);
+    u8* valtypes = slots_valtypes(from);
+    TypedValue* keys = slots_keys(from);
+    TypedValue* vals = slots_vals(from);
+    u32 end = from->cap / TABLE_GROUP;
+
+    for (; groups > 0 && t->next < end && from->live > 0; groups--, t->next++) {
+        u32 base = t->next * TABLE_GROUP;
+        for (u32 full = ~group_free(ctrl + base) & 0xFFFF; full; full &= full - 1) {
+            u32 i = base + lowest(full);
+            place(vm, to, key_hash(keytypes[i], keys[i]), keytypes[i], keys[i], valtypes[i], vals[i]);
+            // deleted rather than erased, a lookup can still be probing through here for a key not moved yet
+            ctrl[i] = CTRL_DELETED;
+            keytypes[i] = valtypes[i] = NUL;
+            from->live--;
+        }
+    }
+
+    if (from->live == 0) {
+        t->old = NULL;
+        t->next = t->stride = 0;
+    }
+}
+
+static bool mismatch(VM* vm) {
+    vm->panic_code = PANIC_TYPE_MISMATCH;
+    return false;
+}
+
+static ObjSlots* slots_new(VM* vm, u32 cap) {
+    u32 size = (u32)(sizeof(ObjSlots) + (size_t)cap * (2 * sizeof(TypedValue) + 3));
+    ObjSlots* s = (ObjSlots*)gc_alloc(vm, &vm->gc, OBJ_SLOTS, size);
+    if (!s) return NULL;
+    s->cap = cap;
+    s->used = s->live = s->pad = 0;
+    memset(slots_ctrl(s), CTRL_EMPTY, cap);
+    memset(slots_keytypes(s), NUL, 2 * (size_t)cap);
+    return s;
+}
+
+ObjTable* table_new(VM* vm) {
+    ObjTable* t = (ObjTable*)gc_alloc(vm, &vm->gc, OBJ_TABLE, sizeof(ObjTable));
+    if (!t) return NULL;
+    t->slots = t->old = NULL;
+    t->next = t->stride = 0;
+    return t;
+}
+
+bool table_grow(VM* vm, ObjTable** tp) {
+    ObjTable* t = *tp;
+
+    // the stride should have finished this already, but a full table can't wait for it
+    if (t->old) migrate(vm, t, UINT32_MAX);
+    if (!table_full(t)) return true;
+
+    // twice what's live, so there's room for as many inserts again while the old slots get moved
+    u32 live = t->slots ? t->slots->live : 0;
+    u32 cap = TABLE_MIN;
+    while (cap < TABLE_MAX && table_limit(cap) < 2 * (u64)live) cap *= 2;
+    if (table_limit(cap) <= live) {
+        vm->panic_code = PANIC_OOM;
+        return false;
+    }
+
+    if (!gc_add_root(&vm->gc, (ObjHeader**)tp)) {
+        vm->panic_code = PANIC_OOM;
+        return false;
+    }
+    ObjSlots* fresh = slots_new(vm, cap);
+    gc_remove_root(&vm->gc, (ObjHeader**)tp);
+    if (!fresh) return false;
+
+    t = *tp;
+    gc_barrier(&vm->gc, &t->header, OBJ, (TypedValue){ .obj = fresh });
+    t->old = live ? t->slots : NULL;
+    t->slots = fresh;
+    if (t->old) {
+        u32 groups = t->old->cap / TABLE_GROUP;
+        u32 room = table_limit(cap) - live;
+        t->next = 0;
+        t->stride = (groups + room - 1) / room;
+    }
+    return true;
+}
+
+bool table_get(VM* vm, ObjTable* t, u8 ktag, TypedValue key, u8* tag, TypedValue* val) {
+    if (!key_canon(ktag, &key)) return mismatch(vm);
+    *tag = NUL;
+    val->u = 0;
+    if (!t->slots) return true;
+
+    u64 hash = key_hash(ktag, key);
+    ObjSlots* s = t->slots;
+    u32 i;
+    if (find(s, ktag, key, hash, &i) || ((s = t->old) && find(s, ktag, key, hash, &i))) {
+        *tag = slots_valtypes(s)[i];
+        *val = slots_vals(s)[i];
+    }
+    return true;
+}
+
+bool table_set(VM* vm, ObjTable* t, u8 ktag, TypedValue key, u8 vtag, TypedValue val) {
+    if (!key_canon(ktag, &key)) return mismatch(vm);
+    if (t->old) migrate(vm, t, t->stride);
+
+    // an existing key gets updated wherever it is (it moves over with its group later), a new one goes in the
+    // new slots
+    u64 hash = key_hash(ktag, key);
+    ObjSlots* s = t->slots;
+    u32 i;
+    if (!(s && find(s, ktag, key, hash, &i)) && !((s = t->old) && find(s, ktag, key, hash, &i))) {
+        if (vtag != NUL) place(vm, t->slots, hash, ktag, key, vtag, val);
+        return true;
+    }
+
+    if (vtag == NUL) {
+        erase(s, i);
+        return true;
+    }
+    gc_barrier(&vm->gc, &s->header, vtag, val);
+    slots_valtypes(s)[i] = vtag;
+    slots_vals(s)[i] = val;
+    return true;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file table.h
+ * @author Noah Mingolelli
+ * @brief hash tables (NEWTABLE, GETELEM, SETELEM)
+ * License: GPLv3
+ *
+ * open addressing, swiss table style. every slot has a control byte: empty, deleted, or the low 7 bits of its
+ * key's hash. slots are probed TABLE_GROUP at a time, the home group picked by the rest of the hash and the ones
+ * after it triangular (1, 2, 3.. groups on), which visits every group of a power of two table. one sse2 compare
+ * of a group's control bytes against the 7 bit hash finds the handful of slots worth comparing keys in (about one
+ * in 128 is a false hit), and a probe ends at the first group with an empty slot. with VM_SIMD off the same
+ * masks come out of a plain loop.
+ *
+ * the slots live in their own object (ObjSlots, heap.h), split like the register file: key payloads, value
+ * payloads, control bytes, key tags, value tags. a probe only touches control bytes until something matches.
+ *
+ * keys are anything but nul and objects that aren't strings (other objects move when they're promoted, so they
+ * can't be hashed by address). numbers are keyed by type and value (1 and 1u are different keys, -0.0 is 0.0),
+ * strings by contents (any form, see str.h), hashed once and cached in the string. storing nul deletes the key, a
+ * missing key reads back as nul.
+ *
+ * growing is incremental: once the slots fill up to 7/8 a new set gets allocated (sized for twice what's live)
+ * and the old one is kept around, then every SETELEM moves `stride` more of its groups over. stride is picked so
+ * the move is done before the new slots could fill, so one insert never pays for a whole rehash. while it's
+ * going a key is in exactly one of the two, lookups try the new slots then the old.
+ */
+#ifndef TABLE_H
+#define TABLE_H
+
+#include "vm.h"
+
+// slots per control group, one sse2 compare
+#define TABLE_GROUP 16
+
+// fewest slots a table grows to, and the most it can have (an ObjSlots has to fit an ObjHeader's u32 size)
+#define TABLE_MIN 16
+#define TABLE_MAX (1u << 26)
+
+// full slots (deleted included) a set of slots takes before it grows, 7/8
+#define table_limit(cap) ((cap) - (cap) / 8)
+
+// control bytes. a full slot's is its hash's low 7 bits, so the top bit means free
+#define CTRL_EMPTY   0x80
+#define CTRL_DELETED 0xFE
+
+// does t need to grow before it can take another key
+static inline bool table_full(ObjTable* t) {
+    return !t->slots || t->slots->used >= table_limit(t->slots->cap);
+}
+
+// a new empty table (no slots until the first key). NULL with vm->panic_code set if out of memory
+ObjTable* table_new(VM* vm);
+
+/**
+ * make room for another key: finish moving out of the old slots if it's still resizing, and if that's not enough
+ * allocate new ones and start moving. can collect, *t is updated if the table moves
+ * @return false with vm->panic_code set if out of memory
+ */
+bool table_grow(VM* vm, ObjTable** t);
+
+/**
+ * look key up
+ * @param tag where the value's tag goes (NUL if it's missing)
+ * @return false with vm->panic_code set if key can't be a key
+ */
+bool table_get(VM* vm, ObjTable* t, u8 ktag, TypedValue key, u8* tag, TypedValue* val);
+
+/**
+ * t[key] = val, or delete key if val is nul. a new key needs room (see table_full/table_grow), never allocates
+ * @return false with vm->panic_code set if key can't be a key
+ */
+bool table_set(VM* vm, ObjTable* t, u8 ktag, TypedValue key, u8 vtag, TypedValue val);
+
+#endif
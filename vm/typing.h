@@ -25,6 +25,9 @@
  * - u32 entry_ip;    (instruction index where function starts)
  * - u16 argc;        (number of arguments)
  * - u16 regc;        (number of registers needed)
+ * - u32 calls;       (call counter for the jit)
+ * - JitCode* jit;    (native code once it's hot, NULL until then)
+ * - AotFn aot;       (ahead of time transpiled version, if the build has one)
  *
  * NativeFunc -> struct, fields:
  * - NativeFn fn;          (pointer to the C native function)
@@ -37,6 +40,21 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <math.h>
+
+// register layout: split payload/tag arrays (default), or one NaN-boxed word a register (see nanbox.h)
+#ifndef VM_NANBOX
+#define VM_NANBOX 0
+#endif
+
+// sse2 for the bulk array ops and table probes (see array.h, table.h). -DVM_SIMD=0 for the portable loops
+#ifndef VM_SIMD
+  #if defined(__SSE2__)
+    #define VM_SIMD 1
+  #else
+    #define VM_SIMD 0
+  #endif
+#endif
 
 // various aliases (as i hate how long stdint names r)
 typedef uint8_t  u8;
@@ -79,46 +97,176 @@ enum Type {
 // starting amount of registers for entry frame
 #define BASE_REGISTERS 16
 
-// max amount of registers and frames we can grow to
-#define MAX_REGISTERS 65536
-#define MAX_FRAMES 256
+// can the register file be reserved and committed as it grows (mmap, VirtualAlloc on windows). without that it's
+// allocated whole up front, so the max drops back to something that's cheap to calloc
+#ifndef REGS_RESERVE
+#if defined(__unix__) || defined(__APPLE__) || defined(_WIN32)
+#define REGS_RESERVE 1
+#else
+#define REGS_RESERVE 0
+#endif
+#endif
+
+// max amount of registers and frames we can grow to. registers are only reserved up to the max, they get
+// committed as frames reach them (see regfile.h) so this costs address space, not memory. keep it a multiple of REG_CHUNK
+#ifndef MAX_REGISTERS
+#if REGS_RESERVE
+#define MAX_REGISTERS (1u << 24)
+#else
+#define MAX_REGISTERS (1u << 16)
+#endif
+#endif
+// frames live in FRAME_SEG sized segments (vm.h) so this is only a ceiling, nothing is allocated for it up front.
+// a vm starts with this as its maxframes, lower that after vm_init for a tighter limit
+#ifndef MAX_FRAMES
+#define MAX_FRAMES (1u << 22)
+#endif
+
+// register access for the handlers, so one set of them builds against either layout. R (and T, or W for the
+// NaN-boxed side array) point at the current frame's window, r is frame relative
+// - RTAG(r): its tag
+// - RGET(r, FIELD) / RSET(r, TAG, FIELD, v): read it as / write it from a TypedValue field (the type is known)
+// - RLOAD(r) / RSTORE(r, TAG, v): the whole value in split form, for anything coming from or going to a pool
+// - RCOPY(dst, src): tag and value
+#if VM_NANBOX
+  #define RTAG(r)                nb_tag(R[r].u)
+  #define RGET(r, FIELD)         nb_get_##FIELD(R, W, (r))
+  #define RSET(r, TAG, FIELD, v) nb_set_##FIELD(R, W, (r), (TAG), (v))
+  #define RLOAD(r)               nb_load(R, W, (r))
+  #define RSTORE(r, TAG, v)      nb_store(R, W, (r), (TAG), (v))
+  #define RCOPY(dst, src)        nb_copy(R, W, (dst), (src))
+#else
+  #define RTAG(r)                T[r]
+  #define RGET(r, FIELD)         R[r].FIELD
+  #define RSET(r, TAG, FIELD, v) do { T[r] = (TAG); R[r].FIELD = (v); } while (0)
+  #define RLOAD(r)               R[r]
+  #define RSTORE(r, TAG, v)      do { T[r] = (TAG); R[r] = (v); } while (0)
+  #define RCOPY(dst, src)        do { T[dst] = T[src]; R[dst] = R[src]; } while (0)
+#endif
 
 // typed operations/type conversions (ugly but it works and is cycle light)
-// type requirement will be removed in prod once i add a verifier
-// macro helpers for typed arithmetic and comparisons
+// type requirements only exist in the checked loop, programs the verifier proved run with VM_CHECKED 0 (see interp.h)
+// macro helpers for typed arithmetic and comparisons. these run inside vm_run on the decoded
+// instruction `in`, reading and writing registers through the accessors above
+#define CHECK_TYPE(TYPE, TAG) (!VM_CHECKED || require_type(vm, (TYPE), (TAG)))
 #define BINOP_TYPED(TAG, FIELD, OP) do { \
-    u32 dest, lhs, rhs; \
-    if (!binop_indices(vm, ins, &dest, &lhs, &rhs)) return false; \
-    if (!require_type(vm, lhs, (TAG)) || !require_type(vm, rhs, (TAG))) return false; \
-    vm->regs->types[dest] = (TAG); \
-    vm->regs->payloads[dest].FIELD = vm->regs->payloads[lhs].FIELD OP vm->regs->payloads[rhs].FIELD; \
+    if (!CHECK_TYPE(RTAG(in->b), (TAG)) || !CHECK_TYPE(RTAG(in->c), (TAG))) return false; \
+    RSET(in->a, (TAG), FIELD, RGET(in->b, FIELD) OP RGET(in->c, FIELD)); \
 } while (0)
 
 #define CMPOP_TYPED(TAG, FIELD, OP) do { \
-    u32 dest, lhs, rhs; \
-    if (!binop_indices(vm, ins, &dest, &lhs, &rhs)) return false; \
-    if (!require_type(vm, lhs, (TAG)) || !require_type(vm, rhs, (TAG))) return false; \
-    vm->regs->types[dest] = BOOL; \
-    vm->regs->payloads[dest].u = (vm->regs->payloads[lhs].FIELD OP vm->regs->payloads[rhs].FIELD) ? 1u : 0u; \
+    if (!CHECK_TYPE(RTAG(in->b), (TAG)) || !CHECK_TYPE(RTAG(in->c), (TAG))) return false; \
+    RSET(in->a, BOOL, u, (RGET(in->b, FIELD) OP RGET(in->c, FIELD)) ? 1u : 0u); \
 } while (0)
 
 #define UNOP_TYPED(TAG, FIELD, OP) do { \
-    u32 idx; \
-    if (!unary_index(vm, ins, &idx)) return false; \
-    if (!require_type(vm, idx, (TAG))) return false; \
-    vm->regs->types[idx] = (TAG); \
-    vm->regs->payloads[idx].FIELD = OP vm->regs->payloads[idx].FIELD; \
+    if (!CHECK_TYPE(RTAG(in->a), (TAG))) return false; \
+    RSET(in->a, (TAG), FIELD, OP RGET(in->a, FIELD)); \
 } while (0)
 
 // conversion helper (dest = op_a, src = op_b)
-#define CAST_TYPED(SRC_TAG, SRC_FIELD, DST_TAG, DST_FIELD, EXPR) do { \
-    u32 dest = op_a(ins) + vm->current->base; \
-    u32 src  = op_b(ins) + vm->current->base; \
-    u32 need = (dest > src ? dest : src) + 1; \
-    if (!ensure_regs(vm, need)) return false; \
-    if (!require_type(vm, src, (SRC_TAG))) return false; \
-    vm->regs->types[dest] = (DST_TAG); \
-    vm->regs->payloads[dest].DST_FIELD = (EXPR); \
+#define CAST_TYPED(SRC_TAG, SRC_FIELD, DST_TAG, DST_FIELD, CTYPE) do { \
+    if (!CHECK_TYPE(RTAG(in->b), (SRC_TAG))) return false; \
+    RSET(in->a, (DST_TAG), DST_FIELD, (CTYPE)RGET(in->b, SRC_FIELD)); \
+} while (0)
+
+// immediate forms (i64 only), the right hand side was sign extended into x.imm at load
+#define BINI_I64(OP) do { \
+    if (!CHECK_TYPE(RTAG(in->b), I64)) return false; \
+    RSET(in->a, I64, i, RGET(in->b, i) OP in->x.imm); \
+} while (0)
+
+#define CMPI_I64(OP) do { \
+    if (!CHECK_TYPE(RTAG(in->b), I64)) return false; \
+    RSET(in->a, BOOL, u, (RGET(in->b, i) OP in->x.imm) ? 1u : 0u); \
+} while (0)
+
+// numeric for loops (a = index, a + 1 = limit, a + 2 = step). the step's sign is its sign bit so i64 and f64
+// (-0.0 and NaN included) pick a direction the same way in the interpreter, the JIT and stk2c
+#define FOR_GUARD(TAG) (CHECK_TYPE(RTAG(in->a), (TAG)) && CHECK_TYPE(RTAG(in->a + 1), (TAG)) && CHECK_TYPE(RTAG(in->a + 2), (TAG)))
+#define FOR_NEG_i(r) (RGET(r, i) < 0)
+#define FOR_NEG_d(r) (signbit(RGET(r, d)) != 0)
+#define FOR_RUNS(FIELD) (FOR_NEG_##FIELD(in->a + 2) ? RGET(in->a, FIELD) > RGET(in->a + 1, FIELD) : RGET(in->a, FIELD) < RGET(in->a + 1, FIELD))
+
+#define FORPREP_TYPED(TAG, FIELD) do { \
+    if (!FOR_GUARD(TAG)) return false; \
+    if (RGET(in->a + 2, FIELD) == 0) { vm->panic_code = PANIC_FOR_STEP; return false; } \
+    if (!FOR_RUNS(FIELD)) pc = code + in->x.target; \
+} while (0)
+
+// i64 steps compare the distance left against the stride (both unsigned) so the index can't overflow past the limit.
+// that distance only means anything while the index is still short of the limit: a body that moved either one
+// past the other would wrap it, so that's checked first (before the step, same as FORPREP's test)
+#define FORLOOP_I64() do { \
+    if (!FOR_GUARD(I64)) return false; \
+    bool near_ = FOR_RUNS(i); \
+    u64 i_ = (u64)RGET(in->a, i), step_ = (u64)RGET(in->a + 2, i); \
+    u64 s_ = (i64)step_ < 0 ? ~(u64)0 : 0; \
+    u64 left_ = (((u64)RGET(in->a + 1, i) - i_) ^ s_) - s_; \
+    u64 stride_ = (step_ ^ s_) - s_; \
+    RSET(in->a, I64, i, (i64)(i_ + step_)); \
+    if (near_ && left_ > stride_) pc = code + in->x.target; \
+} while (0)
+
+#define FORLOOP_F64() do { \
+    if (!FOR_GUARD(DOUBLE)) return false; \
+    RSET(in->a, DOUBLE, d, RGET(in->a, d) + RGET(in->a + 2, d)); \
+    if (FOR_RUNS(d)) pc = code + in->x.target; \
+} while (0)
+
+// fused compare + branch (the branch is the next instruction, so falling through skips it)
+#define CMPJMP_TYPED(TAG, FIELD, OP) do { \
+    if (!CHECK_TYPE(RTAG(in->b), (TAG)) || !CHECK_TYPE(RTAG(in->c), (TAG))) return false; \
+    bool cond = RGET(in->b, FIELD) OP RGET(in->c, FIELD); \
+    if (in->aux & FUSE_KEEP) RSET(in->a, BOOL, u, cond ? 1u : 0u); \
+    STAT(vm->stats.fused++); \
+    pc = (cond == ((in->aux & FUSE_SENSE) != 0)) ? code + in->x.target : pc + 1; \
+} while (0)
+
+// fused load + binop with the loaded constant on the right (KFIELD is where it sits in Inst.x)
+#define BINK_TYPED(TAG, FIELD, KFIELD, OP) do { \
+    if (in->aux & FUSE_KEEP) RSET(in->c, (TAG), FIELD, in->x.KFIELD); \
+    if (!CHECK_TYPE(RTAG(in->b), (TAG))) return false; \
+    RSET(in->a, (TAG), FIELD, RGET(in->b, FIELD) OP in->x.KFIELD); \
+    STAT(vm->stats.fused++); \
+    pc++; \
+} while (0)
+
+// generic op (see quicken.h): rewrite into the quickened handler for the sources' type and rerun it.
+// in == pc[-1] here, pc just points at the code array without the const. no variant is a plain type mismatch
+#define QUICKEN(TYPE_OK, TYPE) do { \
+    u8 quick = (TYPE_OK) ? quicken_op(in->op, (TYPE), true) : 0; \
+    if (LIKELYFALSE(!quick)) { vm->panic_code = PANIC_TYPE_MISMATCH; return false; } \
+    pc[-1].aux = in->op; \
+    pc[-1].op = quick; \
+    STAT(vm->stats.quickened++); \
+    pc--; \
+} while (0)
+
+#define QUICKEN_BINARY() QUICKEN(RTAG(in->b) == RTAG(in->c), RTAG(in->b))
+#define QUICKEN_UNARY()  QUICKEN(true, RTAG(in->a))
+
+// a quickened guard missed, put the generic op back and rerun it so it can quicken for what it sees now
+#define DESPECIALIZE() do { \
+    pc[-1].op = in->aux; \
+    STAT(vm->stats.despecialized++); \
+    pc--; \
+} while (0)
+
+// quickened handlers. same bodies as the typed ops but the guard is real in both loops
+#define QBINOP(TAG, FIELD, OP) do { \
+    if (LIKELYFALSE(RTAG(in->b) != (TAG) || RTAG(in->c) != (TAG))) { DESPECIALIZE(); break; } \
+    RSET(in->a, (TAG), FIELD, RGET(in->b, FIELD) OP RGET(in->c, FIELD)); \
+} while (0)
+
+#define QCMPOP(TAG, FIELD, OP) do { \
+    if (LIKELYFALSE(RTAG(in->b) != (TAG) || RTAG(in->c) != (TAG))) { DESPECIALIZE(); break; } \
+    RSET(in->a, BOOL, u, (RGET(in->b, FIELD) OP RGET(in->c, FIELD)) ? 1u : 0u); \
+} while (0)
+
+#define QUNOP(TAG, FIELD, OP) do { \
+    if (LIKELYFALSE(RTAG(in->a) != (TAG))) { DESPECIALIZE(); break; } \
+    RSET(in->a, (TAG), FIELD, OP RGET(in->a, FIELD)); \
 } while (0)
 
 // aliases for typed ops to remove some clutter
@@ -132,6 +280,10 @@ enum Type {
 #define CMPOP_F32(OP) CMPOP_TYPED(FLOAT, f, OP)
 #define CMPOP_F64(OP) CMPOP_TYPED(DOUBLE, d, OP)
 
+#define CMPJMP_I64(OP) CMPJMP_TYPED(I64, i, OP)
+#define CMPJMP_U64(OP) CMPJMP_TYPED(U64, u, OP)
+#define CMPJMP_F64(OP) CMPJMP_TYPED(DOUBLE, d, OP)
+
 #define UNOP_I64(OP) UNOP_TYPED(I64, i, OP)
 #define UNOP_U64(OP) UNOP_TYPED(U64, u, OP)
 #define UNOP_F32(OP) UNOP_TYPED(FLOAT, f, OP)
@@ -173,15 +325,29 @@ typedef union {
 
 // this is either gonna be a pointer to a val, or a payload containing a value. width is canonical
 // so you can use u8 but extensions r basically noop.
+// both halves live in one reservation of MAX_REGISTERS each (regfile.h), only [0, committed) is backed.
+// NaN-boxed builds keep tag and payload in the one word and have a side array for what doesn't fit (nanbox.h)
 typedef struct {
-    TypedValue payloads[MAX_REGISTERS];
-    u8 types[MAX_REGISTERS];
+    TypedValue* payloads;  // NaN-boxed: the boxed words
+#if VM_NANBOX
+    TypedValue* wide;      // full width payloads of registers marked NB_WIDE
+#else
+    u8* types;
+#endif
+    u32 committed;  // registers that can be touched
+    u32 dirty;      // highest any frame's window has reached since the last collection, nothing above holds an OBJ
 } Registers;
 
+// bytes a register takes in the second array
+#define REG_SIDE_SIZE (VM_NANBOX ? sizeof(TypedValue) : sizeof(u8))
+
 // allow C natives (pointer to a function that takes these args, this is a feature of the language)
 // to be properly passed to value. base is the register index where args start
 typedef void (*NativeFn)(VM* vm, u32 base, u16 argc, u32 dest);
 
+// a bytecode function transpiled ahead of time (see aot.h). runs on the frame's window from ip, returns where to resume
+typedef u32 (*AotFn)(VM* vm, TypedValue* R, u8* T, u32 ip);
+
 // function types
 typedef struct {
     u32 entry_ip;  // instruction index
@@ -189,6 +355,11 @@ typedef struct {
     // TODO: decide if this is 16 bit or 8 bit. instructions only rly allow for 8 bit
     u16 argc;      // how many args this takes
     u16 regc;      // how many registers this call needs when it runs
+    u32 id;        // its slot in vm->funcs (the constant it was loaded from), what a Frame stores instead of a pointer
+
+    u32 calls;             // times called, compiled once it hits JIT_THRESHOLD (see jit.h)
+    struct JitCode* jit;   // native code, NULL while interpreted
+    AotFn aot;             // transpiled version, NULL unless this build has one (takes priority over the jit)
 } BytecodeFunc;
 
 typedef struct {
@@ -0,0 +1,470 @@
+/**
+ * @file verify.c
+ * @author Noah Mingolelli
+ * @brief the verifier itself. see verify.h for what gets proven
+ * License: GPLv3
+ */
+#include "verify.h"
+#include "decode.h"
+#include "quicken.h"
+
+// a register whose type can't be proven on some path
+#define UNKNOWN 0xFF
+
+// unvisited leader
+#define NO_SLOT UINT32_MAX
+
+// generic op the walk hasn't reached
+#define UNSEEN 0xFF
+
+// what a typed op requires from its operands and what it leaves in its dest
+typedef enum { SIG_NONE = 0, SIG_BINARY, SIG_UNARY, SIG_CAST } Shape;
+typedef struct {
+    u8 shape;
+    u8 in;
+    u8 out;
+} Sig;
+
+#define SIG_BIN(T)     { SIG_BINARY, (T), (T) }
+#define SIG_CMP(T)     { SIG_BINARY, (T), BOOL }
+#define SIG_UN(T)      { SIG_UNARY, (T), (T) }
+#define SIG_CONV(S, D) { SIG_CAST, (S), (D) }
+#define SIG_IMM(T)     { SIG_CAST, (T), (T) }   // dest, src, immediate: same register shape as a cast
+#define SIG_CMPI(T)    { SIG_CAST, (T), BOOL }
+
+// every typed op the loop implements (anything missing here and not handled by name in walk() is rejected)
+static const Sig SIGS[256] = {
+    [ADD] = SIG_BIN(I64), [SUB] = SIG_BIN(I64), [MUL] = SIG_BIN(I64), [DIV] = SIG_BIN(I64), [MOD] = SIG_BIN(I64),
+    [AND] = SIG_BIN(I64), [OR]  = SIG_BIN(I64), [XOR] = SIG_BIN(I64), [SHL] = SIG_BIN(I64), [SHR] = SIG_BIN(I64),
+    [EQ]  = SIG_CMP(I64), [NEQ] = SIG_CMP(I64), [GT]  = SIG_CMP(I64), [GE]  = SIG_CMP(I64),
+    [LT]  = SIG_CMP(I64), [LE]  = SIG_CMP(I64),
+    [NEG] = SIG_UN(I64),  [BNOT] = SIG_UN(I64),
+
+    [ADD_U] = SIG_BIN(U64), [SUB_U] = SIG_BIN(U64), [MUL_U] = SIG_BIN(U64), [DIV_U] = SIG_BIN(U64),
+    [MOD_U] = SIG_BIN(U64), [AND_U] = SIG_BIN(U64), [OR_U]  = SIG_BIN(U64), [XOR_U] = SIG_BIN(U64),
+    [SHL_U] = SIG_BIN(U64), [SHR_U] = SIG_BIN(U64),
+    [EQ_U]  = SIG_CMP(U64), [NEQ_U] = SIG_CMP(U64), [GT_U] = SIG_CMP(U64), [GE_U] = SIG_CMP(U64),
+    [LT_U]  = SIG_CMP(U64), [LE_U]  = SIG_CMP(U64),
+    [NEG_U] = SIG_UN(U64),  [BNOT_U] = SIG_UN(U64),
+
+    [ADD_F] = SIG_BIN(FLOAT), [SUB_F] = SIG_BIN(FLOAT), [MUL_F] = SIG_BIN(FLOAT), [DIV_F] = SIG_BIN(FLOAT),
+    [EQ_F]  = SIG_CMP(FLOAT), [NEQ_F] = SIG_CMP(FLOAT), [GT_F] = SIG_CMP(FLOAT), [GE_F] = SIG_CMP(FLOAT),
+    [LT_F]  = SIG_CMP(FLOAT), [LE_F]  = SIG_CMP(FLOAT),
+    [NEG_F] = SIG_UN(FLOAT),
+
+    [ADD_D] = SIG_BIN(DOUBLE), [SUB_D] = SIG_BIN(DOUBLE), [MUL_D] = SIG_BIN(DOUBLE), [DIV_D] = SIG_BIN(DOUBLE),
+    [EQ_D]  = SIG_CMP(DOUBLE), [NEQ_D] = SIG_CMP(DOUBLE), [GT_D] = SIG_CMP(DOUBLE), [GE_D] = SIG_CMP(DOUBLE),
+    [LT_D]  = SIG_CMP(DOUBLE), [LE_D]  = SIG_CMP(DOUBLE),
+    [NEG_D] = SIG_UN(DOUBLE),
+
+    [I2D] = SIG_CONV(I64, DOUBLE), [I2F] = SIG_CONV(I64, FLOAT), [D2I] = SIG_CONV(DOUBLE, I64),
+    [F2I] = SIG_CONV(FLOAT, I64),  [I2U] = SIG_CONV(I64, U64),   [U2I] = SIG_CONV(U64, I64),
+    [U2D] = SIG_CONV(U64, DOUBLE), [U2F] = SIG_CONV(U64, FLOAT), [D2U] = SIG_CONV(DOUBLE, U64),
+    [F2U] = SIG_CONV(FLOAT, U64),
+
+    [ADDI] = SIG_IMM(I64),  [SUBI] = SIG_IMM(I64),  [MULI] = SIG_IMM(I64), [SHLI] = SIG_IMM(I64), [SHRI] = SIG_IMM(I64),
+    [EQI]  = SIG_CMPI(I64), [NEQI] = SIG_CMPI(I64), [GTI]  = SIG_CMPI(I64), [GEI] = SIG_CMPI(I64),
+    [LTI]  = SIG_CMPI(I64), [LEI]  = SIG_CMPI(I64),
+};
+
+// per run state. leaders are program wide, slots/states are reset for every function
+typedef struct {
+    VM* vm;
+    u32 regc;          // register window of the function being walked
+
+    bool* leader;      // icount, true for jump targets and function entries (where paths merge)
+    u32*  slot;        // icount, leader ip -> index into states (NO_SLOT if not reached yet)
+    u32*  owner;       // slot -> leader ip, so slot[] can be reset cheaply
+    u8*   states;      // one regc sized type vector per reached leader
+    u32   nslots;
+    u32   capslots;
+
+    u32*  work;        // leaders waiting to be (re)walked
+    u32   nwork;
+    u32   capwork;
+
+    u8*   cur;         // scratch type vector for the block being walked
+
+    u8*   quick;       // icount, the typed op each generic op can become (0 if unproven, UNSEEN if unreached)
+} Verifier;
+
+// queue a leader to be walked
+static bool push_work(Verifier* v, u32 ip) {
+    if (v->nwork == v->capwork) {
+        u32 cap = v->capwork ? v->capwork * 2 : 64;
+        u32* grown = (u32*)realloc(v->work, cap * sizeof(u32));
+        if (!grown) return false;
+        v->work = grown;
+        v->capwork = cap;
+    }
+    v->work[v->nwork++] = ip;
+    return true;
+}
+
+/**
+ * flow a type vector into a leader. the first path to reach it copies, later ones forget any
+ * register they disagree on. requeues the leader whenever its state changed
+ */
+static bool merge(Verifier* v, u32 ip, const u8* types) {
+    u32 s = v->slot[ip];
+
+    if (s == NO_SLOT) {
+        if (v->nslots == v->capslots) {
+            u32 cap = v->capslots ? v->capslots * 2 : 16;
+            u8* grown = (u8*)realloc(v->states, (size_t)cap * v->regc);
+            u32* owners = (u32*)realloc(v->owner, cap * sizeof(u32));
+            if (grown) v->states = grown;
+            if (owners) v->owner = owners;
+            if (!grown || !owners) return false;
+            v->capslots = cap;
+        }
+
+        s = v->nslots++;
+        v->slot[ip] = s;
+        v->owner[s] = ip;
+        memcpy(v->states + (size_t)s * v->regc, types, v->regc);
+        return push_work(v, ip);
+    }
+
+    u8* state = v->states + (size_t)s * v->regc;
+    bool changed = false;
+    for (u32 r = 0; r < v->regc; r++) {
+        if (state[r] != types[r] && state[r] != UNKNOWN) {
+            state[r] = UNKNOWN;
+            changed = true;
+        }
+    }
+    return changed ? push_work(v, ip) : true;
+}
+
+// note what a generic op could be rewritten to on this visit. every visit has to agree
+static void prove(Verifier* v, u32 ip, u8 typed) {
+    if (v->quick[ip] == UNSEEN) v->quick[ip] = typed;
+    else if (v->quick[ip] != typed) v->quick[ip] = 0;
+}
+
+// bail out of walk() on anything unproven
+#define REQUIRE(cond) do { if (!(cond)) return false; } while (0)
+#define REG(r) REQUIRE((u32)(r) < v->regc)
+
+/**
+ * walk one block from a leader until it ends (terminator, unconditional jump) or falls into the next leader
+ * @return false if anything on the way can't be proven
+ */
+static bool walk(Verifier* v, u32 start) {
+    VM* vm = v->vm;
+    u8* cur = v->cur;
+    memcpy(cur, v->states + (size_t)v->slot[start] * v->regc, v->regc);
+
+    for (u32 i = start; ; i++) {
+        // falling off the end of the stream is a reachable no halt
+        REQUIRE(i < vm->icount);
+        if (i != start && v->leader[i]) return merge(v, i, cur);
+
+        const Inst* in = &vm->code[i];
+        switch (in->op) {
+            case HALT:
+            case PANIC:
+                return true;
+
+            case RET:
+                REG(in->a);
+                return true;
+
+            // the callee (verified on its own) takes over the frame, so nothing after this runs
+            case TAILCALL:
+                REG(in->a);
+                REG((u32)in->a + in->b);
+                return true;
+
+            case JMP:
+                REQUIRE(in->x.target < vm->icount);
+                return merge(v, in->x.target, cur);
+
+            // any type is fine for truthiness
+            case JMPIF:
+            case JMPIFZ:
+                REG(in->a);
+                REQUIRE(in->x.target < vm->icount);
+                if (!merge(v, in->x.target, cur)) return false;
+                break;
+
+            case COPY:
+                REG(in->a); REG(in->b);
+                cur[in->a] = cur[in->b];
+                break;
+
+            case MOVE:
+                REG(in->a); REG(in->b);
+                cur[in->a] = cur[in->b];
+                cur[in->b] = NUL;
+                break;
+
+            case WIDE:
+                break;
+
+            // every case is a way out (the fallthrough is the next instruction, handled like any other)
+            case JMPTABLE: {
+                REG(in->a);
+                REQUIRE(cur[in->a] == I64);
+                u32 ncases;
+                const u32* cases = decoded_cases(in, &ncases);
+                for (u32 c = 0; c < ncases; c++) {
+                    REQUIRE(cases[c] < vm->icount);
+                    if (!merge(v, cases[c], cur)) return false;
+                }
+                break;
+            }
+
+            // index, limit and step all have to be proven the loop's type, both ways out keep them
+            case FORPREP: case FORLOOP:
+            case FORPREP_D: case FORLOOP_D: {
+                u8 type = in->op == FORPREP || in->op == FORLOOP ? I64 : DOUBLE;
+                REG(in->a); REG((u32)in->a + 2);
+                REQUIRE(cur[in->a] == type && cur[in->a + 1] == type && cur[in->a + 2] == type);
+                REQUIRE(in->x.target < vm->icount);
+                if (!merge(v, in->x.target, cur)) return false;
+                break;
+            }
+
+            case LOADI:
+                REG(in->a);
+                cur[in->a] = I64;
+                break;
+
+            // constants never change so their type is known for good
+            case LOADC:
+                REG(in->a);
+                cur[in->a] = in->aux;
+                break;
+
+            // globals can be stored to from anywhere
+            case LOADG:
+                REG(in->a);
+                cur[in->a] = UNKNOWN;
+                break;
+
+            case STOREG:
+                REG(in->a);
+                break;
+
+            // the callee's window starts at the args, so everything above the function register could
+            // come back changed. args have to be in the window too
+            case CALL:
+                REG(in->a); REG(in->c);
+                REG((u32)in->a + in->b);
+                memset(cur + in->a + 1, UNKNOWN, v->regc - in->a - 1);
+                cur[in->c] = UNKNOWN;
+                break;
+
+            case LNOT:
+                REG(in->a);
+                REQUIRE(cur[in->a] == BOOL);
+                break;
+
+            // the length/index has to be proven, the array is always checked (an OBJ could be any kind).
+            // elements can be anything
+            case NEWARR:
+                REG(in->a); REG(in->b);
+                REQUIRE(cur[in->b] == I64);
+                cur[in->a] = OBJ;
+                break;
+
+            case ARRGET:
+                REG(in->a); REG(in->b); REG(in->c);
+                REQUIRE(cur[in->c] == I64);
+                cur[in->a] = UNKNOWN;
+                break;
+
+            case ARRSET:
+                REG(in->a); REG(in->b); REG(in->c);
+                REQUIRE(cur[in->b] == I64);
+                break;
+
+            case ARRLEN:
+                REG(in->a); REG(in->b);
+                cur[in->a] = I64;
+                break;
+
+            // bulk ops check their element types themselves, only the count has to be proven
+            case ARRFILL: case ARRADD:
+                REG(in->a); REG(in->b);
+                break;
+
+            case ARRCOPY:
+                REG(in->a); REG(in->b); REG(in->c);
+                REQUIRE(cur[in->c] == I64);
+                break;
+
+            case ARRSUM:
+                REG(in->a); REG(in->b);
+                cur[in->a] = UNKNOWN;
+                break;
+
+            // tables check their keys at runtime (only a string can be an OBJ key), values can be anything
+            case NEWTABLE:
+                REG(in->a);
+                cur[in->a] = OBJ;
+                break;
+
+            case GETELEM:
+                REG(in->a); REG(in->b); REG(in->c);
+                cur[in->a] = UNKNOWN;
+                break;
+
+            case SETELEM:
+                REG(in->a); REG(in->b); REG(in->c);
+                break;
+
+            // strings are OBJs like any other, CONCAT and STRLEN check the kind at runtime
+            case CONCAT:
+                REG(in->a); REG(in->b); REG(in->c);
+                cur[in->a] = OBJ;
+                break;
+
+            case STRLEN:
+                REG(in->a); REG(in->b);
+                cur[in->a] = I64;
+                break;
+
+            // generic ops guard their own types at runtime so they never need a proof,
+            // but when both sources are proven the same type the op can skip quickening entirely
+            case ADD_N: case SUB_N: case MUL_N: case DIV_N: case MOD_N:
+            case EQ_N: case NEQ_N: case GT_N: case GE_N: case LT_N: case LE_N: {
+                REG(in->a); REG(in->b); REG(in->c);
+                u8 type = cur[in->b] == cur[in->c] ? cur[in->b] : UNKNOWN;
+                u8 typed = quicken_op(in->op, type, false);
+                prove(v, i, typed);
+                cur[in->a] = in->op >= EQ_N ? BOOL : (typed ? type : UNKNOWN);
+                break;
+            }
+
+            case NEG_N:
+                REG(in->a);
+                prove(v, i, quicken_op(in->op, cur[in->a], false));
+                break;
+
+            default: {
+                const Sig* sig = &SIGS[in->op];
+                switch (sig->shape) {
+                    case SIG_BINARY:
+                        REG(in->a); REG(in->b); REG(in->c);
+                        REQUIRE(cur[in->b] == sig->in && cur[in->c] == sig->in);
+                        cur[in->a] = sig->out;
+                        break;
+
+                    case SIG_UNARY:
+                        REG(in->a);
+                        REQUIRE(cur[in->a] == sig->in);
+                        break;
+
+                    case SIG_CAST:
+                        REG(in->a); REG(in->b);
+                        REQUIRE(cur[in->b] == sig->in);
+                        cur[in->a] = sig->out;
+                        break;
+
+                    // traps, unimplemented opcodes, anything else we don't know about
+                    default:
+                        return false;
+                }
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * verify everything reachable from one entry point
+ * @param v verifier (leaders already built)
+ * @param entry ip to start at
+ * @param regc the function's register window
+ */
+static bool verify_function(Verifier* v, u32 entry, u32 regc) {
+    if (entry >= v->vm->icount || regc == 0) return false;
+
+    // fresh per function state (states are regc wide, so they can't be shared)
+    v->regc = regc;
+    v->nslots = 0;
+    v->capslots = 0;
+    v->nwork = 0;
+    free(v->states);
+    free(v->owner);
+    free(v->cur);
+    v->states = NULL;
+    v->owner = NULL;
+    v->cur = (u8*)malloc(regc);
+    if (!v->cur) return false;
+
+    // args and leftovers from earlier frames could be anything
+    memset(v->cur, UNKNOWN, regc);
+    bool ok = merge(v, entry, v->cur);
+    while (ok && v->nwork > 0) {
+        ok = walk(v, v->work[--v->nwork]);
+    }
+
+    // put slot[] back the way the next function expects it
+    for (u32 s = 0; s < v->nslots; s++) v->slot[v->owner[s]] = NO_SLOT;
+    return ok;
+}
+
+bool vm_verify(VM* vm) {
+    if (!VM_VERIFY || !vm || !vm->code || vm->icount == 0) return false;
+
+    Verifier v = { .vm = vm };
+    bool ok = false;
+
+    v.leader = (bool*)calloc(vm->icount, sizeof(bool));
+    v.slot = (u32*)malloc(vm->icount * sizeof(u32));
+    v.quick = (u8*)malloc(vm->icount);
+    if (!v.leader || !v.slot || !v.quick) goto done;
+    memset(v.quick, UNSEEN, vm->icount);
+    for (u32 i = 0; i < vm->icount; i++) v.slot[i] = NO_SLOT;
+
+    // paths merge at jump targets and function entries
+    v.leader[0] = true;
+    for (u32 i = 0; i < vm->icount; i++) {
+        const Inst* in = &vm->code[i];
+        u32 target = decoded_target(in);
+        if (target < vm->icount) v.leader[target] = true;
+
+        u32 ncases;
+        const u32* cases = decoded_cases(in, &ncases);
+        for (u32 c = 0; c < ncases; c++) {
+            if (cases[c] < vm->icount) v.leader[cases[c]] = true;
+        }
+    }
+
+    // every function reachable through a CALLABLE constant (has to have been patched by the loader)
+    for (u32 i = 0; i < vm->constcount; i++) {
+        if (vm->consttypes[i] != CALLABLE) continue;
+        if (!vm->funcs || !vm->funcs[i] || vm->funcs[i]->kind != BYTECODE) goto done;
+        if (vm->funcs[i]->as.bc.entry_ip >= vm->icount) goto done;
+        v.leader[vm->funcs[i]->as.bc.entry_ip] = true;
+    }
+
+    // entry code runs in the entry frame
+    if (!verify_function(&v, 0, BASE_REGISTERS)) goto done;
+
+    for (u32 i = 0; i < vm->constcount; i++) {
+        if (vm->consttypes[i] != CALLABLE) continue;
+        const BytecodeFunc* fn = &vm->funcs[i]->as.bc;
+        if (!verify_function(&v, fn->entry_ip, fn->regc)) goto done;
+    }
+    ok = true;
+
+    // everything checked out, so the proven generic ops can go straight to their typed op
+    for (u32 i = 0; i < vm->icount; i++) {
+        if (v.quick[i] != UNSEEN && v.quick[i] != 0) vm->code[i].op = v.quick[i];
+    }
+
+done:
+    free(v.leader);
+    free(v.slot);
+    free(v.owner);
+    free(v.states);
+    free(v.work);
+    free(v.cur);
+    free(v.quick);
+    return ok;
+}
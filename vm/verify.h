@@ -0,0 +1,45 @@
+/**
+ * @file verify.h
+ * @author Noah Mingolelli
+ * @brief load time bytecode verifier. proving a program is well formed is what lets it run without runtime checks
+ * License: GPLv3
+ *
+ * runs over the decoded stream (so after vm_decode) once per function: the entry code at ip 0 (with the
+ * entry frame's BASE_REGISTERS) and every function found through the CALLABLE constants (with its own regc).
+ * each one is walked along every reachable path, tracking the type held in each register.
+ *
+ * a program verifies when, on every reachable path:
+ * - every register an instruction names is below the function's regc (frames can't step on each other)
+ * - every jump lands inside the stream (no reachable out of range jump traps)
+ * - every const/global index is valid (no reachable pool traps)
+ * - every opcode is implemented, and execution never runs off the end
+ * - every typed operation is proven to get the type it requires
+ *
+ * types are tracked per register with a flat lattice (a known tag, or unknown). LOADI/LOADC and typed
+ * ops produce known types, LOADG, CALL results, and function arguments are unknown (the format doesn't
+ * carry types for them). paths merge by keeping types that agree and dropping the rest.
+ *
+ * generic ops (ADD_N..LE_N) check their own types so they never stop a program from verifying. when a
+ * program does verify, every generic op whose sources were proven the same numeric type is rewritten
+ * into the plain typed op up front (see quicken.h), the rest quicken themselves when they run.
+ *
+ * anything that doesn't verify still runs, just in the checked loop. nothing about behavior changes.
+ */
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include "vm.h"
+
+// build with -DVM_VERIFY=0 (make VERIFY=0) to always run the checked loop
+#ifndef VM_VERIFY
+#define VM_VERIFY 1
+#endif
+
+/**
+ * verify every function in a decoded program
+ * @param vm a vm that has been through vm_load (and so vm_decode)
+ * @return true if the whole program can run in the unchecked loop
+ */
+bool vm_verify(VM* vm);
+
+#endif
@@ -4,6 +4,15 @@
  * doccing this later cuz i would rather kill myself rn no cap
  */
 #include "vm.h"
+#include "decode.h"
+#include "verify.h"
+#include "fuse.h"
+#include "quicken.h"
+#include "jit.h"
+#include "aot.h"
+#include "array.h"
+#include "table.h"
+#include "str.h"
 #include "io/reader.h"
 
 // listing of all error messages. im making it work then im modularizing. alr prematurely optimized lol
@@ -27,6 +36,8 @@ const char *const MESSAGES[] = {
     "Call failed",
     "Type mismatch",
     "Invalid opcode",
+    "For loop step is zero",
+    "Index out of bounds",
 };
 
 /**
@@ -36,8 +47,8 @@ const char *const MESSAGES[] = {
 void vm_init(VM* vm) {
     if (!vm) return;
     *vm = (VM){0};
-
-    // TODO: potentially limit registers and frames here (maxregs and maxframes)
+    vm->maxframes = MAX_FRAMES;
+    gc_init(vm, &vm->gc);
 }
 
 /**
@@ -48,21 +59,45 @@ void vm_free(VM* vm) {
     // if already nulled no worry
     if (vm == NULL) return;
 
+    // every object goes first, nothing below needs them
+    gc_free(vm, &vm->gc);
+    free(vm->interns.items);
+    vm->interns = (Interns){0};
+
     // free any leftovers
     if (vm->regs) {
-        free(vm->regs);
+        regs_free(vm->regs);
         vm->regs = NULL;
     }
 
     // free all functions (now stored separately cuz its way safer)
     if (vm->funcs) {
-        for (u32 i = 0; i < vm->funccount; i++) {
-            free(vm->funcs[i]);
+        // indexed by constant (NULL for anything not callable), so it's constcount long
+        for (u32 i = 0; i < vm->constcount; i++) {
+            jit_free(vm->funcs[i]);
         }
         free(vm->funcs);
         vm->funcs = NULL;
         vm->funccount = 0;
     }
+    slab_release(&vm->funcslab);
+
+    // decoded stream is built from (and freed with) the packed one, same for its call caches
+    if (vm->code) {
+        free(vm->code);
+        vm->code = NULL;
+    }
+    if (vm->ics) {
+        free(vm->ics);
+        vm->ics = NULL;
+        vm->iccount = 0;
+    }
+    if (vm->tables) {
+        for (u32 i = 0; i < vm->tablecount; i++) free(vm->tables[i]);
+        free(vm->tables);
+        vm->tables = NULL;
+        vm->tablecount = 0;
+    }
 
     // free instruction stream (casting to void pointer shuts the compiler up)
     if (vm->istream) {
@@ -71,27 +106,34 @@ void vm_free(VM* vm) {
         vm->icount  = 0;
     }
 
-    // any dead frames get nulled out
-    if (vm->frames) {
-        free(vm->frames);
-        vm->frames = NULL;
+    // any dead frames get nulled out (every segment, from the bottom up)
+    if (vm->seg) {
+        FrameSeg* seg = vm->seg;
+        while (seg->prev) seg = seg->prev;
+        while (seg) {
+            FrameSeg* next = seg->next;
+            free(seg);
+            seg = next;
+        }
+        vm->seg = NULL;
+        vm->current = NULL;
         vm->framecount = 0;
-        vm->framecap = 0;
     }
 
 
-    // the vm will store globals, so we can free them here
+    // the vm will store globals, so we can free them here (tags go with the payloads)
     if (vm->globals) {
         free(vm->globals);
         vm->globals = NULL;
+        vm->globaltypes = NULL;
         vm->globalcount = 0;
     }
 
-    // reset non-owned fields to safe defaults. null out constant pool
-    // TODO: i am not freeing the constant pool. pissing memory
+    // same for the constant pool
     if (vm->consts) {
         free((void*)vm->consts);
         vm->consts = NULL;
+        vm->consttypes = NULL;
         vm->constcount = 0;
     }
 
@@ -100,13 +142,28 @@ void vm_free(VM* vm) {
 }
 
 
+// split on-disk Values into aligned payloads with the tags right after them (one allocation, like the register
+// file). no Values (globals without an initializer) means all NUL. NULL on out of memory
+static TypedValue* split_pool(const Value* pool, u32 count, u8** types) {
+    TypedValue* vals = (TypedValue*)malloc((size_t)count * (sizeof(TypedValue) + 1));
+    if (!vals) return NULL;
+
+    *types = (u8*)(vals + count);
+    for (u32 i = 0; i < count; i++) {
+        vals[i].u = 0;
+        (*types)[i] = pool ? pool[i].type : NUL;
+        if (pool) memcpy(&vals[i], pool[i].val, sizeof(u64));
+    }
+    return vals;
+}
+
 /**
- * load a compiled chunk into the VM instance. the VM takes ownership of the instructions
+ * load a compiled chunk into the VM instance. the VM takes ownership of the instructions, the pools are copied
  * DO NOT REUSE A VM
  * @param vm a pointer to the `VM` to load into
  * @param code `Instruction` stream pointer
  * @param instrcount `Instruction` count
- * @param consts constant pool pointer
+ * @param consts constant pool pointer (as read from the file, callables already patched to their Func*)
  * @param constcount number of constants
  * @param globals_init initial globals (copied into owned storage)
  * @param globalcount number of globals
@@ -133,6 +190,8 @@ void vm_load(
     vm->ip = 0;
     vm->panic_code = NO_ERROR;
     vm->framecount = 0;
+    vm->current = NULL;
+    while (vm->seg && vm->seg->prev) vm->seg = vm->seg->prev;
 
     // take ownership of the instructions (no copy, 8 = out of memory)
     if (instrcount > 0) {
@@ -145,58 +204,84 @@ void vm_load(
         vm->icount = instrcount;
     }
 
-    // set constants to provided pool (will be dealt with on load of file)
-    vm->consts = consts;
-    vm->constcount = constcount;
+    // split both pools out of their 9 byte on-disk form, loads and stores never touch a packed Value again
+    if (constcount > 0) {
+        u8* types;
+        vm->consts = split_pool(consts, constcount, &types);
+        if (!vm->consts) {
+            vm->panic_code = PANIC_OOM;
+            return;
+        }
+        vm->consttypes = types;
+        vm->constcount = constcount;
 
-    // allocate globals (if necessary, if none just return)
-    if (globalcount == 0) return;
-    vm->globals = (Value*)calloc(globalcount, sizeof(Value));
-    if (!vm->globals) {
-        vm->panic_code = PANIC_OOM;
-        return;
+        // string constants come in as their bytes, they're made into strings before anything can load them
+        if (!str_load(vm)) return;
     }
 
-    vm->globalcount = globalcount;
-    if (globals_init) {
-        memcpy(vm->globals, globals_init, globalcount * sizeof(Value));
+    if (globalcount > 0) {
+        vm->globals = split_pool(globals_init, globalcount, &vm->globaltypes);
+        if (!vm->globals) {
+            vm->panic_code = PANIC_OOM;
+            return;
+        }
+        vm->globalcount = globalcount;
+    }
+
+    // everything the decoder resolves against is in place, build the stream vm_run executes
+    // then see if it can run without checks. fusion goes last, the verifier only knows real opcodes.
+    // transpiled functions (if this build has any for this program) get bound once everything's settled
+    if (vm->istream && vm_decode(vm)) {
+        vm->verified = vm_verify(vm);
+        vm_fuse(vm);
+        vm->stats.aot_bound = aot_bind(vm);
     }
 }
 
-/**
- * add a frame to the stack
- */
-static inline bool push_frame(VM* vm, Frame *frame) {
-    if (!vm || !frame) return false;
+// the segment the next push lands in: the bottom one for an empty stack, otherwise the one above the current
+// (the spare if there is one, a fresh one if not)
+static FrameSeg* next_segment(VM* vm) {
+    FrameSeg* below = vm->current ? vm->seg : NULL;
+    FrameSeg* seg = below ? below->next : vm->seg;
+    if (seg) return seg;
 
-    // grows will be x2 here too, base of 8
-    if (vm->framecount >= vm->framecap) {
-        u32 newmax = vm->framecap == 0 ? 8 : vm->framecap * 2;
-        if (newmax > MAX_FRAMES) newmax = MAX_FRAMES;
+    seg = (FrameSeg*)malloc(sizeof(FrameSeg));
+    if (!seg) {
+        vm->panic_code = PANIC_OOM;
+        return NULL;
+    }
+    seg->prev = below;
+    seg->next = NULL;
+    if (below) below->next = seg;
+    return seg;
+}
 
-        // already at max capacity
-        if (vm->framecount >= newmax) {
-            vm->panic_code = PANIC_STACK_OVERFLOW;
-            return false;
-        }
+/**
+ * add a frame to the stack and make it current. frames never move once pushed, so pointers to them stay good
+ */
+static inline bool push_frame(VM* vm, const Frame *frame) {
+    if (LIKELYFALSE(vm->framecount >= vm->maxframes)) {
+        vm->panic_code = PANIC_STACK_OVERFLOW;
+        return false;
+    }
 
-        // alloc, poll, and set counters properly
-        Frame* newframes = (Frame*)realloc(vm->frames, newmax * sizeof(Frame));
-        if (!newframes) {
-            vm->panic_code = PANIC_OOM;
-            return false;
-        }
-        vm->frames = newframes;
-        vm->framecap = newmax;
+    // the next slot in this segment, or the first one of the next
+    Frame* at = vm->current + 1;
+    if (LIKELYFALSE(!vm->current || at == vm->seg->frames + FRAME_SEG)) {
+        FrameSeg* seg = next_segment(vm);
+        if (!seg) return false;
+        vm->seg = seg;
+        at = seg->frames;
     }
 
-    // push the frame
-    vm->frames[vm->framecount++] = *frame;
+    *at = *frame;
+    vm->current = at;
+    vm->framecount++;
     return true;
 }
 
 /**
- * pop a frame from the stack
+ * pop a frame from the stack, the one under it becomes current (NULL once it's empty)
  * @param vm the vm instance
  * @param out optional pointer to store the popped frame
  */
@@ -205,51 +290,37 @@ static inline bool pop_frame(VM* vm, Frame *out) {
         if (vm) vm->panic_code = PANIC_STACK_UNDERFLOW;
         return false;
     }
-    vm->framecount--;
 
     // TODO: look into coroutines, generators, and etc. this is why it's a "pop" not a destruction
-    if (out) *out = vm->frames[vm->framecount];
-    return true;
-}
-
-/**
- * jump to a relative offset. used for JMP, JMPIF, and JMPIFZ. improved safety by casting to int64 (avoiding overflows)
- * @param vm a vm struct to read from
- * @param off the offset to jump forward or backwards from
- */
-static inline bool jump_rel(VM* vm, i32 off) {
-    i64 next = (i64)vm->ip + (i64)off;
+    if (out) *out = *vm->current;
+    vm->framecount--;
 
-    // (2 = register overflow)
-    if (next < 0 || next >= (i64)vm->icount) {
-        vm->panic_code = PANIC_OOB;
-        return false;
+    if (vm->framecount == 0) vm->current = NULL;
+    else if (LIKELYTRUE(vm->current != vm->seg->frames)) vm->current--;
+    else {
+        // stepping down a segment. the one we left becomes the spare, whatever was above it goes
+        FrameSeg* left = vm->seg;
+        if (left->next) {
+            free(left->next);
+            left->next = NULL;
+        }
+        vm->seg = left->prev;
+        vm->current = vm->seg->frames + FRAME_SEG - 1;
     }
-
-    vm->ip = (u32)next;
     return true;
 }
 
-/**
- * copy a value from register to register (nulling does not happen here)
- * @param vm a vm struct to read from
- * @param dest the register to copy to
- * @param src the register to copy from
- */
-static inline bool copy(VM* vm, u32 dest, u32 src, u32 offset) {
-    // assess the need, based on destination or src, and grow if needed
-    u32 need = (dest > src ? dest : src) + vm->current->base + 1;
-    if (!ensure_regs(vm, need)) return false;
-
-    // move from source to destination, zero out source register
-    vm->regs->types[dest + offset] = vm->regs->types[src + offset];
-    vm->regs->payloads[dest + offset] = vm->regs->payloads[src + offset];
-    return true;
+// the caller of the current frame (NULL for the entry frame)
+static inline Frame* frame_below(VM* vm) {
+    if (vm->framecount < 2) return NULL;
+    return vm->current != vm->seg->frames ? vm->current - 1 : vm->seg->prev->frames + FRAME_SEG - 1;
 }
 
 /**
  * when run, if this is a native function it's just called normally (i think maybe i should create a stack frame but TODO)
- * if this is a bytecode function. base is the register index where args start.
+ * if this is a bytecode function its frame starts AT base (the register index where args start), so the callee's
+ * window overlaps the caller's from the args up. anything the caller had above the function register is fair game
+ * for the callee, the return value goes to reg in the caller's window when it RETs.
  */
 bool vm_call(VM *vm, Func *fn, u32 base, u16 argc, u16 reg) {
     if (!vm || !fn) return false;
@@ -259,23 +330,23 @@ bool vm_call(VM *vm, Func *fn, u32 base, u16 argc, u16 reg) {
             // validate argc before doing anything
             if (argc != fn->as.bc.argc) return false;
 
-            // ensure frames (calc via base)
-            Frame* caller = vm->current;
-            u16 new_base = caller->base + caller->regc;
-            if (!ensure_regs(vm, new_base + fn->as.bc.regc)) return false;
+            // the callee's window starts right on the args (overlapping the caller's), so they're its r0.. with
+            // no copying. the window has to cover whatever registers the code names, checking that once here
+            // is what lets the handlers index registers without a bounds check
+            u32 new_base = base;
+            u32 window = fn->as.bc.regc > vm->regspan ? fn->as.bc.regc : vm->regspan;
+            if (!ensure_regs(vm, new_base + window)) return false;
 
             // push frame (safely ofc) and update fp
             Frame callee_frame = {
                 .jump = vm->ip,
                 .base = new_base,
-                .regc = fn->as.bc.regc,
-                .reg = reg,
-                .callee = fn
+                .fn = fn->as.bc.id,
+                .reg = reg
             };
             if (!push_frame(vm, &callee_frame)) return false;
-            vm->current = &vm->frames[vm->framecount - 1];
 
-            // jump (args are in the first slots so saves us some bullshit)
+            // jump (args are already in the first slots)
             vm->ip = fn->as.bc.entry_ip;
             return true;
         }
@@ -293,6 +364,51 @@ bool vm_call(VM *vm, Func *fn, u32 base, u16 argc, u16 reg) {
     }
 }
 
+/**
+ * tail call. no frame gets pushed, fn just takes over the current one: same base, same return address,
+ * same return register, so when it returns it goes straight back to whoever called us.
+ * the args (argc registers from base) get moved down to the first slots of the frame.
+ * a native runs right away, its result goes to our caller, and the frame is popped like a RET
+ */
+bool vm_tailcall(VM* vm, Func* fn, u32 base, u16 argc) {
+    if (!vm || !fn || !vm->current) return false;
+    Frame* frame = vm->current;
+
+    switch (fn->kind) {
+        case BYTECODE: {
+            if (argc != fn->as.bc.argc) return false;
+
+            // same window rule as vm_call, just from the base we already have
+            u32 window = fn->as.bc.regc > vm->regspan ? fn->as.bc.regc : vm->regspan;
+            if (!ensure_regs(vm, frame->base + window)) return false;
+
+            // args sit above the slots they're moving to and can overlap them
+            regs_move(vm->regs, frame->base, base, argc);
+
+            // reuse the frame, only what it's running changes
+            frame->fn = fn->as.bc.id;
+            vm->ip = fn->as.bc.entry_ip;
+            return true;
+        }
+
+        // the result is our caller's. the entry frame has no caller so it just lands in its own window
+        case NATIVE: {
+            if (!fn->as.nat.fn || argc != fn->as.nat.argc) return false;
+            Frame* caller = frame_below(vm);
+            u32 dest = (caller ? caller->base : frame->base) + frame->reg;
+            fn->as.nat.fn(vm, base, argc, dest);
+
+            Frame popped;
+            if (!pop_frame(vm, &popped)) return false;
+            vm->ip = popped.jump;
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
 /**
  * close and free safely on a panic. panics can contain 0 and that is just gonna be a runtime error
  * may just make runtime exception handling sep but i feel like this simplifies handling
@@ -312,351 +428,160 @@ u32 vm_panic(u32 code) {
     return code;
 }
 
+// dispatch mode. threaded uses labels as values (gcc/clang only) so every handler ends in its own indirect jump,
+// giving the branch predictor one jump per opcode instead of one shared by all of them. the switch is the strict C99 fallback.
+// make DISPATCH=switch forces the fallback, otherwise it's picked based on the compiler
+#ifndef THREADED_DISPATCH
+  #if defined(__GNUC__) || defined(__clang__)
+    #define THREADED_DISPATCH 1
+  #else
+    #define THREADED_DISPATCH 0
+  #endif
+#endif
+
+// fetch the next decoded instruction. no bounds check, the stream ends in a trap (see decode.h)
+#define FETCH() do { \
+    in = pc++; \
+    if (DEBUG) printf("code: %d\n", in->op); \
+    STAT(vm->stats.dispatches++); \
+} while (0)
+
+// re-point the register window after anything that changes the current frame
+#if VM_NANBOX
+#define SYNC_FRAME() do { \
+    R = vm->regs->payloads + vm->current->base; \
+    W = vm->regs->wide + vm->current->base; \
+} while (0)
+#else
+#define SYNC_FRAME() do { \
+    R = vm->regs->payloads + vm->current->base; \
+    T = vm->regs->types + vm->current->base; \
+} while (0)
+#endif
+
+// handlers are written once with CASE/NEXT/DEFAULT and expand to whichever mode is on
+#if THREADED_DISPATCH
+  #define LABEL(OP)       [OP] = &&op_##OP
+  #define CASE(OP)        op_##OP:
+  #define DEFAULT         op_DEFAULT:
+  #define NEXT            do { FETCH(); goto *labels[in->op]; } while (0)
+  #define DISPATCH_BEGIN  NEXT; {
+  #define DISPATCH_END    }
+#else
+  #define CASE(OP)        case OP:
+  #define DEFAULT         default:
+  #define NEXT            continue
+  #define DISPATCH_BEGIN  for (;;) { FETCH(); switch (in->op) {
+  #define DISPATCH_END    } }
+#endif
+
+// hand off to native code when the frame we just landed in runs a transpiled (aot.h) or jitted (jit.h) function.
+// after a call NATIVE_CALLED also counts it toward the jit if it landed on the entry (a native call comes back
+// to the caller mid function)
+#if VM_JIT || VM_AOT
+  #define NATIVE_ENTER() do { \
+      Func* nf_ = vm->current->fn != FRAME_ENTRY ? vm->funcs[vm->current->fn] : NULL; \
+      if (nf_ && nf_->kind == BYTECODE) { \
+          if (VM_AOT && nf_->as.bc.aot) { \
+              STAT(vm->stats.native_entries++); \
+              pc = code + nf_->as.bc.aot(vm, R, T, (u32)(pc - code)); \
+          } \
+          else if (VM_JIT && nf_->as.bc.jit) pc = code + jit_run(vm, nf_, (u32)(pc - code)); \
+      } \
+  } while (0)
+  #define NATIVE_CALLED() do { \
+      Func* nf_ = vm->current->fn != FRAME_ENTRY ? vm->funcs[vm->current->fn] : NULL; \
+      if (VM_JIT && nf_ && nf_->kind == BYTECODE && !nf_->as.bc.jit && !nf_->as.bc.aot \
+          && (u32)(pc - code) == nf_->as.bc.entry_ip && ++nf_->as.bc.calls == JIT_THRESHOLD) jit_compile(vm, nf_); \
+      NATIVE_ENTER(); \
+  } while (0)
+#else
+  #define NATIVE_ENTER()  do { } while (0)
+  #define NATIVE_CALLED() do { } while (0)
+#endif
+
+// remember a callee in its site's cache. only bytecode functions get cached, natives always take the full path
+static inline void cache_callee(VM* vm, CallCache* ic, Func* fn) {
+    if (fn->kind != BYTECODE) return;
+    ic->fn = fn;
+    ic->entry = fn->as.bc.entry_ip;
+    ic->window = fn->as.bc.regc > vm->regspan ? fn->as.bc.regc : vm->regspan;
+}
+
+// CALL through a cache hit. same frame vm_call would push, minus every check the cache already covers
+static inline bool call_cached(VM* vm, const CallCache* ic, u32 base, u16 reg) {
+    if (!ensure_regs(vm, base + ic->window)) return false;
+
+    Frame callee_frame = {
+        .jump = vm->ip,
+        .base = base,
+        .fn = ic->fn->as.bc.id,
+        .reg = reg
+    };
+    if (!push_frame(vm, &callee_frame)) return false;
+    vm->ip = ic->entry;
+    return true;
+}
+
+// TAILCALL through a cache hit (see vm_tailcall)
+static inline bool tailcall_cached(VM* vm, const CallCache* ic, u32 base, u16 argc) {
+    Frame* frame = vm->current;
+    if (!ensure_regs(vm, frame->base + ic->window)) return false;
+
+    regs_move(vm->regs, frame->base, base, argc);
+    frame->fn = ic->fn->as.bc.id;
+    vm->ip = ic->entry;
+    return true;
+}
+
+// checked and unchecked copies of the run loop (see interp.h)
+#define RUN_LOOP run_checked
+#define VM_CHECKED 1
+#include "interp.h"
+#undef RUN_LOOP
+#undef VM_CHECKED
+
+#define RUN_LOOP run_unchecked
+#define VM_CHECKED 0
+#include "interp.h"
+#undef RUN_LOOP
+#undef VM_CHECKED
+
 /**
- * main vm run loop. while ip < icount execute instructions (may move this)
- * potentially look into a dispatch table, as hash lookup would prob speed up some already tight hot loops
+ * main vm run loop. executes the decoded stream (vm->code) until HALT or a panic
+ * dispatch is either one big switch or direct threaded (see THREADED_DISPATCH), handlers are shared between both.
+ * verified programs (see verify.h) run the unchecked build of the loop, everything else runs the checked one
  * return false if we do not properly hit a halt, or if we hit panic
  * @param vm the `VM` with instructions loaded into it (vm_load)
  */
 bool vm_run(VM* vm) {
     // init checks
-    if (!vm || !vm->istream || !vm->regs) return false;
+    if (!vm || !vm->code || !vm->regs) return false;
 
     // default 0, panic = 0 means no errors
     vm->panic_code = NO_ERROR;
 
-    // ensure a base of 16 registers for the entry frame
-    if (!ensure_regs(vm, BASE_REGISTERS)) return false;
+    // ensure a base of 16 registers for the entry frame (and everything the code names)
+    if (!ensure_regs(vm, BASE_REGISTERS) || !ensure_regs(vm, vm->regspan)) return false;
 
     // push the initial frame (mark return to the absolute end. deciding if this shud be a panic or if halt should do a return)
     // everything is safe i believe it's just a design choice, but i do not know for certain so i'll doubt myself
     Frame entry = {
         .jump = vm->icount,
         .base = 0,
-        .regc = BASE_REGISTERS,
-        .callee = NULL
+        .fn = FRAME_ENTRY
     };
     if (!push_frame(vm, &entry)) return false;
-    vm->current = &vm->frames[vm->framecount - 1];
-
-    while (vm->ip < vm->icount) {
-        // pull current instruction and increment ip
-        Instruction ins = vm->istream[vm->ip++];
-
-        if (DEBUG) printf("code: %d\n", opcode(ins));
-        switch ((Opcode)opcode(ins)) {
-            // normal halt returns with no issues
-            case HALT:
-                return true;
-
-            // panic on failure, panic returns a code from 0-256 with op_a
-            case PANIC:
-                vm->panic_code = op_a(ins);
-                return false;
-
-            // jump (1 instr, signed)
-            case JMP: {
-                i32 off = op_signed_i24(ins);
-                if (!jump_rel(vm, off)) return false;
-                break;
-            }
-
-            // dry these up but this should work lol. just check if val isnt zero or false
-            case JMPIF: {
-                u32 src = op_a(ins) + vm->current->base;
-                i32 off = op_signed_i16(ins);
-
-                if (!ensure_regs(vm, src + 1)) return false;
-
-                // if falsy ignore, but if offset invalid, panic
-                u8 type = vm->regs->types[src];
-                TypedValue payload = vm->regs->payloads[src];
-                if (!value_falsy(type, payload)) {
-                    if (!jump_rel(vm, off)) return false;
-                }
-                break;
-            }
-
-            case JMPIFZ: {
-                u32 src = op_a(ins) + vm->current->base;
-                i32 off = op_signed_i16(ins);
-
-                if (!ensure_regs(vm, src + 1)) return false;
-
-                // if falsy ignore, but if offset invalid, panic
-                u8 type = vm->regs->types[src];
-                TypedValue payload = vm->regs->payloads[src];
-                if (value_falsy(type, payload)) {
-                    if (!jump_rel(vm, off)) return false;
-                }
-                break;
-            }
-
-            // copy WITHOUT nulling
-            case COPY: {
-                u32 dest = op_a(ins);
-                u32 src  = op_b(ins);
-
-                if (!copy(vm, dest, src, vm->current->base)) return false;
-                break;
-            }
-
-            // copy AND null source
-            case MOVE: {
-                u32 dest = op_a(ins);
-                u32 src  = op_b(ins);
-
-                if (!copy(vm, dest, src, vm->current->base)) return false;
-                vm->regs->types[src + vm->current->base] = 0;
-                vm->regs->payloads[src + vm->current->base].u = 0;
-                break;
-            }
-
-            // load an immediate to a register (16 bit)
-            case LOADI: {
-                u32 dest  = op_a(ins);
-                i32 imm   = op_signed_i16(ins);
-
-                // ensure registers then make the move
-                if (!ensure_regs(vm, dest + vm->current->base + 1)) return false;
-
-                // adjust for base and set
-                u32 adjusted = dest + vm->current->base;
-                vm->regs->types[adjusted] = I64;
-                vm->regs->payloads[adjusted].i = imm;
-                break;
-            }
-
-            // load a constant from the CONSTANT pool
-            case LOADC: {
-                u32 dest  = op_a(ins);
-                u32 index = op_b(ins);
-
-                // if no pool or out of bounds panic
-                if (!vm->consts || index >= vm->constcount) {
-                    vm->panic_code = PANIC_OOB;
-                    return false;
-                }
-
-                // ensure registers then make the move
-                u32 adjusted = dest + vm->current->base;
-                if (!ensure_regs(vm, adjusted + 1)) return false;
-                vm->regs->types[adjusted] = vm->consts[index].type;
-                memcpy(&vm->regs->payloads[adjusted], vm->consts[index].val, sizeof(u64));
-                break;
-            }
-
-            // load a global from the pool
-            case LOADG: {
-                u32 dest  = op_a(ins);
-                u32 index = op_b(ins);
-
-                // if no pool or out of bounds panic (really needa fix this name pollution next)
-                if (!vm->globals || index >= vm->globalcount) {
-                    vm->panic_code = PANIC_OOB;
-                    return false;
-                }
-
-                // ensure registers then make the move
-                u32 adjusted = dest + vm->current->base;
-                if (!ensure_regs(vm, adjusted + 1)) return false;
-                vm->regs->types[adjusted] = vm->globals[index].type;
-                memcpy(&vm->regs->payloads[adjusted], vm->globals[index].val, sizeof(u64));
-                break;
-            }
-
-            // store a global to the pool
-            case STOREG: {
-                u32 dest  = op_a(ins);
-                u32 index = op_b(ins);
-
-                if (!vm->globals || index >= vm->globalcount) {
-                    vm->panic_code = PANIC_OOB;
-                    return false;
-                }
-
-                // copy with this ugly shite
-                u32 adjusted = dest + vm->current->base;
-                if (!ensure_regs(vm, adjusted + 1)) return false;
-                vm->globals[index].type = vm->regs->types[adjusted];
-                memcpy(vm->globals[index].val, &vm->regs->payloads[adjusted], sizeof(u64));
-                break;
-            }
-
-            // call a function: CALL func_reg argc dest
-            case CALL: {
-                u32 reg  = op_a(ins);
-                u16 argc = op_b(ins);
-                u16 dest = op_c(ins);
-
-                // bounds check
-                u32 abs = reg + vm->current->base;
-                if (!ensure_regs(vm, abs + 1)) return false;
-
-                // yoink from register
-                if (vm->regs->types[abs] != CALLABLE) {
-                    vm->panic_code = PANIC_INVALID_CALLABLE;
-                    return false;
-                }
-
-                // extract pointer
-                Func* fn = vm->regs->payloads[abs].fn;
-                if (!fn) {
-                    vm->panic_code = PANIC_INVALID_CALLABLE;
-                    return false;
-                }
-
-                // pull args and call
-                if (!vm_call(vm, fn, abs + 1, argc, dest)) {
-                    if (vm->panic_code == 0) vm->panic_code = PANIC_CALL_FAILED;
-                    return false;
-                }
-
-                break;
-            }
-
-            // return from function: RET register
-            case RET: {
-                u32 ret = op_a(ins);
-                u32 abs = ret + vm->current->base;
-
-                // get return val then pop
-                Frame popped;
-                Value returned = {0};
-                if (abs < MAX_REGISTERS) {
-                    returned.type = vm->regs->types[abs];
-                    memcpy(returned.val, &vm->regs->payloads[abs], sizeof(u64));
-                }
-                
-                // if pop somehow failed GET OUT.
-                if (!pop_frame(vm, &popped)) return false;
-
-                // jump ip back and restore previous state
-                if (vm->framecount == 0) return true;
-                vm->current = &vm->frames[vm->framecount - 1];
-                vm->ip = popped.jump;
-
-                // store return value in caller spec
-                u32 adjusted = vm->current->base + popped.reg;
-                vm->regs->types[adjusted] = returned.type;
-                memcpy(&vm->regs->payloads[adjusted], returned.val, sizeof(u64));
-                break;
-            }
-
-            // cast helpers
-            case I2D: CAST_TYPED(I64, i, DOUBLE, d, (double)vm->regs->payloads[src].i); break;
-            case I2F: CAST_TYPED(I64, i, FLOAT,  f, (float)vm->regs->payloads[src].i);  break;
-            case D2I: CAST_TYPED(DOUBLE, d, I64, i, (i64)vm->regs->payloads[src].d);    break;
-            case F2I: CAST_TYPED(FLOAT,  f, I64, i, (i64)vm->regs->payloads[src].f);    break;
-            case I2U: CAST_TYPED(I64, i, U64, u, (u64)vm->regs->payloads[src].i);       break;
-            case U2I: CAST_TYPED(U64, u, I64, i, (i64)vm->regs->payloads[src].u);       break;
-            case U2D: CAST_TYPED(U64, u, DOUBLE, d, (double)vm->regs->payloads[src].u); break;
-            case U2F: CAST_TYPED(U64, u, FLOAT,  f, (float)vm->regs->payloads[src].u);  break;
-            case D2U: CAST_TYPED(DOUBLE, d, U64, u, (u64)vm->regs->payloads[src].d);    break;
-            case F2U: CAST_TYPED(FLOAT,  f, U64, u, (u64)vm->regs->payloads[src].f);    break;
-
-            // all operators muahahaha (i think) 
-            // binary ops, arithmetic and bitwise (default to signed 64-bit)
-            case ADD:   BINOP_I64(+);  break;
-            case SUB:   BINOP_I64(-);  break;
-            case MUL:   BINOP_I64(*);  break;
-            case DIV:   BINOP_I64(/);  break;
-            case MOD:   BINOP_I64(%);  break;
-            case AND:   BINOP_I64(&);  break;
-            case OR:    BINOP_I64(|);  break;
-            case XOR:   BINOP_I64(^);  break;
-            case SHL:   BINOP_I64(<<); break;
-            case SHR:   BINOP_I64(>>); break;
-            // case SAR: figure out what to allow
-
-            // unsigned ops (u64)
-            case ADD_U: BINOP_U64(+);  break;
-            case SUB_U: BINOP_U64(-);  break;
-            case MUL_U: BINOP_U64(*);  break;
-            case DIV_U: BINOP_U64(/);  break;
-            case MOD_U: BINOP_U64(%);  break;
-            case AND_U: BINOP_U64(&);  break;
-            case OR_U:  BINOP_U64(|);  break;
-            case XOR_U: BINOP_U64(^);  break;
-            case SHL_U: BINOP_U64(<<); break;
-            case SHR_U: BINOP_U64(>>); break;
-            
-            // boolean comparison ops
-            case EQ:    CMPOP_I64(==); break;
-            case NEQ:   CMPOP_I64(!=); break;
-            case GT:    CMPOP_I64(>);  break;
-            case GE:    CMPOP_I64(>=); break;
-            case LT:    CMPOP_I64(<);  break;
-            case LE:    CMPOP_I64(<=); break;
-
-            // u64 comparisons
-            case EQ_U:  CMPOP_U64(==); break;
-            case NEQ_U: CMPOP_U64(!=); break;
-            case GT_U:  CMPOP_U64(>);  break;
-            case GE_U:  CMPOP_U64(>=); break;
-            case LT_U:  CMPOP_U64(<);  break;
-            case LE_U:  CMPOP_U64(<=); break;
-
-            // float ops (f32)
-            case ADD_F: BINOP_F32(+);  break;
-            case SUB_F: BINOP_F32(-);  break;
-            case MUL_F: BINOP_F32(*);  break;
-            case DIV_F: BINOP_F32(/);  break;
-            case EQ_F:  CMPOP_F32(==); break;
-            case NEQ_F: CMPOP_F32(!=); break;
-            case GT_F:  CMPOP_F32(>);  break;
-            case GE_F:  CMPOP_F32(>=); break;
-            case LT_F:  CMPOP_F32(<);  break;
-            case LE_F:  CMPOP_F32(<=); break;
-
-            // float ops (f64)
-            case ADD_D: BINOP_F64(+);  break;
-            case SUB_D: BINOP_F64(-);  break;
-            case MUL_D: BINOP_F64(*);  break;
-            case DIV_D: BINOP_F64(/);  break;
-            case EQ_D:  CMPOP_F64(==); break;
-            case NEQ_D: CMPOP_F64(!=); break;
-            case GT_D:  CMPOP_F64(>);  break;
-            case GE_D:  CMPOP_F64(>=); break;
-            case LT_D:  CMPOP_F64(<);  break;
-            case LE_D:  CMPOP_F64(<=); break;
-
-            // unary ops
-            case NEG:    UNOP_I64(-);  break;
-            case NEG_U:  UNOP_U64(-);  break;
-            case NEG_F:  UNOP_F32(-);  break;
-            case NEG_D:  UNOP_F64(-);  break;
-            case BNOT:   UNOP_I64(~);  break;
-            case BNOT_U: UNOP_U64(~);  break;
-            
-            // logical not has special cases. ONLY can be used on boolean values. gonna fix jmpif and jmpifz to be the same mayb
-            // also prolly gonna figure out a way to fucking dry this cuz its just a type check
-            case LNOT: {
-                u32 src = op_a(ins) + vm->current->base;
-
-                if (!ensure_regs(vm, src + 1)) return false;
-                if (vm->regs->types[src] != BOOL) { 
-                    vm->panic_code = PANIC_TYPE_MISMATCH; 
-                    return false; 
-                }
-                
-                vm->regs->payloads[src].u = vm->regs->payloads[src].u ? 0u : 1u;
-                break;
-            }
-
-            // nothing matched (9 = invalid opcode)
-            default: {
-                vm->panic_code = PANIC_INVALID_OPCODE;
-                return false;   
-            }
-        }
-    }
 
-    // (3 = no halt found)
-    vm->panic_code = PANIC_NO_HALT;
-    return false;
+    return vm->verified ? run_unchecked(vm) : run_checked(vm);
 }
 
+// the transpiler (utils/stk2c.c) links everything but this (make aot)
+#ifndef VM_MAIN
+#define VM_MAIN 1
+#endif
+
+#if VM_MAIN
 /**
  * main loop driving this big boy. gonna figure out how to properly modularize next
  */
@@ -691,8 +616,48 @@ int main(int argc, char const *argv[]) {
     bool ok = vm_run(&vm);
     u32 code = vm.panic_code;
 
+    // counters. every fused dispatch stands in for two instructions of the original stream
+    if (VM_STATS) {
+        u64 executed = vm.stats.dispatches + vm.stats.fused;
+        double rate = executed ? 100.0 * (double)(2 * vm.stats.fused) / (double)executed : 0.0;
+        printf(
+            "Stats: %" PRIu64 " dispatches, %" PRIu32 " pairs fused, %" PRIu64 " fused hits (%.1f%% of instructions ran fused)\n",
+            vm.stats.dispatches, vm.stats.pairs, vm.stats.fused, rate
+        );
+        printf(
+            "Stats: %" PRIu64 " generic ops quickened, %" PRIu64 " de-specialized\n",
+            vm.stats.quickened, vm.stats.despecialized
+        );
+        printf(
+            "Stats: %" PRIu64 " call cache hits, %" PRIu64 " misses\n",
+            vm.stats.ic_hits, vm.stats.ic_misses
+        );
+        printf(
+            "Stats: %" PRIu32 " functions jitted, %" PRIu32 " transpiled, %" PRIu64 " native entries\n",
+            vm.stats.jitted, vm.stats.aot_bound, vm.stats.native_entries
+        );
+        gc_sweep_collect(&vm.gc, true); // so the last sweep's frees count
+        printf(
+            "Stats: %" PRIu32 " minor, %" PRIu32 " major collections, %" PRIu64 " bytes promoted, %" PRIu64 " freed\n",
+            vm.gc.minors, vm.gc.majors, vm.gc.promoted, vm.gc.freed
+        );
+        printf(
+            "Stats: %" PRIu64 " incremental gc steps, longest pause %" PRIu64 "us\n",
+            vm.gc.steps, vm.gc.longest
+        );
+        for (u32 c = 0; c < SLAB_CLASSES; c++) {
+            SlabStats* st = &vm.gc.slab.stats[c];
+            if (!st->allocs) continue;
+            printf(
+                "Stats: slab %4" PRIu32 "B: %" PRIu64 " allocated, %" PRIu64 " freed, %" PRIu32 " pages\n",
+                slab_sizes[c], st->allocs, st->frees, st->pages
+            );
+        }
+    }
+
     // free everything safely when done, log any errors
     vm_free(&vm);
     if (!ok && code != 0) vm_panic(code);
     return (int)code;
 }
+#endif
@@ -10,31 +10,50 @@
  * VM -> struct, fields:
  * INSTRUCTIONS:
  * - const Instruction* istream; (VM-owned instruction stream, decays to a pointer)
+ * - Inst* code;                 (decoded stream built from istream at load, what vm_run actually executes)
+ * - CallCache* ics;             (inline caches for every call site in code)
+ * - JumpTable** tables;         (resolved tables for every JMPTABLE in code)
+ * - bool verified;              (set at load if the verifier proved the program, picks the unchecked loop)
  * - u32 icount;                 (number of instructions)
- * - const Value* consts;        (constant pool used by LOADI/LOADC)
+ * - const TypedValue* consts;   (constant pool payloads used by LOADC, split from the file's Values at load)
+ * - const u8* consttypes;       (their tags)
  * - u32 constcount;             (length of constant pool)
  * - u32 ip;                     (instruction pointer, just a flat index into the stream)
  *
  * VALUE: just a typed container
- * - Value* regs;                (flat register array used by all frames)
- * - u32 maxregs;                (capacity of regs array)
+ * - Registers* regs;           (flat register file used by all frames, committed as it grows, see regfile.h)
+ * - u32 regspan;                (highest register any instruction names + 1, checked once per frame instead of per op)
  *
  * GLOBALS: vm always owns
- * - Value* globals;             (globals storage)
+ * - TypedValue* globals;        (globals storage, payloads)
+ * - u8* globaltypes;            (their tags)
  * - u32 globalcount;            (number of globals)
  *
  * FRAMES: all stack frames
- * - Frame* frames;              (call stack array)
+ * - FrameSeg* seg;              (segment holding the current frame, segments are linked both ways)
+ * - Frame* current;             (top of the call stack, NULL when it's empty)
  * - u32 framecount;             (current number of active frames)
- * - u32 maxframes;              (capacity of frames array)
+ * - u32 maxframes;              (deepest the stack can get, MAX_FRAMES unless lowered after vm_init)
  * - u32 panic_code;             (set on error (0 if no error))
  *
  *
- * Frame -> struct, fields:
- * - u32 return_ip;              (where to resume after RET)
- * - u16 base;                   (base register index for this frame)
- * - u16 regc;                   (number of registers reserved by this frame)
- * - Func*    callee;            (the function being executed in this frame)
+ * Frame -> struct, fields: (16 bytes, 4 to a cache line)
+ * - u32 jump;                   (where to resume after RET)
+ * - u32 base;                   (base register index for this frame)
+ * - u32 fn;                     (slot in vm->funcs of the function being executed, FRAME_ENTRY for the entry code)
+ * - u16 reg;                    (register in the caller's window the result goes to)
+ *
+ *
+ * Inst -> struct, fields: (decoded instruction, 16 bytes)
+ * - u8  op;                     (handler to run, an Opcode or one of the internal ones)
+ * - u8  aux;                    (small extra operand for internal ops)
+ * - u16 a, b, c;                (operands widened out of the packed word, registers are frame relative)
+ * - union x;                    (whatever the op needs resolved ahead of time)
+ *   - i64 imm;                  (pre sign extended immediate)
+ *   - double d;                 (double immediate)
+ *   - u32 target;               (absolute jump target)
+ *   - const TypedValue* k;      (constant payload, its tag goes in aux)
+ *   - u32 slot;                 (global index)
  *
  * API:
  * - void vm_init(VM* vm);       (initialize VM fields to safe defaults)
@@ -52,6 +71,10 @@
  *      Value* args, u16 argc,
  *      Value* out
  *   );
+ * - bool vm_tailcall(           (invoke a callable in place of the current frame; returns success)
+ *      VM* vm, Func* fn,
+ *      u32 base, u16 argc
+ *   );
  *
  * HELPERS:
  * - instr_op/instr_a/instr_b/instr_c
@@ -63,10 +86,13 @@
  *
  * NOTES:
  * - Instructions are 32-bit packed values: [op:8][a:8][b:8][c:8].
+ * - The packed stream is only the file format. vm_load decodes it once into Insts so the
+ *   hot loop never shifts, masks, sign extends, or bounds checks an index again.
  * - Registers are a single flat array; each call frame is a window into it
- *   defined by Frame.base and Frame.regc.
+ *   starting at Frame.base, as wide as the callee's window (the larger of its
+ *   regc and vm->regspan, see vm_call and CallCache.window).
  * - Callables are represented by Func (bytecode functions or native hooks).
- * - GC / heap management and more advanced error handling are left to future work.
+ * - The heap and its collector live in heap.h. More advanced error handling is left to future work.
  */
 
 // header spec
@@ -87,10 +113,18 @@
 #include "opcodes.h"
 #include "errors.h"
 #include "heap.h"
+#include "regfile.h"
+#include "nanbox.h"
 
 // debug flag (WILL BE REMOVED)
 #define DEBUG 0
 
+// runtime counters (dispatches, fused pair hits). off unless built with make STATS=1
+#ifndef VM_STATS
+#define VM_STATS 0
+#endif
+#define STAT(x) do { if (VM_STATS) { x; } } while (0)
+
 // read from the header
 #define MAGIC "STIK"
 #define VERSION 1
@@ -130,15 +164,79 @@ static inline i32 op_signed_i24(Instruction ins) {
     return ((i32)(ins << 8)) >> 8;
 }
 
-// call frames
+// per call site inline cache, one for every CALL/TAILCALL (handed out by decode.c). remembers the last bytecode
+// function the site called. argc was checked against the site when it was filled, so a call that lands on the
+// same Func* again skips the type, null, kind and arity checks and goes straight in
+typedef struct CallCache {
+    Func* fn;      // last callee (NULL until the site's first bytecode call)
+    u32   entry;   // its entry_ip
+    u32   window;  // registers needed from its base (max of its regc and regspan)
+} CallCache;
+
+// a JMPTABLE's cases, resolved at load (decode.c). the fallthrough sits at the end so a selector out of range
+// picks it without a second branch
+typedef struct JumpTable {
+    u32 count;      // number of cases
+    u32 targets[];  // count + 1 absolute indices into code, targets[count] is the instruction after the JMPTABLE
+} JumpTable;
+
+// decoded instruction. built once at load (decode.c) so handlers just read fields
+typedef struct Inst {
+    u8  op;    // handler to run (Opcode, or an internal opcode like TRAP)
+    u8  aux;   // small extra operand (fused branch sense, a quickened op's generic op, LOADC's tag), 0 otherwise
+    u16 a;     // src0 (frame relative register, or a small literal like a panic code)
+    u16 b;     // src1
+    u16 c;     // src2
+    union {
+        i64          imm;     // LOADI: already sign extended
+        double       d;       // double immediate (fused LOADC + ADD_D/SUB_D)
+        u32          target;  // JMP/JMPIF/JMPIFZ: absolute index into code (out of range jumps point at a trap)
+        const TypedValue* k;  // LOADC: the constant's payload (constants never change, so the tag is copied into aux)
+        u32          slot;    // LOADG/STOREG: index into the global pool
+        CallCache*   ic;      // CALL/TAILCALL: the site's inline cache
+        const JumpTable* jt;  // JMPTABLE: its resolved table
+    } x;
+} Inst;
+
+// Inst.aux bits for fused pairs (see fuse.h)
+#define FUSE_SENSE 0x01  // compare+branch: jump when the compare is true (JMPIF) instead of false (JMPIFZ)
+#define FUSE_KEEP  0x02  // still write the intermediate (the BOOL, or the loaded register), something may read it
+
+// call frames. kept to 16 bytes: the callee is its slot in vm->funcs rather than a pointer, and the window size
+// isn't stored at all (nothing reads it, the window was checked when the frame was pushed)
 typedef struct Frame {
-    u32   jump;    // where to jump back to upon return
-    u16   base;    // base register index for this call (registers are owned by the vm)
-    u16   regc;    // number of registers reserved for this frame
-    u16   reg;     // register to store return value in
-    Func* callee;  // function currently being executed
+    u32 jump;  // where to jump back to upon return
+    u32 base;  // base register index for this call (registers are owned by the vm)
+    u32 fn;    // function currently being executed (vm->funcs index, FRAME_ENTRY for the entry frame)
+    u16 reg;   // register to store return value in
 } Frame;
 
+#define FRAME_ENTRY 0xFFFFFFFFu
+
+// the call stack is a doubly linked list of these. a frame never moves once pushed, push/pop just step a pointer
+// and only cross into a neighbouring segment at an edge. the segment above the top is kept as a spare (anything
+// past it is freed) so a call/return pair bouncing on an edge doesn't malloc every time
+#define FRAME_SEG 1024
+typedef struct FrameSeg {
+    struct FrameSeg* prev;
+    struct FrameSeg* next;
+    Frame frames[FRAME_SEG];
+} FrameSeg;
+
+
+// what VM_STATS builds count. load time numbers are always filled in
+typedef struct VMStats {
+    u64 dispatches;     // instructions dispatched by the run loop
+    u64 fused;          // of those, how many were fused pairs (each one stands in for 2 instructions)
+    u64 quickened;      // generic ops rewritten into a quickened handler at runtime
+    u64 despecialized;  // quickened guards that missed and put the generic op back
+    u64 ic_hits;        // calls that went through their site's inline cache
+    u64 ic_misses;      // calls that took the full path (and refilled the cache)
+    u64 native_entries; // times the interpreter handed off to native code (jitted or transpiled)
+    u32 jitted;         // functions the jit compiled
+    u32 aot_bound;      // functions bound to transpiled code at load
+    u32 pairs;          // pairs the fusion pass rewrote
+} VMStats;
 
 // the big dawg
 typedef struct VM {
@@ -146,34 +244,58 @@ typedef struct VM {
     const Instruction* istream;
     u32    icount;
 
-    // constant pooling (pulled from using LOADC)
-    const Value* consts;  // constant pool (allocated at compile time)
-    u32 constcount;       // length of pool
+    // decoded stream (icount + trailing traps, see decode.h)
+    Inst*  code;
+    bool   verified;  // passed vm_verify, runs the unchecked loop
+
+    // call site inline caches (one per CALL/TAILCALL in code, see CallCache)
+    CallCache* ics;
+    u32        iccount;
+
+    // jump tables (one per JMPTABLE in code, see JumpTable)
+    JumpTable** tables;
+    u32         tablecount;
+
+    // constant pooling (pulled from using LOADC). split the same way as the register file, payloads aligned and
+    // tags on their own, so loads are plain moves. CALLABLEs already hold their Func*
+    const TypedValue* consts;      // constant payloads (one allocation, the tags sit right after)
+    const u8*         consttypes;  // constant tags
+    u32 constcount;                // length of pool
 
     // instruction pointer
     u32 ip;
 
     // registers (gonna carve Frames via Frame.base as this is a flat array)
     Registers* regs;
+    u32 regspan;  // highest register named by any instruction + 1
 
     // functions (stored sep from registers for easier access, less register usage, and safer free)
     Func** funcs;
     u32    funccount;
+    Slab   funcslab;  // where the Funcs live, they all go at once with the vm (see slab.h)
 
-    // globals table (switching to hash but for rn this is ok)
-    Value* globals;
-    u32    globalcount;
+    // globals table (switching to hash but for rn this is ok). same split as the constants
+    TypedValue* globals;      // payloads (one allocation, the tags sit right after)
+    u8*         globaltypes;  // tags
+    u32         globalcount;
 
-    // call stack
-    Frame* frames;
-    Frame* current;
-    u32    framecount;  // current count
-    u32    framecap;    // max that can be filled BEFORE A RESIZE. max TOTAL is 65536 (MAX_REGISTERS)
+    // call stack (see FrameSeg)
+    FrameSeg* seg;         // segment current lives in (the bottom one while the stack is empty)
+    Frame*    current;     // top frame, NULL when empty
+    u32       framecount;  // current count
+    u32       maxframes;   // limit, push past it is a stack overflow
 
     // last error/panic info
     u32 panic_code;
 
-    // heap/GC hooks coming later
+    // counters (see VMStats)
+    VMStats stats;
+
+    // the heap (see heap.h)
+    GC gc;
+
+    // every string constant, and every short string CONCAT has made that's still alive (see str.h)
+    Interns interns;
 } VM;
 
 
@@ -188,18 +310,22 @@ bool vm_load_file(VM* vm, const char* path);
 void vm_load(
     VM* vm,                                       // pointer to vm (to load into)
     const Instruction* code, u32 instrcount,      // instruction stream (owned by VM after call)
-    const Value* consts, u32 constcount,          // const pool (borrowed)
-    const Value* globals_init, u32 globalcount    // global pool
+    const Value* consts, u32 constcount,          // const pool (borrowed, split into the vm's own copy)
+    const Value* globals_init, u32 globalcount    // global pool (same)
 );
 
 // call entry function (which will be a CALLABLE)
-//  is the register index where args start (so no copies or pointer bullshit)
+// base is the register index where args start, a bytecode callee's window starts there (so no copies or pointer bullshit)
 bool vm_call(
     VM* vm, Func* fn,
     u32 base, u16 argc,
     u16 reg
 );
 
+// tail call: fn takes over the current frame (base, return address, return register) instead of pushing one.
+// base is where the args start, they get moved down into the frame's first slots
+bool vm_tailcall(VM* vm, Func* fn, u32 base, u16 argc);
+
 // run until HALT/PANIC
 bool vm_run(VM* vm);
 
@@ -208,41 +334,41 @@ u32 vm_panic(u32 code);
 
 
 // operation helpers
-// ensure we have enough registers to store a value
+// ensure we have enough registers to store a value, committing more of the file if a frame just reached past it.
+// every window goes through here, so it's also where the collector learns how far up registers can be dirty
 static inline bool ensure_regs(VM* vm, u32 need) {
-    if (need <= MAX_REGISTERS) return true;
-    if (vm) vm->panic_code = PANIC_REG_LIMIT;
+    if (need > vm->regs->dirty) vm->regs->dirty = need;
+    if (LIKELYTRUE(need <= vm->regs->committed)) return true;
+    if (regs_commit(vm->regs, need)) return true;
+    vm->panic_code = need > MAX_REGISTERS ? PANIC_REG_LIMIT : PANIC_OOM;
     return false;
 }
 
-// validate register bounds for an operation with 3 operands and compute their absolute indices
-static inline bool binop_indices(VM* vm, Instruction ins, u32* dest, u32* lhs, u32* rhs) {
-    u32 base = vm->current ? vm->current->base : 0;
-    *dest = op_a(ins) + base;
-    *lhs  = op_b(ins) + base;
-    *rhs  = op_c(ins) + base;
-
-    u32 max = *dest;
-    if (*lhs > max) max = *lhs;
-    if (*rhs > max) max = *rhs;
-
-    return ensure_regs(vm, max + 1);
+// ensure a register holds an expected type
+static inline bool require_type(VM* vm, u8 type, u8 expect) {
+    if (LIKELYFALSE(type != expect)) {
+        vm->panic_code = PANIC_TYPE_MISMATCH;
+        return false;
+    }
+    return true;
 }
 
-// validate register bounds for a unary op and compute its absolute index
-static inline bool unary_index(VM* vm, Instruction ins, u32* idx) {
-    u32 base = vm->current ? vm->current->base : 0;
-    *idx = op_a(ins) + base;
-    return ensure_regs(vm, *idx + 1);
+// an OBJ register that has to hold an array. object kinds are always checked, the verifier can't tell them apart
+static inline ObjArray* as_array(VM* vm, u8 type, TypedValue val) {
+    if (LIKELYFALSE(type != OBJ || obj_inline(val) || obj_kind((ObjHeader*)val.obj) != OBJ_ARRAY)) {
+        vm->panic_code = PANIC_TYPE_MISMATCH;
+        return NULL;
+    }
+    return (ObjArray*)val.obj;
 }
 
-// ensure a specific register holds an expected type
-static inline bool require_type(VM* vm, u32 idx, u8 expect) {
-    if (vm->regs->types[idx] != expect) {
+// same for a table
+static inline ObjTable* as_table(VM* vm, u8 type, TypedValue val) {
+    if (LIKELYFALSE(type != OBJ || obj_inline(val) || obj_kind((ObjHeader*)val.obj) != OBJ_TABLE)) {
         vm->panic_code = PANIC_TYPE_MISMATCH;
-        return false;
+        return NULL;
     }
-    return true;
+    return (ObjTable*)val.obj;
 }
 
 // register a native function. may do this a different way